@@ -0,0 +1,36 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_FIXED_H
+#define PILOMAR_FIXED_H
+
+#include <cstdint>
+
+// Speeds are kept in Q20.12 fixed point. The RP2040 has no FPU, so this keeps
+// soft-float out of the planner and the step interrupts. 20 integer bits allow
+// for step rates well beyond what the PWM can produce, 12 fraction bits give
+// a resolution of 1/4096 Hz.
+typedef int32_t fixed_t;
+
+#define FIXED_SHIFT 12
+#define FIXED_ONE (1 << FIXED_SHIFT)
+
+#define INT_TO_FIXED(x) ((fixed_t)((x) * FIXED_ONE))
+#define FIXED_TO_INT(x) ((int)((x) >> FIXED_SHIFT))
+
+// Conversion from API values, rounds positive non-zero inputs up to one LSB
+// so that very slow requested speeds don't turn into a standstill
+inline fixed_t doubleToFixed(double value)
+{
+    auto result = (fixed_t)(value * FIXED_ONE);
+    if (result == 0 && value > 0)
+        result = 1;
+    return result;
+}
+
+inline double fixedToDouble(fixed_t value)
+{
+    return (double)value / FIXED_ONE;
+}
+
+#endif //PILOMAR_FIXED_H
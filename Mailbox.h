@@ -0,0 +1,51 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_MAILBOX_H
+#define PILOMAR_MAILBOX_H
+
+#include <cstdint>
+#include <hardware/sync.h>
+
+// Ring of Size items between two cores, one only pushes and the other only
+// pops. Each index is written by one side only, so no lock is needed. The
+// barriers keep an item's contents ordered against the index that hands it
+// over.
+template <typename T, uint32_t Size>
+class Mailbox
+{
+public:
+    bool push(const T &item)
+    {
+        uint32_t current = head;
+        if (current - tail == Size)
+            return false;
+
+        items[current % Size] = item;
+        __dmb();
+        head = current + 1;
+
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        uint32_t current = tail;
+        if (head == current)
+            return false;
+
+        __dmb();
+        item = items[current % Size];
+        __dmb();
+        tail = current + 1;
+
+        return true;
+    }
+
+private:
+    T items[Size] = {};
+    volatile uint32_t head = 0;             // Written by the pushing core
+    volatile uint32_t tail = 0;             // Written by the popping core
+};
+
+#endif //PILOMAR_MAILBOX_H
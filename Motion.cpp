@@ -0,0 +1,58 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <pico/multicore.h>
+#include <pico/time.h>
+#include "Motion.h"
+#include "Motor.h"
+
+Mailbox<Motion::Command, MOTION_MAILBOX> Motion::commands;
+Mailbox<bool, MOTION_MAILBOX> Motion::results;
+
+void Motion::start()
+{
+    multicore_launch_core1(&Motion::core1Main);
+}
+
+bool Motion::post(const Command &command)
+{
+    // Motor code calling back into itself is already where it needs to be
+    if (get_core_num() == 1)
+        return command.run(command.context);
+
+    while (!commands.push(command))
+        tight_loop_contents();
+    __sev();
+
+    bool result;
+    while (!results.pop(result))
+        tight_loop_contents();
+
+    return result;
+}
+
+void Motion::core1Main()
+{
+    // Lets core0 park this core in RAM while it writes the flash
+    multicore_lockout_victim_init();
+
+    // Created here, so the motor timers fire on this core
+    Motor::setAlarmPool(alarm_pool_create_with_unused_hardware_alarm(MOTION_TIMERS));
+
+    for (;;)
+    {
+        // Moves end and homing goes on from here once an interrupt left them
+        Motor::service();
+
+        Command command{};
+        if (!commands.pop(command))
+        {
+            // Woken by core0's __sev() or any interrupt
+            __wfe();
+            continue;
+        }
+
+        // Core0 waits for each result, so there is always room
+        results.push(command.run(command.context));
+    }
+}
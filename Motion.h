@@ -0,0 +1,50 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_MOTION_H
+#define PILOMAR_MOTION_H
+
+#include <type_traits>
+#include "Mailbox.h"
+
+// Commands on their way to core1, the caller waits for each one
+#define MOTION_MAILBOX 4
+
+// Repeating timers the motors can have running on core1 at once
+#define MOTION_TIMERS 16
+
+// The motion engine runs on core1: the Motor interrupts and timers,
+// planning and homing. Core0 keeps USB, lwIP and the web server and hands
+// motor work over through a mailbox, so nothing on the network side can
+// hold up a step. Motors have to be created through call() so their
+// interrupts end up on core1. Reading a motor's state is fine from either
+// core.
+class Motion
+{
+public:
+    static void start();
+
+    // Runs function on core1 and waits for it. Captures by reference are
+    // fine, the caller's stack stays put until it returns.
+    template <typename Function>
+    static bool call(Function &&function)
+    {
+        using Callable = std::remove_reference_t<Function>;
+        return post({[](void *context) { return (bool)(*(Callable *)context)(); }, (void *)&function});
+    }
+
+private:
+    struct Command
+    {
+        bool (*run)(void *context);
+        void *context;
+    };
+
+    static Mailbox<Command, MOTION_MAILBOX> commands;
+    static Mailbox<bool, MOTION_MAILBOX> results;
+
+    static bool post(const Command &command);
+    static void core1Main();
+};
+
+#endif //PILOMAR_MOTION_H
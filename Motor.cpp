@@ -2,14 +2,35 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
 // This is the highest wrap resulting in an integral frequency, it represents 1/2 full step per second
-#define MAX_WRAP 62500.0
+#define MAX_WRAP 62500
+
+#define PWM_CLOCK 125000000
 
 #define MIN_HZ 10
 
+// Velocity mode half periods on the timer are polled this often for a
+// change of the rate
+#define VELOCITY_POLL_US 10000
+
 #define SPEED_STEP (31 * options.microsteps)
 #define SPEED_STEP_PULSES (5 * options.microsteps)
 
-#define DIV_MIN ((0x01 << 4) + 0x0)
+// Homing backs up this far from where the endstop triggers, that is zero
+#define HOMING_BACKOFF (125 * options.microsteps)
+
+// Ramp shape of the plan being built, see setRampScale()
+#define RAMP_STEP_FIXED rampStep
+#define RAMP_STEP_PULSES rampPulses
+
+// Fraction bits of the PWM counts of a linear ramp step. Twice the longest
+// period still fits into 32 bits.
+#define LINEAR_SHIFT 14
+
+#define STEP_PIO pio0
+#define STEP_PIO_IRQ PIO0_IRQ_0
+
+// Two words per chunk in the four entry TX FIFO
+#define PIO_FIFO_CHUNKS 2
 
 #include <cstdio>
 #include <hardware/pwm.h>
@@ -17,10 +38,127 @@
 #include <hardware/regs/intctrl.h>
 #include <hardware/irq.h>
 #include <hardware/gpio.h>
+#include <hardware/pio.h>
+#include <hardware/sync.h>
+#include <hardware/structs/timer.h>
+#include <hardware/structs/iobank0.h>
+#if MOTOR_STATS
+#include <hardware/structs/systick.h>
+#endif
 #include "Motor.h"
+#include "PioSegment.h"
+#include "stepper.pio.h"
+
+// Everything a step interrupt can get to, down to the 64 bit divisions,
+// runs from RAM. A flash cache miss there delays the step, and the network
+// side keeps evicting the cache. Planning and homing stay in flash. The
+// build lists what ended up in RAM in pilomar.ram.txt.
+
+// The SDK's time, alarm and pin function calls are in flash. These do the
+// same with the registers, from RAM.
+static uint64_t __not_in_flash_func(timeNow)()
+{
+    // Read until the high word is the same on both sides of the low one
+    uint32_t high = timer_hw->timerawh;
+    for (;;)
+    {
+        uint32_t low = timer_hw->timerawl;
+        uint32_t next = timer_hw->timerawh;
+        if (next == high)
+            return (uint64_t)high << 32 | low;
+        high = next;
+    }
+}
+
+// Arms the alarm for due, in microseconds. True if that has gone by, then
+// the alarm is off and the caller has to step itself. Only the low word is
+// compared, the step alarms are never 2^31 us out.
+static bool __not_in_flash_func(alarmArm)(uint alarm, uint64_t due)
+{
+    uint32_t target = (uint32_t)due;
+    timer_hw->alarm[alarm] = target;
+    if ((int32_t)(timer_hw->timerawl - target) < 0)
+        return false;
+
+    // It may have fired in between, drop that too
+    timer_hw->armed = 1u << alarm;
+    timer_hw->intr = 1u << alarm;
+    return true;
+}
+
+static void __not_in_flash_func(alarmCancel)(uint alarm)
+{
+    timer_hw->armed = 1u << alarm;
+    timer_hw->intr = 1u << alarm;
+}
+
+// The pads were set up by gpio_set_function() in the constructor, changing
+// the function after that only takes the mux
+static void __not_in_flash_func(pinFunction)(uint pin, uint function)
+{
+    iobank0_hw->io[pin].ctrl = function << IO_BANK0_GPIO0_CTRL_FUNCSEL_LSB;
+}
+
+// Largest speed between low and high, to within 1 Hz, that passes test.
+// low has to pass.
+template <typename Test>
+static fixed_t fastestSpeed(fixed_t low, fixed_t high, Test test)
+{
+    if (test(high))
+        return high;
+
+    while (high - low > FIXED_ONE)
+    {
+        fixed_t middle = low + (high - low) / 2;
+        if (test(middle))
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+// Rounded down
+static uint64_t __not_in_flash_func(squareRoot)(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ull << 62;
+
+    while (bit > value)
+        bit >>= 2;
+
+    while (bit != 0)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return root;
+}
 
 bool Motor::initialized = false;
-std::list<Motor *> Motor::instances;
+alarm_pool_t *Motor::alarmPool = nullptr;
+Motor *Motor::slices[NUM_PWM_SLICES] = {};
+Motor *Motor::alarmMotors[NUM_TIMERS] = {};
+uint32_t Motor::alarmMask = 0;
+volatile uint32_t Motor::snapshotSequence = 0;
+Motor *Motor::pioMotors[4] = {};
+bool Motor::pioInitialized = false;
+unsigned Motor::pioProgramOffset = 0;
+uint32_t Motor::modeMask = 0;
+int Motor::modePins[3] = {};
+int Motor::modeMicrosteps = 0;
+volatile int Motor::modeShift = 0;
+volatile int Motor::fineHolds = 0;
 
 Motor::Motor(Pins pins, Options options, int microStepsPerRevolution, int maxSteps)
 {
@@ -57,82 +195,350 @@ Motor::Motor(Pins pins, Options options, int microStepsPerRevolution, int maxSte
 
     sliceNumber = pwm_gpio_to_slice_num(pins.step);
 
-    if (std::find_if(Motor::instances.begin(), Motor::instances.end(),
-                     [this](const Motor *motor) {return motor->sliceNumber == this->sliceNumber;}) != Motor::instances.end())
+    if (Motor::slices[sliceNumber] != nullptr)
     {
         printf("Duplicate slices are not supported\r\n");
         return; // Should throw here but that is disabled on Pico
     }
 
-    Motor::instances.emplace_back(this);
+    Motor::slices[sliceNumber] = this;
 
     if (!initialized)
     {
         irq_set_exclusive_handler(PWM_IRQ_WRAP, &Motor::interruptHandler);
         irq_set_enabled(PWM_IRQ_WRAP, true);
 
+#if MOTOR_STATS
+        // Free running cycle counter for the stats, counting down from 2^24
+        systick_hw->rvr = 0xffffff;
+        systick_hw->cvr = 0;
+        systick_hw->csr = 0x5; // Enabled on the processor clock, no interrupt
+#endif
+
         initialized = true;
     }
     pwm_set_irq_enabled(sliceNumber, true);
 
+    // Slow steps, the alarm interrupt is enabled on this core. The motors
+    // take the interrupt themselves, the SDK's alarm dispatch is in flash.
+    stepAlarm = hardware_alarm_claim_unused(true);
+    alarmMotors[stepAlarm] = this;
+    alarmMask |= 1u << stepAlarm;
+    irq_set_exclusive_handler(TIMER_IRQ_0 + stepAlarm, &Motor::stepAlarmInterrupt);
+    hw_set_bits(&timer_hw->inte, 1u << stepAlarm);
+    irq_set_enabled(TIMER_IRQ_0 + stepAlarm, true);
+
+#if MOTOR_STATS
+    resetStats();
+#endif
+
     pwm_set_clkdiv_mode(sliceNumber, PWM_DIV_FREE_RUNNING);
     pwm_set_clkdiv_int_frac(sliceNumber, 250, 0);
 
-    if (!homed)
-        home();
+    // Homing still runs on the PWM, it needs to see the endstop on every step
+    if (options.backend == PioBackend)
+        initPio();
 
-    add_repeating_timer_ms(1000, alarmHandler, this, &timerData);
+    // A position saved before a restart stands in for homing
+    if (options.startPosition >= 0 && options.startPosition <= maxSteps)
+    {
+        position = options.startPosition;
+        homed = true;
+        if (!options.autoPowerOff && options.callback == nullptr)
+            enableMotor();
+        publishSnapshot();
+    }
 
-    while (!homed)
-        sleep_ms(10);
+    // Homing runs from the step interrupt, the motor refuses moves until
+    // it is done
+    if (!homed)
+        home();
 }
 
 Motor::~Motor()
 {
-    Motor::instances.remove(this);
+    trajectoryCancel();
+    velocityCancel();
+
+    if (Motor::slices[sliceNumber] == this)
+        Motor::slices[sliceNumber] = nullptr;
+
+    if (stepAlarm != -1)
+    {
+        stepAlarmStop();
+        irq_set_enabled(TIMER_IRQ_0 + stepAlarm, false);
+        hw_clear_bits(&timer_hw->inte, 1u << stepAlarm);
+        irq_remove_handler(TIMER_IRQ_0 + stepAlarm, &Motor::stepAlarmInterrupt);
+        alarmMask &= ~(1u << stepAlarm);
+        alarmMotors[stepAlarm] = nullptr;
+        hardware_alarm_unclaim(stepAlarm);
+    }
+
+    if (pioSm != -1)
+    {
+        pio_sm_set_enabled(STEP_PIO, pioSm, false);
+        pio_set_irq0_source_enabled(STEP_PIO, (pio_interrupt_source)(pis_sm0_rx_fifo_not_empty + pioSm), false);
+        pioMotors[pioSm] = nullptr;
+        pio_sm_unclaim(STEP_PIO, pioSm);
+    }
 }
 
-void Motor::setPwmFreq(float freq) const {
-    uint32_t clock = 125000000;
-    auto div = (uint32_t)((double)(clock << 4) / freq / MAX_WRAP);
+// Finest divider that still reaches freq within the 16 bit counter
+uint32_t __not_in_flash_func(Motor::pwmDivFor)(fixed_t freq)
+{
+    // Clock in 1/16 units of the divider
+    uint32_t clock = (uint32_t)PWM_CLOCK << 4;
+
+    // Rounded up, a divider rounded down can push TOP past 16 bits
+    uint32_t div = (((clock / MAX_WRAP) << FIXED_SHIFT) + (uint32_t)freq - 1) / (uint32_t)freq;
     if (div < DIV_MIN) {
         div = DIV_MIN;
     }
     if (div > 254 * 16)
         div = 256 * 16;
-    auto top = (uint32_t)(((double)(clock << 4) / div / freq) - 1);
-    float out = (float)(clock << 4) / (float)div / (float)(top + 1);
+
+    return div;
+}
+
+// With a divider from pwmDivFor() all divisions are 32 bit, which the SDK
+// runs on the SIO hardware divider. Fast entries of a plan with a coarse
+// shared divider need 64 bits, those are normally done at plan time.
+Motor::PwmTiming __not_in_flash_func(Motor::pwmTiming)(fixed_t freq, uint32_t div)
+{
+    uint32_t clock = (uint32_t)PWM_CLOCK << 4;
+
+    // top + 1 = (clock << FIXED_SHIFT) / (div * freq). The numerator is too wide
+    // for 32 bits, so it is long divided four bits at a time.
+    uint32_t top;
+    if ((uint32_t)freq < (1u << 28) / div)
+    {
+        uint32_t divisor = div * (uint32_t)freq;
+        uint32_t quotient = clock / divisor;
+        uint32_t remainder = clock % divisor;
+        for (int bits = 0 ; bits < FIXED_SHIFT ; bits += 4)
+        {
+            remainder <<= 4;
+            quotient = (quotient << 4) + remainder / divisor;
+            remainder %= divisor;
+        }
+        top = quotient - 1;
+    }
+    else
+    {
+        top = (uint32_t)(((uint64_t)clock << FIXED_SHIFT) / ((uint64_t)div * (uint32_t)freq) - 1);
+    }
+
+    // With a divider shared across the plan the usual pulse length may not
+    // fit into the faster periods, so it never goes past half of one
+    uint32_t level = div << 4;
+    if (level > (top + 1) / 2)
+        level = (top + 1) / 2;
 
     // Some code useful for debugging this. Uncomment as needed
-//    printf("Freq = %f, ",         freq);
+//    printf("Freq = %f, ",         fixedToDouble(freq));
 //    printf("Top = %ld, ",         top);
 //    printf("Div = %.2f, ", (float)div/16);
-//    printf("Out = %f\n",          out);
+//    printf("Out = %f\n",          (float)clock / (float)div / (float)(top + 1));
+
+    return {(uint16_t)top, (uint16_t)div, (uint16_t)level};
+}
+
+Motor::PwmTiming __not_in_flash_func(Motor::entryTiming)(const PlanEntry &entry) const
+{
+    if (entry.top != 0)
+        return {entry.top, (uint16_t)active->div, (uint16_t)std::min(active->div << 4, (entry.top + 1u) / 2)};
+
+    return entry.timing != -1 ? active->timings[entry.timing] : pwmTiming(entry.speed, active->div);
+}
+
+// Stop, program and restart the slice. A held start leaves the slice for
+// runCoordinated() to enable.
+void __not_in_flash_func(Motor::applyPwmTiming)(PwmTiming timing)
+{
+    stagedTiming = timing;
+    publishPending = true;
+    timing = modeTiming(timing);
+
+    pwm_set_wrap(sliceNumber, timing.top);
+    pwm_set_chan_level(sliceNumber, PWM_CHAN_A, timing.level);
+    pwm_set_clkdiv_int_frac(sliceNumber, timing.div >> 4, timing.div & 0x0f);
+    statsRestart();
+    if (holdStart)
+    {
+        pwm_set_counter(sliceNumber, 0);
+        startPending = true;
+    }
+    else
+    {
+        pwm_set_enabled(sliceNumber, true);
+    }
+    pwmDiv = timing.div;
+}
+
+// Takes effect at the next wrap, without disturbing the pulse in progress
+void __not_in_flash_func(Motor::stagePwmTiming)(PwmTiming timing)
+{
+    stagedTiming = timing;
+    publishPending = true;
+    timing = modeTiming(timing);
+
+    pwm_set_wrap(sliceNumber, timing.top);
+    pwm_set_chan_level(sliceNumber, PWM_CHAN_A, timing.level);
+}
+
+void __not_in_flash_func(Motor::setPwmFreq)(fixed_t freq)
+{
+    applyPwmTiming(pwmTiming(freq, pwmDivFor(freq)));
+}
+
+// On full steps a pulse covers 1 << modeShift microsteps, so the period is
+// that much longer. One that doesn't fit is capped, that only happens to
+// a slow axis going along with a fast one.
+Motor::PwmTiming __not_in_flash_func(Motor::modeTiming)(PwmTiming timing) const
+{
+    if (modeShift != 0)
+        timing.top = (uint16_t)std::min(((uint32_t)timing.top + 1) << modeShift, (uint32_t)MAX_WRAP) - 1;
+
+    return timing;
+}
+
+// A plan on the PWM. Slower axes of a coordinated move go along with a
+// fast one, their periods capped at the longest the PWM can do. Nothing
+// follows the last entry to take a full step's overrun off, so the last
+// two full steps of the plan are made in microsteps.
+bool __not_in_flash_func(Motor::canTakeFullSteps)() const
+{
+    return state == Running && !velocityMode && pioSm == -1 && !homingSeek && options.fullStepSpeed > 0 &&
+           speed >= INT_TO_FIXED(MIN_HZ) && targetCount > 0 &&
+           abs(targets[targetCount - 1].position - position) >= 2 * options.microsteps;
+}
+
+// Fast enough for full steps, with their period in range
+bool __not_in_flash_func(Motor::wantsFullSteps)() const
+{
+    int shift = __builtin_ctz(options.microsteps);
+
+    return speed >= INT_TO_FIXED(options.fullStepSpeed) && ((uint32_t)stagedTiming.top + 1) << shift <= MAX_WRAP;
+}
+
+// Switches the mode pins to whatever all stepping motors can take. Only
+// acts with none of their pulses waiting to be counted, otherwise the
+// interrupt that counts it comes back here.
+void __not_in_flash_func(Motor::updateMode)()
+{
+    uint32_t pending = pwm_get_irq_status_mask();
+    int microsteps = 0;
+    bool fullSteps = fineHolds == 0 && modeMask != 0;
+    bool wanted = false;
+
+    for (Motor *motor : slices)
+    {
+        if (motor == nullptr || motor->isIdle())
+            continue;
+
+        if (pending & (1u << motor->sliceNumber))
+            return;
+
+        if (!motor->canTakeFullSteps() || (microsteps != 0 && motor->options.microsteps != microsteps))
+            fullSteps = false;
+        microsteps = motor->options.microsteps;
+
+        if (motor->wantsFullSteps())
+            wanted = true;
+
+        // Not on a full step once the pulse it has out is counted
+        int inFlight = 1 << motor->pulseShift;
+        if (((motor->indexer + (motor->direction ? inFlight : -inFlight)) & (microsteps - 1)) != 0)
+            fullSteps = false;
+    }
+
+    int shift = fullSteps && wanted ? __builtin_ctz(microsteps) : 0;
+    if (shift != modeShift)
+    {
+        if (shift != 0)
+            modeMicrosteps = microsteps;
+        setMode(shift);
+    }
+}
+
+// The pulse in progress keeps the period it started with, the next one is
+// on the new mode
+void __not_in_flash_func(Motor::setMode)(int shift)
+{
+    int microsteps = modeMicrosteps >> shift;
+    int bits = __builtin_ctz(microsteps);
+
+    // DRV8825 mode table, M0 to M2 are the bits of log2(microsteps)
+    uint32_t value = 0;
+    for (int i = 0 ; i < 3 ; i++)
+    {
+        if (bits & (1 << i))
+            value |= 1u << modePins[i];
+    }
+    gpio_put_masked(modeMask, value);
+
+    modeShift = shift;
+
+    for (Motor *motor : slices)
+    {
+        if (motor != nullptr && motor->state == Running && !motor->velocityMode)
+            motor->stagePwmTiming(motor->stagedTiming);
+    }
+}
+
+// Called by anything that starts a motor other than on a plan that is
+// already running, the mode is back on microsteps when this returns
+void Motor::holdMicrosteps()
+{
+    fineHolds++;
 
-    pwm_set_wrap(sliceNumber, top);
-    pwm_set_chan_level(sliceNumber, PWM_CHAN_A, div << 4);
-    pwm_set_clkdiv_int_frac(sliceNumber, div >> 4, div & 0x0f);
-    pwm_set_enabled(sliceNumber, true);
+    while (modeShift != 0)
+    {
+        uint32_t interrupts = save_and_disable_interrupts();
+        updateMode();
+        restore_interrupts(interrupts);
+    }
+}
+
+void Motor::releaseMicrosteps()
+{
+    fineHolds--;
 }
 
-void Motor::interruptHandler()
+// Runs on every step, so it lives in RAM and only visits the pending slices
+void __not_in_flash_func(Motor::interruptHandler)()
 {
-    for (int slice = 0; slice < 8; slice++)
+    uint32_t pending = pwm_get_irq_status_mask();
+
+    while (pending)
     {
-        if (pwm_get_irq_status_mask() & (1 << slice))
+        unsigned slice = __builtin_ctz(pending);
+        pending &= pending - 1;
+
+        // Cleared first, so a wrap that happens while we are busy raises the IRQ again
+        pwm_clear_irq(slice);
+
+        Motor *motor = Motor::slices[slice];
+#if MOTOR_STATS
+        if (motor != nullptr)
         {
-            auto it = std::find_if(Motor::instances.begin(), Motor::instances.end(),
-                                   [slice](Motor *motor) {return motor->sliceNumber == slice;});
-            if (it != Motor::instances.end())
-            {
-                (*it)->handleSpecificInterrupt();
-            }
-            pwm_clear_irq(slice);
+            uint32_t start = systick_hw->cvr;
+            uint32_t latency = motor->statsWrapLatency();
+            motor->handleSpecificInterrupt();
+            motor->publishWrap();
+            statsRecord(motor->stats.wrap, start, latency);
+        }
+#else
+        if (motor != nullptr)
+        {
+            motor->handleSpecificInterrupt();
+            motor->publishWrap();
         }
+#endif
     }
 }
 
-void Motor::handleSpecificInterrupt()
+void __not_in_flash_func(Motor::handleSpecificInterrupt)()
 {
     if (state != Running)
     {
@@ -148,6 +554,7 @@ void Motor::handleSpecificInterrupt()
 //        }
 
         position++;
+        indexer += direction ? 1 : -1;
 
         if (state == MovingOffEndstop)
         {
@@ -163,7 +570,7 @@ void Motor::handleSpecificInterrupt()
             {
                 state = BackingUp;
                 setDirection(!options.dirToEndstop);
-                position = -125 * options.microsteps;
+                position = -HOMING_BACKOFF;
             }
         }
         if (state == BackingUp)
@@ -192,434 +599,2513 @@ void Motor::handleSpecificInterrupt()
     {
         if (!gpio_get(options.endstop))
         {
-            // HALP! Hit endstop in normal run
-            pwm_set_enabled(sliceNumber, false);
-            state = Stopped;
-            position = 0;
+            if (homingSeek)
+            {
+                // Found it, slow down past it on the ramp. This takes over
+                // from the plan like velocityRun() does, without leaving
+                // RAM, and service() goes on with home() once it stopped.
+                homingSeek = false;
+                homingBrake = true;
+                performStep();
+                stepsToGo = 0;
+                upcomingValid = false;
+                targetCount = 0;
+                velocityTarget = 0;
+                velocityDeadline = nil_time;
+                velocityRate = (uint64_t)speed << (32 - FIXED_SHIFT);
+                velocityOnTimer = false;
+                velocityMode = true;
+                if (velocityStep(false))
+                    pwm_set_wrap(sliceNumber, velocityInterval() - 1);
+                return;
+            }
+            else if (!homingBrake && !options.continuous)
+            {
+                // HALP! Hit endstop in normal run
+                recordEndstop();
+                pwm_set_enabled(sliceNumber, false);
+                state = Stopped;
+                velocityMode = false;
+                position = 0;
+                if (modeShift != 0)
+                    updateMode();
+            }
         }
     }
 
+    if (velocityMode)
+    {
+        if (!performStep())
+            velocityStop();
+        else if (velocityStep(false))
+            pwm_set_wrap(sliceNumber, velocityInterval() - 1); // Period after the one that just started
+        return;
+    }
+
+    int counted = 1 << pulseShift;
     performStep();
 
     if (stepsToGo)
     {
-        if (!--stepsToGo)
+        // A full step can run past the end of the entry, motorSpeedStep()
+        // takes the rest off the next one
+        stepsToGo -= counted;
+        if (stepsToGo <= 0)
             motorSpeedStep();
+        else if (stepsToGo <= 1 << modeShift && !upcomingValid)
+            stageUpcoming(); // The next wrap starts the last pulse of this entry
     }
-}
 
-bool Motor::alarmHandler(repeating_timer_t *timer)
-{
-    return ((Motor *)timer->user_data)->handleSpecificAlarm();
+    if (options.fullStepSpeed > 0 || modeShift != 0)
+        updateMode();
 }
 
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "readability-convert-member-functions-to-static"
-#pragma ide diagnostic ignored "readability-make-member-function-const"
-bool Motor::handleSpecificAlarm()
+// Each motor's alarm has an interrupt of its own, they all come here
+void __not_in_flash_func(Motor::stepAlarmInterrupt)()
 {
-    if (gpio_get_out_level(pins.step))
-    {
-        gpio_put(pins.step, false);
+    uint32_t pending = timer_hw->ints & alarmMask;
 
-        if (!performStep())
-            return false;
-
-        if (stepsToGo)
-        {
-            if (!--stepsToGo)
-            {
-                motorSpeedStep();
-                return false;
-            }
-        }
-    }
-    else
+    while (pending)
     {
-        gpio_put(pins.step, true);
-    }
+        unsigned alarm = __builtin_ctz(pending);
+        pending &= pending - 1;
 
-    return true;
+        timer_hw->intr = 1u << alarm;
+        stepAlarmHandler(alarm);
+    }
 }
-#pragma clang diagnostic pop
 
-void Motor::home()
+void __not_in_flash_func(Motor::stepAlarmHandler)(uint alarm)
 {
-    if (options.endstop == -1)
+    Motor *motor = alarmMotors[alarm];
+#if MOTOR_STATS
+    if (motor != nullptr)
     {
-        homed = true;
-        if (!options.autoPowerOff && options.callback == nullptr)
-            enableMotor();
-        return;
+        uint32_t start = systick_hw->cvr;
+        int32_t late = (int32_t)(time_us_32() - (uint32_t)(motor->stepDue >> FIXED_SHIFT));
+        motor->handleStepAlarm();
+        motor->publishSnapshot();
+        statsRecord(motor->stats.alarm, start, std::max(late, 0) * (PWM_CLOCK / 1000000));
+    }
+#else
+    if (motor != nullptr)
+    {
+        motor->handleStepAlarm();
+        motor->publishSnapshot();
     }
+#endif
+}
 
-    setPwmMode();
+// One edge of the step pulse, or a few if it came in late. The motor is
+// counted on the rising edge like on the PWM, so a replan sees where it is.
+// Entries change on the falling edge, with the pulse complete.
+void __not_in_flash_func(Motor::handleStepAlarm)()
+{
+    stepAlarmBusy = true;
 
-    if (!gpio_get(options.endstop) && state != BackingUp)
+    do
     {
-//        printf("Move off endstop\n");
-        setDirection(!options.dirToEndstop);
-        state = MovingOffEndstop;
-        setPwmFreq(250.0f * (float)options.microsteps);
+        bool rising = !gpio_get_out_level(pins.step);
+        gpio_put(pins.step, rising);
+        stepDue += stepHalf;
 
-        enableMotor();
+        if (rising)
+        {
+            stepAlarmLimit = !performStep();
+        }
+        else if (stepAlarmLimit)
+        {
+            onStepAlarm = false;
+        }
+        else if (stepsToGo && !--stepsToGo)
+        {
+            // Can retime, restart or stop the alarm
+            motorSpeedStep();
+            if (stepsToGo <= 0)
+                onStepAlarm = false; // Out of plan
+        }
+    } while (onStepAlarm && stepAlarmMissed());
 
-        return;
-    }
+    stepAlarmBusy = false;
+}
 
-//    printf("Home\n");
-    state = Homing;
+// Half a period at freq, in microseconds with FIXED_SHIFT fraction bits
+static uint64_t __not_in_flash_func(stepAlarmHalf)(fixed_t freq)
+{
+    return ((uint64_t)1000000 << (2 * FIXED_SHIFT)) / (2 * (uint64_t)freq);
+}
 
-    setPwmMode();
-    setDirection(options.dirToEndstop);
-    setPwmFreq(250.0f * (float)options.microsteps);
+// The first step comes a whole period after lastStep
+void __not_in_flash_func(Motor::stepAlarmStart)(fixed_t freq, uint64_t lastStep)
+{
+    stepHalf = stepAlarmHalf(freq);
+    stepDue = std::max(lastStep + 2 * stepHalf, timeNow() << FIXED_SHIFT);
+    stepAlarmLimit = false;
+    onStepAlarm = true;
 
-    enableMotor();
+    setGpioMode();
+    stepAlarmSet();
 }
 
-void Motor::setPwmMode() const
+// Moves the next edge, keeping the time already gone by the current one.
+// An edge that is overdue by now goes right away, not several at once.
+void __not_in_flash_func(Motor::stepAlarmRetime)(fixed_t freq)
 {
-    gpio_set_function(pins.step, GPIO_FUNC_PWM);
+    uint64_t half = stepAlarmHalf(freq);
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    stepDue = std::max(stepDue - stepHalf + half, timeNow() << FIXED_SHIFT);
+    stepHalf = half;
+    restore_interrupts(interrupts);
+
+    stepAlarmSet();
 }
 
-void Motor::setGpioMode() const
+void __not_in_flash_func(Motor::stepAlarmStop)()
 {
-    gpio_put(pins.step, false);
-    gpio_set_function(pins.step, GPIO_FUNC_SIO);
+    alarmCancel(stepAlarm);
+
+    // Cuts a pulse short, its step is already counted
+    if (onStepAlarm)
+        gpio_put(pins.step, false);
+
+    onStepAlarm = false;
 }
 
-void Motor::enableMotor() const
+void __not_in_flash_func(Motor::stepAlarmSet)()
 {
-    gpio_put(pins.enable, false);
+    // The handler sets it on its way out
+    if (stepAlarmBusy)
+        return;
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    if (onStepAlarm && alarmArm(stepAlarm, stepDue >> FIXED_SHIFT))
+        handleStepAlarm();
+    restore_interrupts(interrupts);
 }
 
-void Motor::disableMotor() const
+// Sets the alarm for the next edge, true if that is overdue already
+bool __not_in_flash_func(Motor::stepAlarmMissed)()
 {
-    pwm_set_enabled(sliceNumber, false);
-    gpio_put(pins.enable, true);
+    if (!alarmArm(stepAlarm, stepDue >> FIXED_SHIFT))
+        return false;
+
+#if MOTOR_STATS
+    stats.alarm.missed++;
+#endif
+    return true;
 }
 
-void Motor::setDirection(bool forward)
+// When the last step was taken, microseconds with FIXED_SHIFT fraction bits
+uint64_t __not_in_flash_func(Motor::lastStepTime)() const
 {
-    direction = forward;
-    gpio_put(pins.dir, forward ^ options.reverse);
+    if (onStepAlarm)
+        return stepDue - (gpio_get_out_level(pins.step) ? stepHalf : 2 * stepHalf);
+
+    // The PWM steps at each wrap, the counter has run on since
+    if (state == Running && speed >= INT_TO_FIXED(MIN_HZ) && !velocityMode && pioSm == -1)
+        return wrapTime();
+
+    // Standing still, the first step can go right away
+    return 0;
 }
 
-int Motor::motorSpeedStepDeltaSteps(int delta) const
+// Counter to start the PWM at, so its first wrap comes a period after lastStep
+uint16_t __not_in_flash_func(Motor::pwmResumeCount)(PwmTiming timing, uint64_t lastStep, bool pulseOut) const
 {
-    return (delta + (SPEED_STEP - 1)) / SPEED_STEP;
+    uint64_t elapsed = (timeNow() << FIXED_SHIFT) - lastStep;
+    uint64_t counts = (elapsed * 16 * (PWM_CLOCK / 1000000) / timing.div) >> FIXED_SHIFT;
+
+    // A pulse that is out already has to stay out, the PWM would put out
+    // another without a wrap to count it. One still going carries on.
+    return (uint16_t)std::clamp<uint64_t>(counts, pulseOut ? timing.level : 0, timing.top);
 }
 
-void Motor::motorSpeedStep()
+// Velocity mode below MIN_HZ, called for each edge of the step pulse
+bool __not_in_flash_func(Motor::velocityAlarmHandler)(repeating_timer_t *timer)
 {
-    for (;;)
-    {
-        if (plan[step].speed < 0)
-        {
-            stepsToGo = 0;
-            if (options.callback != nullptr)
-            {
-                if (options.callback(options.userData))
-                    disableMotor();
-            }
-            if (options.autoPowerOff)
-                disableMotor();
-            return;
-        }
+    auto motor = (Motor *)timer->user_data;
+    bool repeat = motor->handleVelocityAlarm(timer);
+    motor->publishSnapshot();
 
-        runStepper(plan[step].speed, plan[step].direction);
-        if (plan[step].steps != 0)
-        {
-//            printf("Expected %d, actual %d\r\n", plan[step].expectedPosition, position);
-            stepsToGo = plan[step].steps;
-            step++;
-            return;
-        }
-        step++;
-    }
+    return repeat;
 }
 
-void Motor::runStepper(double newSpeed, bool newDirection)
+bool __not_in_flash_func(Motor::handleVelocityAlarm)(repeating_timer_t *timer)
 {
-//    printf("Run stepper %d, %s\n", newSpeed, newDirection ? "out" : "in");
+    if (!velocityMode || !velocityOnTimer)
+        return false;
 
-    if (newSpeed == 0)
-    {
-        pwm_set_enabled(sliceNumber, false);
-        state = Stopped;
-        newSpeed = 0;
+    velocityWait -= std::min(velocityWait, (uint64_t)-timer->delay_us);
+    if (velocityWait && !velocityRetime())
+        return false;
 
-        return;
+    if (velocityWait)
+    {
+        // Polled partway through
+        timer->delay_us = -(int64_t)std::min(velocityWait, (uint64_t)VELOCITY_POLL_US);
+        return true;
     }
 
-    pwm_set_enabled(sliceNumber, false);
+    if (gpio_get_out_level(pins.step))
+    {
+        gpio_put(pins.step, false);
+
+        if (options.endstop != -1 && !gpio_get(options.endstop) && !homingBrake && !options.continuous)
+        {
+            // HALP! Hit endstop in normal run
+            recordEndstop();
+            velocityStop();
+            position = 0;
+            return false;
+        }
+
+        if (!performStep())
+        {
+            velocityStop();
+            return false;
+        }
+
+        if (!velocityStep(true))
+            return false;
+    }
+    else
+    {
+        gpio_put(pins.step, true);
+    }
+
+    // Negative, so the next edge is timed from this one's due time rather
+    // than from when this callback happened to run
+    velocityWait = velocityInterval();
+    timer->delay_us = -(int64_t)std::min(velocityWait, (uint64_t)VELOCITY_POLL_US);
+    return true;
+}
+
+// A half period on the timer can be long. A faster rate in the same
+// direction shortens what is left of it. Stopping or turning around drops
+// a step that hasn't started yet and finishes one that has. Returns false
+// if the timer has to stop.
+bool __not_in_flash_func(Motor::velocityRetime)()
+{
+    velocityCheckDeadline();
+
+    int64_t target = velocityTarget;
+    uint64_t wanted = target < 0 ? -target : target;
+
+    if (target != 0 && (target > 0) == direction)
+    {
+        // Stays below MIN_HZ, the PWM takes over at the next step
+        uint64_t rate = std::min({wanted, (uint64_t)SPEED_STEP << 32, ((uint64_t)MIN_HZ << 32) - 1});
+        if (rate <= velocityRate || (rate >> 16) == 0)
+            return true;
+
+        velocityWait = velocityWait * (velocityRate >> 16) / (rate >> 16);
+        return velocitySetRate(rate, true);
+    }
+
+    if (gpio_get_out_level(pins.step))
+    {
+        velocityWait = 0;
+        return true;
+    }
+
+    velocityRate = 0;
+    if (!velocityStep(true))
+        return false;
+
+    velocityWait = velocityInterval();
+    return true;
+}
+
+void Motor::home()
+{
+    homingNext = false;
+    trajectoryCancel();
+    velocityCancel();
+    stepAlarmStop();
+
+    if (options.endstop == -1)
+    {
+        homed = true;
+        if (!options.autoPowerOff && options.callback == nullptr)
+            enableMotor();
+        publishSnapshot();
+        return;
+    }
+
+    setPwmMode();
+
+    // The seek runs on the PWM, the PIO only looks at the endstop now and then
+    if (options.homingSpeed > 0 && pioSm == -1 && !homingBrake && gpio_get(options.endstop) && state != BackingUp)
+    {
+        homeSeek();
+        return;
+    }
+    homingBrake = false;
+
+    if (!gpio_get(options.endstop) && state != BackingUp)
+    {
+//        printf("Move off endstop\n");
+        setDirection(!options.dirToEndstop);
+        state = MovingOffEndstop;
+        setPwmFreq(homingApproach());
+
+        enableMotor();
+
+        return;
+    }
+
+//    printf("Home\n");
+    state = Homing;
+
+    setPwmMode();
+    setDirection(options.dirToEndstop);
+    setPwmFreq(homingApproach());
+
     enableMotor();
+}
 
-    speed = newSpeed;
-    direction = newDirection;
+// Work the interrupts leave for the motion loop, which calls this between
+// commands: the end of a move and the homing phase after the seek
+void Motor::service()
+{
+    for (Motor *motor : slices)
+    {
+        if (motor == nullptr)
+            continue;
+
+        if (motor->finishNext)
+        {
+            motor->finishNext = false;
+            motor->finishMove();
+        }
+
+        if (motor->homingNext)
+        {
+            motor->homingNext = false;
+            motor->home();
+        }
+    }
+}
+
+// First part of homing from further away, a planned move long enough to
+// reach the endstop from anywhere. Where the motor is isn't known yet, so
+// the move is planned from wherever position says and may end outside the
+// travel. Running into the endstop hands over to velocity mode to slow
+// down, then service() carries on with home().
+void Motor::homeSeek()
+{
+    int distance = maxSteps + HOMING_BACKOFF;
+
+    // Slowing down past the endstop has to stay within the backoff, so
+    // the seek is capped at the speed that ramps to a stop in that
+    int fastest = HOMING_BACKOFF * SPEED_STEP / SPEED_STEP_PULSES;
+
+    targets[0] = {options.dirToEndstop ? position + distance : position - distance,
+                  INT_TO_FIXED(std::min(options.homingSpeed, fastest)), Trapezoid};
+    targetCount = 1;
+    state = Stopped;
+    homed = false;
+    homingSeek = true;
+
+    if (planTargets(SPEED_STEP_PULSES))
+        startPlan();
+}
+
+fixed_t Motor::homingApproach() const
+{
+    return INT_TO_FIXED(options.homingApproachSpeed > 0 ? options.homingApproachSpeed : 250 * options.microsteps);
+}
+
+void __not_in_flash_func(Motor::setPwmMode)() const
+{
+    pinFunction(pins.step, GPIO_FUNC_PWM);
+}
+
+void Motor::setPioMode() const
+{
+    gpio_set_function(pins.step, GPIO_FUNC_PIO0);
+}
+
+void __not_in_flash_func(Motor::setGpioMode)() const
+{
+    gpio_put(pins.step, false);
+    pinFunction(pins.step, GPIO_FUNC_SIO);
+}
+
+void __not_in_flash_func(Motor::enableMotor)() const
+{
+    gpio_put(pins.enable, false);
+}
+
+void Motor::disableMotor() const
+{
+    pwm_set_enabled(sliceNumber, false);
+    gpio_put(pins.enable, true);
+}
+
+void __not_in_flash_func(Motor::setDirection)(bool forward)
+{
+    direction = forward;
+    gpio_put(pins.dir, forward ^ options.reverse);
+}
+
+// Ramp entries needed for a speed change, counted the way planRamp() does
+int Motor::motorSpeedStepDeltaSteps(fixed_t delta) const
+{
+    return (delta + (RAMP_STEP_FIXED - 1)) / RAMP_STEP_FIXED;
+}
+
+// A plan with pulses motor steps per ramp entry instead of SPEED_STEP_PULSES
+// runs at pulses / SPEED_STEP_PULSES of the speed. With the speed steps
+// scaled the same way it takes exactly as long as the unscaled plan would
+// for the same fraction of the distance.
+void Motor::setRampScale(int pulses)
+{
+    rampPulses = std::max(pulses, 1);
+    rampStep = scaledSpeed(INT_TO_FIXED(SPEED_STEP));
+    rampAccel = std::max(scaledSpeed(INT_TO_FIXED(options.acceleration)), 1);
+}
+
+fixed_t Motor::scaledSpeed(fixed_t unscaled) const
+{
+    return (fixed_t)((int64_t)unscaled * RAMP_STEP_PULSES / SPEED_STEP_PULSES);
+}
+
+fixed_t __not_in_flash_func(Motor::segmentEntrySpeed)(const Segment &segment, int entry)
+{
+    if (segment.accel != 0)
+    {
+        if (entry == segment.entries - 1)
+            return segment.limit;
+
+        fixed_t entrySpeed = linearSpeed(segment.accel, abs(segment.index + entry));
+        if (segment.index > 0 ? entrySpeed > segment.limit : entrySpeed < segment.limit)
+            entrySpeed = segment.limit;
+        return entrySpeed;
+    }
+
+    fixed_t entrySpeed = segment.speed + (entry + 1) * segment.delta;
+    if (segment.jerk != 0)
+        entrySpeed += (entry + 1) * entry / 2 * segment.jerk;
+    if (segment.delta < 0 ? entrySpeed < segment.limit : entrySpeed > segment.limit)
+        entrySpeed = segment.limit;
+    return entrySpeed;
+}
+
+bool __not_in_flash_func(Motor::nextPlanEntry)(PlanEntry &entry)
+{
+    const Segment &segment = active->segments[step];
+
+    if (segment.speed < 0)
+        return false;
+
+    entry.direction = segment.direction;
+    entry.timing = -1;
+    entry.top = 0;
+    entry.segment = segmentEntry == 0 ? step : -1;
+
+    if (segment.accel != 0 && segmentEntry < segment.entries - 1)
+    {
+        if (segmentEntry == 0)
+        {
+            linearCount = segment.count;
+            linearIndex = segment.index;
+        }
+        else
+        {
+            // v = sqrt(2 * accel * n) gives c(n) = c(n - 1) * sqrt((n - 1) / n)
+            // for the period, which 1 - 2 / (4n - 1) is within 1/(32n^3) of.
+            // Braking n counts up towards zero and the period grows.
+            int divisor = 4 * ++linearIndex - 1;
+            if (divisor > 0)
+                linearCount -= (linearCount << 1) / divisor;
+            else
+                linearCount += (linearCount << 1) / -divisor;
+        }
+
+        uint32_t counts = (linearCount + (1u << (LINEAR_SHIFT - 1))) >> LINEAR_SHIFT;
+        if (segment.endTop != 0)
+        {
+            uint32_t end = segment.endTop + 1u;
+            counts = segment.index > 0 ? std::max(counts, end) : std::min(counts, end);
+        }
+        counts = std::min(std::max(counts, 2u), (uint32_t)MAX_WRAP);
+
+        entry.top = counts - 1;
+        entry.speed = INT_TO_FIXED(active->linearRate / counts);
+        entry.steps = 1;
+    }
+    else
+    {
+        entry.speed = segmentEntrySpeed(segment, segmentEntry);
+        entry.steps = entry.speed > 0 ? segment.steps : 0;
+        if (segment.accel != 0)
+            entry.top = segment.endTop;
+        if (segment.timings != -1 && segment.timings + segmentEntry < PLAN_TIMINGS)
+            entry.timing = segment.timings + segmentEntry;
+    }
+
+    if (++segmentEntry == segment.entries)
+    {
+        segmentEntry = 0;
+        step++;
+    }
+
+    return true;
+}
+
+// Runs at rate steps per second, negative moving in. Changes of the rate
+// are ramped. With a timeout the motor comes to a stop unless it is called
+// again within timeoutMs. Returns false if the motor isn't homed, or the
+// PIO backend still has steps queued.
+bool Motor::runAtVelocity(double rate, int timeoutMs)
+{
+    if (!homed)
+        return false;
+
+    holdMicrosteps();
+    trajectoryCancel();
+    velocityHold = false;
+
+    bool result = velocityRun((int64_t)(rate * 4294967296.0), timeoutMs);
+    releaseMicrosteps();
+
+    return result;
+}
+
+// Rate is in steps per second with 32 fraction bits
+bool Motor::velocityRun(int64_t target, int timeoutMs)
+{
+    if (state != Stopped && state != Running)
+        return false;
+
+    if (pioSm != -1 && !velocityMode && (state == Running || pioInFlightCount))
+        return false;
+
+    foldPosition();
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    velocityTarget = target;
+    velocityDeadline = timeoutMs > 0 ? make_timeout_time_ms(timeoutMs) : nil_time;
+    restore_interrupts(interrupts);
+
+    if (velocityMode || (target == 0 && state != Running))
+        return true; // The step interrupts pick it up from here
+
+    // Take over from a plan at the speed it is running at
+    stepsToGo = 0;
+    upcomingValid = false;
+    targetCount = 0;
+    stepAlarmStop();
+
+    velocityRate = state == Running ? (uint64_t)speed << (32 - FIXED_SHIFT) : 0;
+    velocityOnTimer = false;
+    velocityMode = true;
+
+    enableMotor();
+    velocityStep(false);
+    publishSnapshot();
+
+    return true;
+}
+
+void __not_in_flash_func(Motor::velocityCheckDeadline)()
+{
+    if (!is_nil_time(velocityDeadline) && time_reached(velocityDeadline))
+    {
+        velocityTarget = 0; // Deadman, nobody asked to keep going
+        velocityDeadline = nil_time;
+    }
+}
+
+// Rate for the next step, heading for velocityTarget
+uint64_t __not_in_flash_func(Motor::velocityNextRate)()
+{
+    velocityCheckDeadline();
+
+    int64_t target = velocityTarget;
+    bool targetDirection = target > 0;
+    uint64_t wanted = target < 0 ? -target : target;
+    uint64_t lowest = (uint64_t)SPEED_STEP << 32;
+    uint64_t increment = lowest / SPEED_STEP_PULSES;
+    uint64_t rate = velocityRate;
+
+    if (velocityHold && position == velocityHoldPosition && rate <= lowest)
+        return 0;
+
+    if (rate != 0 && targetDirection != direction)
+        wanted = 0; // Turning around, slow down first
+
+    if (rate == 0)
+    {
+        // Starting, like a ramp does at up to SPEED_STEP
+        if (target != 0)
+            setDirection(targetDirection);
+        rate = std::min(wanted, lowest);
+    }
+    else if (rate < wanted)
+    {
+        rate = std::min(wanted, rate + increment);
+    }
+    else if (rate > wanted)
+    {
+        uint64_t slower = rate > increment ? rate - increment : 0;
+        if (wanted == 0 && slower < lowest)
+            slower = 0; // Below the lowest ramp speed stops right away
+        rate = std::max(slower, wanted);
+
+        if (rate == 0 && target != 0)
+        {
+            setDirection(targetDirection);
+            rate = std::min((uint64_t)(target < 0 ? -target : target), lowest);
+        }
+    }
+
+    return rate;
+}
+
+// Returns false if the step generation that called it has to stop, either
+// because the motor stopped or because it moved to the PWM or the timer
+bool __not_in_flash_func(Motor::velocityStep)(bool onTimer)
+{
+    uint64_t rate = velocityNextRate();
+
+    if (rate == 0)
+    {
+        velocityStop();
+        return false;
+    }
+
+    if (rate != velocityRate || velocityDivisor == 0)
+        return velocitySetRate(rate, onTimer);
+
+    return true;
+}
+
+bool __not_in_flash_func(Motor::velocitySetRate)(uint64_t rate, bool onTimer)
+{
+    velocityRate = rate;
+    speed = (fixed_t)(rate >> (32 - FIXED_SHIFT));
+    velocityAccumulator = 0;
+    publishPending = true;
+
+    if (rate < ((uint64_t)MIN_HZ << 32))
+    {
+        // Half a step in microseconds, times the rate
+        uint64_t interval = (uint64_t)500000 << 32;
+        velocityPeriod = interval / rate;
+        velocityRemainder = interval % rate;
+        velocityDivisor = rate;
+
+        if (!onTimer)
+        {
+            pwm_set_enabled(sliceNumber, false);
+            setGpioMode();
+            gpio_put(pins.step, false);
+            velocityOnTimer = true;
+            state = Running;
+            velocityWait = velocityInterval();
+            alarm_pool_add_repeating_timer_us(timerPool(), -(int64_t)std::min(velocityWait, (uint64_t)VELOCITY_POLL_US),
+                                              velocityAlarmHandler, this, &velocityTimer);
+        }
+
+        return onTimer;
+    }
+
+    // PWM counts per step, times 16 for the divider and times the rate
+    uint64_t clock = (uint64_t)PWM_CLOCK << 36;
+    uint32_t div = pwmDiv;
+    bool restart = onTimer || velocityOnTimer || state != Running || div == 0;
+
+    if (!restart)
+    {
+        // A divider change is only worth a restart when the counter runs
+        // out of range or gets too coarse
+        uint64_t counts = clock / ((uint64_t)div * rate);
+        restart = counts > 0xffff || counts < MAX_WRAP / 8;
+    }
+
+    if (restart)
+        div = pwmDivFor((fixed_t)(rate >> (32 - FIXED_SHIFT)));
+
+    velocityDivisor = (uint64_t)div * rate;
+    velocityPeriod = clock / velocityDivisor;
+    velocityRemainder = clock % velocityDivisor;
+
+    pwm_set_chan_level(sliceNumber, PWM_CHAN_A, (uint16_t)std::min<uint64_t>(div << 4, velocityPeriod / 2));
+
+    if (restart)
+    {
+        // Runs right after a wrap, so restarting the period costs little
+        pwm_set_enabled(sliceNumber, false);
+        setPwmMode();
+        pwm_set_clkdiv_int_frac(sliceNumber, div >> 4, div & 0x0f);
+        pwm_set_counter(sliceNumber, 0);
+        pwm_set_wrap(sliceNumber, velocityInterval() - 1);
+        statsRestart();
+        pwm_set_enabled(sliceNumber, true);
+        pwmDiv = div;
+        velocityOnTimer = false;
+        state = Running;
+    }
+
+    return !onTimer;
+}
+
+// Length of the next period, the carried fraction makes up a whole count
+// every so often
+uint64_t __not_in_flash_func(Motor::velocityInterval)()
+{
+    velocityAccumulator += velocityRemainder;
+    if (velocityAccumulator >= velocityDivisor)
+    {
+        velocityAccumulator -= velocityDivisor;
+        return velocityPeriod + 1;
+    }
+
+    return velocityPeriod;
+}
+
+void __not_in_flash_func(Motor::velocityStop)()
+{
+    pwm_set_enabled(sliceNumber, false);
+    velocityMode = false;
+    velocityOnTimer = false;
+    velocityRate = 0;
+    velocityDivisor = 0;
+    speed = 0;
+    state = Stopped;
+    publishSnapshot();
+    finishPlan();
+}
+
+// A plan takes over, at the speed velocity mode left it running at
+void Motor::velocityCancel()
+{
+    if (!velocityMode)
+        return;
+
+    velocityMode = false;
+    velocityDivisor = 0;
+    if (velocityOnTimer)
+    {
+        cancel_repeating_timer(&velocityTimer);
+        velocityOnTimer = false;
+
+        // Cancelled between the edges of a step. The driver took it on the
+        // rising edge, the falling one that counts it won't come any more.
+        uint32_t interrupts = save_and_disable_interrupts();
+        if (gpio_get_out_level(pins.step))
+        {
+            gpio_put(pins.step, false);
+            performStep();
+        }
+        restore_interrupts(interrupts);
+    }
+}
+
+// Adds a point the motor passes through at the given time, at velocity
+// steps/s if hasVelocity. Times must increase. Playback starts with the
+// first point, until then the motor is left alone. After the last point
+// the motor stops there. Returns false if the motor isn't homed, the point
+// is out of order or TRAJECTORY_POINTS are queued.
+bool Motor::queueTrajectoryPoint(absolute_time_t time, int target, double velocity, bool hasVelocity)
+{
+    uint32_t tail = trajectoryTail;
+    uint64_t at = to_us_since_boot(time);
+
+    if (!homed || tail - trajectoryHead >= TRAJECTORY_POINTS)
+        return false;
+
+    if (tail != trajectoryHead && at <= trajectory[(tail - 1) % TRAJECTORY_POINTS].time)
+        return false;
+
+    foldPosition();
+    int from = tail != trajectoryHead ? trajectory[(tail - 1) % TRAJECTORY_POINTS].position : plannedStart();
+
+    // Playback starts by itself later, on microsteps
+    holdMicrosteps();
+    trajectory[tail % TRAJECTORY_POINTS] = {at, clampTarget(target, from), doubleToFixed(velocity), hasVelocity};
+    trajectoryTail = tail + 1;
+
+    if (!trajectoryActive)
+    {
+        trajectoryActive = true;
+        alarm_pool_add_repeating_timer_ms(timerPool(), -TRAJECTORY_TICK_MS, trajectoryAlarmHandler, this, &trajectoryTimer);
+    }
+    releaseMicrosteps();
+
+    return true;
+}
+
+// Drops the points, playback brings the motor to a stop unless new ones
+// are queued before its next look at the clock
+void Motor::clearTrajectory()
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    trajectoryHead = trajectoryTail;
+    restore_interrupts(interrupts);
+}
+
+int Motor::trajectoryPoints() const
+{
+    return (int)(trajectoryTail - trajectoryHead);
+}
+
+absolute_time_t Motor::trajectoryEnd() const
+{
+    uint32_t tail = trajectoryTail;
+    if (tail == trajectoryHead)
+        return nil_time;
+
+    return from_us_since_boot(trajectory[(tail - 1) % TRAJECTORY_POINTS].time);
+}
+
+// Where the last queued point is, -1 with none queued
+int Motor::trajectoryEndPosition() const
+{
+    uint32_t tail = trajectoryTail;
+    if (tail == trajectoryHead)
+        return -1;
+
+    return wrapPosition(trajectory[(tail - 1) % TRAJECTORY_POINTS].position);
+}
+
+// Something else takes over the motor
+void Motor::trajectoryCancel()
+{
+    if (trajectoryActive)
+    {
+        cancel_repeating_timer(&trajectoryTimer);
+        trajectoryActive = false;
+    }
+
+    trajectoryHead = trajectoryTail;
+}
+
+// Position in 1/65536 steps and rate in steps/s with 32 fraction bits at
+// now, on a cubic Hermite curve between two points
+void Motor::trajectorySample(const TrajectoryPoint &from, const TrajectoryPoint &to, uint64_t now,
+                             int64_t &target, int64_t &rate)
+{
+    auto duration = (int64_t)(to.time - from.time);
+    int64_t s = ((int64_t)(now - from.time) << 16) / duration;
+    int64_t s2 = s * s >> 16;
+    int64_t s3 = s2 * s >> 16;
+
+    // Distance and tangents over the whole segment, in 1/65536 steps
+    int64_t chord = (int64_t)(to.position - from.position) << 16;
+    int64_t m0 = from.hasVelocity ? (int64_t)from.velocity * duration / 1000000 << (16 - FIXED_SHIFT) : chord;
+    int64_t m1 = to.hasVelocity ? (int64_t)to.velocity * duration / 1000000 << (16 - FIXED_SHIFT) : chord;
+
+    target = ((int64_t)from.position << 16) +
+             ((chord * (3 * s2 - 2 * s3) + m0 * (s3 - 2 * s2 + s) + m1 * (s3 - s2)) >> 16);
+
+    int64_t slope = (chord * (6 * s - 6 * s2) + m0 * (3 * s2 - 4 * s + 65536) + m1 * (3 * s2 - 2 * s)) >> 16;
+    rate = slope * 1000000 / duration << 16;
+}
+
+bool Motor::trajectoryAlarmHandler(repeating_timer_t *timer)
+{
+    return ((Motor *)timer->user_data)->handleTrajectoryAlarm();
+}
+
+bool Motor::handleTrajectoryAlarm()
+{
+    uint64_t now = time_us_64();
+    uint32_t head = trajectoryHead;
+    uint32_t tail = trajectoryTail;
+
+    // Keep the point before now and the one after it
+    while (tail - head > 1 && trajectory[(head + 1) % TRAJECTORY_POINTS].time <= now)
+        head++;
+    trajectoryHead = head;
+
+    if (head == tail)
+    {
+        // Cleared
+        trajectoryActive = false;
+        velocityHold = false;
+        if (velocityMode)
+            velocityTarget = 0;
+        return false;
+    }
+
+    const auto &from = trajectory[head % TRAJECTORY_POINTS];
+    bool holding = now < from.time || tail - head == 1;
+
+    if (now < from.time && !velocityMode)
+        return true; // Not started, leave a move to the first point alone
+
+    int64_t target = (int64_t)from.position << 16;
+    int64_t rate = 0;
+    if (!holding)
+        trajectorySample(from, trajectory[(head + 1) % TRAJECTORY_POINTS], now, target, rate);
+
+    // The position only counts whole steps, so while following it is up to
+    // a step off without being behind
+    int64_t error = target - ((int64_t)position << 16);
+    int64_t tolerance = holding ? 0 : 1 << 16;
+
+    if (holding && error == 0 && !velocityMode)
+    {
+        // Arrived at the last point
+        trajectoryHead = tail;
+        trajectoryActive = false;
+        velocityHold = false;
+        return false;
+    }
+
+    if (error > tolerance || error < -tolerance)
+    {
+        // Catch up in half a second, at no more than the lowest ramp speed
+        int64_t limit = (int64_t)SPEED_STEP << 32;
+        rate += std::max(-limit, std::min(limit, error << 17));
+    }
+
+    velocityHoldPosition = from.position;
+    velocityHold = holding;
+    velocityRun(rate, 0);
+
+    return true;
+}
+
+// Runs from the step interrupts. The end-of-move callback and powering off
+// are left for service(), they are in flash.
+void __not_in_flash_func(Motor::finishPlan)()
+{
+    if (homingSeek || homingBrake)
+    {
+        // Done slowing down past the endstop, or the seek never got there.
+        // Either way the slow approach finds it from here, started by
+        // service() outside the interrupt.
+        homingSeek = false;
+        homingNext = true;
+        return;
+    }
+
+    stepsToGo = 0;
+    targetCount = 0;
+    finishNext = true;
+}
+
+// The end of a move as far as the caller is concerned, unless a new one
+// started since
+void Motor::finishMove()
+{
+    if (state != Stopped)
+        return;
+
+    if (options.callback != nullptr)
+    {
+        if (options.callback(options.userData))
+            disableMotor();
+    }
+    if (options.autoPowerOff)
+        disableMotor();
+}
+
+void __not_in_flash_func(Motor::motorSpeedStep)()
+{
+    if (pioSm != -1)
+    {
+        pioFeed();
+        return;
+    }
+
+    PlanEntry entry{};
+
+    for (;;)
+    {
+        if (upcomingValid)
+        {
+            entry = upcoming;
+            upcomingValid = false;
+            checkSegmentStart(entry);
+
+            if (upcomingStaged)
+                speed = entry.speed; // Already latched by the wrap that got us here
+            else
+                runStepper(entry);
+        }
+        else if (nextPlanEntry(entry))
+        {
+            checkSegmentStart(entry);
+            runStepper(entry);
+        }
+        else
+        {
+            break;
+        }
+
+        if (entry.steps != 0)
+        {
+            stepsToGo += entry.steps;
+            if (stepsToGo > 0)
+            {
+                if (stepsToGo <= 1 << modeShift)
+                    stageUpcoming();
+                return;
+            }
+        }
+    }
+
+    finishPlan();
+}
+
+// True if the entry can follow on the running PWM without stopping it
+bool __not_in_flash_func(Motor::canRetime)(const PlanEntry &entry) const
+{
+    return state == Running && speed >= INT_TO_FIXED(MIN_HZ) && entry.speed >= INT_TO_FIXED(MIN_HZ) &&
+           entry.direction == direction && entryTiming(entry).div == pwmDiv;
+}
+
+// Steps past the end of the last entry, from a full step or from before
+// the plan started, count as made in this one
+void __not_in_flash_func(Motor::checkSegmentStart)(const PlanEntry &entry)
+{
+    // The first segment starts wherever the motor is
+    if (entry.segment <= 0)
+        return;
+
+    const Segment &segment = active->segments[entry.segment];
+    int deviation = position + (direction ? stepsToGo : -stepsToGo) - segment.expectedPosition;
+    auto late = (int32_t)((int64_t)(timeNow() - active->startTime) - segment.start);
+
+    planCheck.segments++;
+    if (deviation != 0)
+    {
+        planCheck.deviations++;
+        planCheck.maxDeviation = std::max(planCheck.maxDeviation, abs(deviation));
+    }
+    if (late >= PLAN_LATE_US)
+        planCheck.late++;
+    if (planCheck.segments == 1 || late > planCheck.maxLate)
+        planCheck.maxLate = late;
+}
+
+void __not_in_flash_func(Motor::stageUpcoming)()
+{
+    upcomingStaged = false;
+    upcomingValid = nextPlanEntry(upcoming);
+
+    if (upcomingValid && canRetime(upcoming))
+    {
+        stagePwmTiming(entryTiming(upcoming));
+        upcomingStaged = true;
+    }
+}
+
+void __not_in_flash_func(Motor::runStepper)(const PlanEntry &entry)
+{
+    fixed_t newSpeed = entry.speed;
+    bool newDirection = entry.direction;
+
+//    printf("Run stepper %d, %s\n", newSpeed, newDirection ? "out" : "in");
+
+    if (newSpeed == 0)
+    {
+        pwm_set_enabled(sliceNumber, false);
+        stepAlarmStop();
+        state = Stopped;
+        newSpeed = 0;
+
+        return;
+    }
+
+    if (canRetime(entry))
+    {
+        stagePwmTiming(entryTiming(entry));
+        speed = newSpeed;
+
+        return;
+    }
+
+    if (onStepAlarm && newSpeed < INT_TO_FIXED(MIN_HZ) && newDirection == direction)
+    {
+        stepAlarmRetime(newSpeed);
+        speed = newSpeed;
+
+        return;
+    }
+
+    // Whichever ran so far, the next step follows on from its last one
+    uint64_t lastStep = lastStepTime();
+    bool pulseOut = onStepAlarm || pwm_get_counter(sliceNumber) >= stagedTiming.level;
+
+    // The PWM counts a step at the wrap that ends its pulse, so the first
+    // wrap after the alarm counts the alarm's last step over again
+    bool handOver = onStepAlarm && newSpeed >= INT_TO_FIXED(MIN_HZ) && newDirection == direction;
+
+    pwm_set_enabled(sliceNumber, false);
+    stepAlarmStop();
+    enableMotor();
+
+    speed = newSpeed;
+    direction = newDirection;
+
+    setDirection(newDirection);
+
+    if (newSpeed < INT_TO_FIXED(MIN_HZ))
+    {
+        stepAlarmStart(newSpeed, lastStep);
+    }
+    else
+    {
+        PwmTiming timing = entryTiming(entry);
+
+        if (handOver)
+        {
+            int stride = 1 << modeShift;
+            position += direction ? -stride : stride;
+            indexer += direction ? -stride : stride;
+            stepsToGo += stride;
+        }
+
+        // The counter keeps its count from before, which can be past the new
+        // TOP and would run round the whole 16 bits first
+        if (!holdStart)
+            pwm_set_counter(sliceNumber, lastStep != 0 ? pwmResumeCount(timing, lastStep, pulseOut) : 0);
+
+        pulseShift = modeShift;
+        setPwmMode();
+        applyPwmTiming(timing);
+    }
+
+    state = Running;
+
+    // Off the PWM, which can't be on full steps
+    if (modeShift != 0)
+        updateMode();
+}
+
+// Adds a ramp in SPEED_STEP increments and returns the speed it arrives at
+fixed_t Motor::planRamp(int &planStep, int &motorPosition, fixed_t fromSpeed, fixed_t delta, fixed_t limit, bool rampDirection)
+{
+    fixed_t span = delta < 0 ? fromSpeed - limit : limit - fromSpeed;
+    if (span <= 0)
+        return fromSpeed;
+
+    fixed_t increment = delta < 0 ? -delta : delta;
+
+    Segment &segment = staged->segments[planStep++];
+    segment.speed = fromSpeed;
+    segment.delta = delta;
+    segment.jerk = 0;
+    segment.limit = limit;
+    segment.entries = (span + increment - 1) / increment;
+    segment.steps = RAMP_STEP_PULSES;
+    segment.direction = rampDirection;
+    segment.expectedPosition = motorPosition;
+    segment.timings = -1;
+    segment.accel = 0;
+
+    // Braking to a standstill, the last entry doesn't move
+    int moving = limit > 0 ? segment.entries : segment.entries - 1;
+    motorPosition += (rampDirection ? 1 : -1) * moving * segment.steps;
+
+    return limit;
+}
+
+void Motor::planConstant(int &planStep, int &motorPosition, fixed_t constantSpeed, int steps, bool constantDirection)
+{
+    Segment &segment = staged->segments[planStep++];
+    segment.speed = constantSpeed;
+    segment.delta = 0;
+    segment.jerk = 0;
+    segment.limit = constantSpeed;
+    segment.entries = 1;
+    segment.steps = steps;
+    segment.direction = constantDirection;
+    segment.expectedPosition = motorPosition;
+    segment.timings = -1;
+    segment.accel = 0;
+
+    if (constantSpeed > 0)
+        motorPosition = constantDirection ? motorPosition + steps : motorPosition - steps;
+}
+
+void Motor::planEnd(int &planStep, int motorPosition)
+{
+    Segment &segment = staged->segments[planStep++];
+    segment.speed = -1;
+    segment.delta = 0;
+    segment.jerk = 0;
+    segment.limit = -1;
+    segment.entries = 1;
+    segment.steps = 0;
+    segment.direction = direction;
+    segment.expectedPosition = motorPosition;
+    segment.timings = -1;
+    segment.accel = 0;
+}
+
+void Motor::planSegment(int &planStep, int &motorPosition, fixed_t fromSpeed, fixed_t delta, fixed_t jerk, fixed_t limit,
+                        int entries, bool segmentDirection)
+{
+    if (entries <= 0)
+        return;
+
+    Segment &segment = staged->segments[planStep++];
+    segment.speed = fromSpeed;
+    segment.delta = delta;
+    segment.jerk = jerk;
+    segment.limit = limit;
+    segment.entries = entries;
+    segment.steps = RAMP_STEP_PULSES;
+    segment.direction = segmentDirection;
+    segment.expectedPosition = motorPosition;
+    segment.timings = -1;
+    segment.accel = 0;
+
+    motorPosition += (segmentDirection ? 1 : -1) * entries * segment.steps;
+}
+
+// Starting and finishing at SPEED_STEP is what the trapezoid does as well.
+// Below that a jerk limit would only make the ends of a move crawl.
+Motor::CurveLayout Motor::curveLayout(fixed_t fromSpeed, fixed_t toSpeed) const
+{
+    CurveLayout curve{};
+    fixed_t lowest = RAMP_STEP_FIXED;
+
+    curve.lead = toSpeed > fromSpeed && fromSpeed < lowest;
+    curve.trail = toSpeed < fromSpeed && toSpeed < lowest;
+    curve.from = curve.lead ? lowest : fromSpeed;
+    curve.to = curve.trail ? lowest : toSpeed;
+
+    fixed_t span = curve.to > curve.from ? curve.to - curve.from : curve.from - curve.to;
+    if ((toSpeed > fromSpeed && curve.to <= curve.from) || (toSpeed < fromSpeed && curve.to >= curve.from) || span == 0)
+    {
+        // Too small a change to shape, go straight to the target speed
+        curve.from = curve.to = toSpeed;
+        curve.lead = false;
+        curve.trail = toSpeed != fromSpeed;
+        return curve;
+    }
+
+    curve.jerk = std::max(scaledSpeed(INT_TO_FIXED(options.jerk)), 1);
+    fixed_t peak = options.sCurveSpeedStep > 0 ? scaledSpeed(INT_TO_FIXED(options.sCurveSpeedStep)) : RAMP_STEP_FIXED;
+
+    // Both jerk phases together change the speed by jerk * n * (n + 1)
+    int n = peak / curve.jerk;
+    while (n > 0 && (int64_t)curve.jerk * n * (n + 1) > span)
+        n--;
+
+    curve.jerkEntries = n;
+    curve.peak = n > 0 ? n * curve.jerk : std::min(curve.jerk, span);
+    fixed_t linear = span - curve.jerk * n * (n + 1);
+    curve.linearEntries = (linear + curve.peak - 1) / curve.peak;
+    if (curve.linearEntries > 0)
+        curve.linearStep = linear / curve.linearEntries;
+
+    return curve;
+}
+
+int Motor::curveSteps(fixed_t fromSpeed, fixed_t toSpeed) const
+{
+    CurveLayout curve = curveLayout(fromSpeed, toSpeed);
+
+    int entries = 2 * curve.jerkEntries + curve.linearEntries;
+    if (curve.lead)
+        entries++;
+    if (curve.trail && toSpeed > 0)
+        entries++;
+
+    return entries * RAMP_STEP_PULSES;
+}
+
+// Fastest speed we can reach from fromSpeed and still stop within dist
+bool Motor::rampMaxSpeed(Profile profile, fixed_t fromSpeed, int dist, fixed_t speedLimit, fixed_t &maxSpeed) const
+{
+    auto fits = [&](fixed_t travelSpeed) {
+        return rampSteps(profile, fromSpeed, travelSpeed) + rampSteps(profile, travelSpeed, 0) <= dist;
+    };
+
+    fixed_t low = std::min(fromSpeed, speedLimit);
+    if (!fits(speedLimit) && !fits(low))
+        return false;
+
+    maxSpeed = fastestSpeed(low, speedLimit, fits);
+    return true;
+}
+
+fixed_t Motor::planCurve(int &planStep, int &motorPosition, fixed_t fromSpeed, fixed_t toSpeed, bool curveDirection)
+{
+    CurveLayout curve = curveLayout(fromSpeed, toSpeed);
+    fixed_t sign = curve.to > curve.from ? 1 : -1;
+    fixed_t gain = curve.jerk * curve.jerkEntries * (curve.jerkEntries + 1) / 2;
+
+    if (curve.lead)
+        planConstant(planStep, motorPosition, curve.from, RAMP_STEP_PULSES, curveDirection);
+
+    planSegment(planStep, motorPosition, curve.from, sign * curve.jerk, sign * curve.jerk, curve.from + sign * gain,
+                curve.jerkEntries, curveDirection);
+    planSegment(planStep, motorPosition, curve.from + sign * gain, sign * curve.linearStep, 0, curve.to - sign * gain,
+                curve.linearEntries, curveDirection);
+    planSegment(planStep, motorPosition, curve.to - sign * gain, sign * curve.peak, -sign * curve.jerk, curve.to,
+                curve.jerkEntries, curveDirection);
+
+    if (curve.trail)
+        planConstant(planStep, motorPosition, toSpeed, toSpeed > 0 ? RAMP_STEP_PULSES : 0, curveDirection);
+
+    return toSpeed;
+}
+
+// Microseconds from a standstill to half of halfSteps, accel in steps/s/s
+int64_t Motor::linearTime(fixed_t accel, int halfSteps)
+{
+    return (int64_t)squareRoot(((uint64_t)halfSteps << FIXED_SHIFT) * 100000000 / (uint32_t)accel * 10000);
+}
+
+// Speed index steps from a standstill, accel in steps/s/s
+fixed_t __not_in_flash_func(Motor::linearSpeed)(fixed_t accel, int index)
+{
+    return (fixed_t)squareRoot((uint64_t)2 * (uint32_t)accel * (uint32_t)index << FIXED_SHIFT);
+}
+
+// Steps from a standstill to atSpeed, at least one
+int Motor::linearIndexOf(fixed_t atSpeed) const
+{
+    return std::max((int)((((int64_t)atSpeed * atSpeed) / (2 * (int64_t)rampAccel)) >> FIXED_SHIFT), 1);
+}
+
+// Linear ramps start and end here. That is the first step from a
+// standstill, unless it would be too slow for the PWM.
+fixed_t Motor::linearFloor() const
+{
+    return std::max(linearSpeed(rampAccel, 1), INT_TO_FIXED(MIN_HZ));
+}
+
+// Steps a linear ramp moves, the way planLinear() lays it out
+int Motor::linearSteps(fixed_t fromSpeed, fixed_t toSpeed) const
+{
+    fixed_t floor = linearFloor();
+    int first = linearIndexOf(std::max(fromSpeed, floor));
+    int last = linearIndexOf(std::max(toSpeed, floor));
+
+    if (toSpeed > fromSpeed)
+        return std::max(last - first, 1);
+    if (toSpeed < fromSpeed)
+        return std::max(first - last, 0);
+    return 0;
+}
+
+// A step per entry, braking to a standstill adds an entry that doesn't
+// move. A change too small for a step jumps straight to toSpeed.
+fixed_t Motor::planLinear(int &planStep, int &motorPosition, fixed_t fromSpeed, fixed_t toSpeed, bool rampDirection)
+{
+    int moving = linearSteps(fromSpeed, toSpeed);
+    int entries = toSpeed == 0 && fromSpeed > 0 ? moving + 1 : moving;
+    if (entries == 0)
+        return toSpeed;
+
+    int first = linearIndexOf(std::max(fromSpeed, linearFloor()));
+
+    Segment &segment = staged->segments[planStep++];
+    segment.speed = fromSpeed;
+    segment.limit = toSpeed;
+    segment.entries = entries;
+    segment.steps = 1;
+    segment.direction = rampDirection;
+    segment.expectedPosition = motorPosition;
+    segment.timings = -1;
+    segment.accel = rampAccel;
+    segment.index = toSpeed > fromSpeed ? first + 1 : 1 - first;
+    segment.count = 0;
+    segment.endTop = 0;
+
+    motorPosition += (rampDirection ? 1 : -1) * moving;
+
+    return toSpeed;
+}
+
+// Work out the PWM registers for the plan entries now, so the interrupt
+// only has to write them
+void Motor::planTimings(int planSteps)
+{
+    Segment *plan = staged->segments;
+    fixed_t slowest = 0;
+    fixed_t fastest = 0;
+    for (int i = 0 ; i < planSteps && plan[i].speed >= 0 ; i++)
+    {
+        for (int entry = 0 ; entry < plan[i].entries ; entry++)
+        {
+            // The ends of a linear ramp are its slowest and fastest entries
+            if (plan[i].accel != 0 && entry != 0 && entry < plan[i].entries - 2)
+                entry = plan[i].entries - 2;
+
+            fixed_t entrySpeed = segmentEntrySpeed(plan[i], entry);
+            if (entrySpeed >= INT_TO_FIXED(MIN_HZ) && (slowest == 0 || entrySpeed < slowest))
+                slowest = entrySpeed;
+            fastest = std::max(fastest, entrySpeed);
+        }
+    }
+
+    if (slowest != 0)
+    {
+        staged->div = pwmDivFor(slowest);
+
+        // Room for the longer period of full steps at the top speed, which
+        // is what a slow axis runs at while a fast one slews
+        if (options.fullStepSpeed > 0 && modeMask != 0)
+            staged->div = std::max(staged->div, pwmDivFor(fastest >> __builtin_ctz(options.microsteps)));
+
+        // A divider we are already running with keeps the change seamless
+        if (state == Running && speed >= INT_TO_FIXED(MIN_HZ) && pwmDiv >= staged->div)
+            staged->div = pwmDiv;
+    }
+
+    // Linear ramps only need their ends, the steps in between follow from
+    // the first one
+    staged->linearRate = ((uint32_t)PWM_CLOCK << 4) / staged->div;
+    for (int i = 0 ; i < planSteps && plan[i].speed >= 0 ; i++)
+    {
+        Segment &segment = plan[i];
+        if (segment.accel == 0)
+            continue;
+
+        fixed_t first = segmentEntrySpeed(segment, 0);
+        if (segment.entries > 1)
+            segment.count = (uint32_t)std::min(((uint64_t)staged->linearRate << (FIXED_SHIFT + LINEAR_SHIFT)) / first,
+                                               (uint64_t)MAX_WRAP << LINEAR_SHIFT);
+
+        // The recurrence comes out 1/(64n^2) slow when started at step n of
+        // a standstill, so it is started that much fast. Braking is exact
+        // until the last few steps.
+        if (segment.index > 0 && segment.index < 1024)
+            segment.count -= segment.count / (64 * segment.index * segment.index);
+        segment.endTop = segment.limit >= INT_TO_FIXED(MIN_HZ) ? pwmTiming(segment.limit, staged->div).top : 0;
+    }
+
+    int timing = 0;
+
+    for (int i = 0 ; i < planSteps && timing < PLAN_TIMINGS ; i++)
+    {
+        Segment &segment = plan[i];
+        if (segment.speed < 0)
+            break;
+        if (segment.accel != 0)
+            continue;
+
+        segment.timings = timing;
+        for (int entry = 0 ; entry < segment.entries && timing < PLAN_TIMINGS ; entry++)
+        {
+            fixed_t entrySpeed = segmentEntrySpeed(segment, entry);
+            if (entrySpeed >= INT_TO_FIXED(MIN_HZ))
+                staged->timings[timing] = pwmTiming(entrySpeed, staged->div);
+            timing++;
+        }
+    }
+}
+
+void Motor::runToTarget(double targetSpeed, int target, Profile profile)
+{
+    holdMicrosteps();
+    if (planMove(doubleToFixed(targetSpeed), target, profile, SPEED_STEP_PULSES))
+        startPlan();
+    releaseMicrosteps();
+}
+
+// Swaps the staged plan in. The steps made since the snapshot ran at the
+// speed the new plan starts with, so they come off its first entries.
+void Motor::startPlan()
+{
+    if (pioSm == -1)
+        planTimings(PLAN_SEGMENTS);
+
+    // Where each segment is due, for positionAt()
+    int64_t start = 0;
+    for (int i = 0 ; i < PLAN_SEGMENTS ; i++)
+    {
+        Segment &segment = staged->segments[i];
+        segment.start = start;
+        if (segment.speed < 0)
+            break;
+        start += segmentDuration(segment, segment.entries, pioSm == -1 ? staged->div : 0);
+    }
+
+    uint32_t interrupts = save_and_disable_interrupts();
+
+    std::swap(active, staged);
+    step = 0;
+    segmentEntry = 0;
+    upcomingValid = false;
+    stepsToGo = pioSm == -1 ? (direction ? planStart - position : position - planStart) : 0;
+    planHeld = false;
+
+    // The steps made since the snapshot were at the speed it held
+    active->startTime = time_us_64();
+    if (stepsToGo < 0 && speed > 0)
+        active->startTime -= ((int64_t)-stepsToGo * 1000000 << FIXED_SHIFT) / speed;
+
+    motorSpeedStep();
+    publishSnapshot();
+
+    restore_interrupts(interrupts);
+}
+
+// Time the plan takes in microseconds
+int64_t Motor::planDuration() const
+{
+    const Segment *plan = staged->segments;
+    int64_t duration = 0;
+
+    for (int i = 0 ; i < PLAN_SEGMENTS && plan[i].speed >= 0 ; i++)
+        duration += segmentDuration(plan[i], plan[i].entries, 0);
+
+    return duration;
+}
+
+// Time the first entries of a segment take in microseconds. With the
+// divider of the plan, at the periods the PWM rounds the entries to.
+int64_t Motor::segmentDuration(const Segment &segment, int entries, uint32_t div)
+{
+    int64_t duration = 0;
+
+    if (segment.accel != 0)
+    {
+        // Step n from a standstill is sqrt(2n / accel) after it, so the
+        // steps of a linear ramp take the time between the half steps on
+        // either side of them
+        int moving = std::min(entries, segment.limit > 0 ? segment.entries : segment.entries - 1);
+        if (moving > 0)
+        {
+            int first = abs(segment.index);
+            int last = abs(segment.index + moving - 1);
+            int low = std::max(std::min(first, last), 1);
+            int high = std::max(first, last);
+            duration = linearTime(segment.accel, 2 * high + 1) - linearTime(segment.accel, 2 * low - 1);
+        }
+        return duration;
+    }
+
+    for (int entry = 0 ; entry < entries ; entry++)
+        duration += entryDuration(segmentEntrySpeed(segment, entry), segment.steps, div);
+
+    return duration;
+}
+
+int64_t Motor::entryDuration(fixed_t entrySpeed, int steps, uint32_t div)
+{
+    if (entrySpeed <= 0)
+        return 0;
+    if (div != 0 && entrySpeed >= INT_TO_FIXED(MIN_HZ))
+        return (int64_t)steps * (pwmTiming(entrySpeed, div).top + 1) * div / (16 * (PWM_CLOCK / 1000000));
+
+    return ((int64_t)steps * 1000000 << FIXED_SHIFT) / entrySpeed;
+}
+
+bool Motor::followingPlan() const
+{
+    return state == Running && !velocityMode && !homingSeek && active->segments[step].speed >= 0;
+}
+
+// Where the active plan has the motor at time. Off a plan a stopped motor
+// stays put and velocity mode goes on at the rate it is running at.
+int Motor::positionAt(absolute_time_t time) const
+{
+    int64_t elapsed = (int64_t)to_us_since_boot(time) - (int64_t)time_us_64();
+
+    if (!followingPlan())
+    {
+        if (state != Running || !velocityMode || elapsed <= 0)
+            return wrapPosition(position);
+
+        int64_t steps = ((int64_t)speed * elapsed / 1000000) >> FIXED_SHIFT;
+        return wrapPosition(direction ? position + (int)steps : position - (int)steps);
+    }
+
+    const Segment *plan = active->segments;
+    int64_t at = (int64_t)to_us_since_boot(time) - (int64_t)active->startTime;
+    int i = 0;
+
+    while (i < PLAN_SEGMENTS - 1 && plan[i].speed >= 0 && plan[i + 1].start <= at)
+        i++;
+
+    const Segment &segment = plan[i];
+    if (segment.speed < 0 || at <= segment.start)
+        return wrapPosition(segment.expectedPosition);
+
+    int64_t into = at - segment.start;
+    int steps = 0;
+
+    if (segment.accel != 0)
+    {
+        // The steps whose time has come, found by halving
+        int low = 0;
+        int high = segment.limit > 0 ? segment.entries : segment.entries - 1;
+        while (low < high)
+        {
+            int middle = (low + high + 1) / 2;
+            if (segmentDuration(segment, middle, 0) <= into)
+                low = middle;
+            else
+                high = middle - 1;
+        }
+        steps = low;
+    }
+    else
+    {
+        for (int entry = 0 ; entry < segment.entries ; entry++)
+        {
+            fixed_t entrySpeed = segmentEntrySpeed(segment, entry);
+            if (entrySpeed <= 0)
+                break;
+
+            int64_t duration = entryDuration(entrySpeed, segment.steps, pioSm == -1 ? active->div : 0);
+            if (into < duration)
+            {
+                steps += (int)(segment.steps * into / duration);
+                break;
+            }
+
+            into -= duration;
+            steps += segment.steps;
+        }
+    }
+
+    return wrapPosition(segment.direction ? segment.expectedPosition + steps : segment.expectedPosition - steps);
+}
+
+// When the active plan reaches its last target, nil_time off a plan
+absolute_time_t Motor::arrivalTime() const
+{
+    if (!followingPlan())
+        return state == Stopped ? get_absolute_time() : nil_time;
+
+    const Segment *plan = active->segments;
+    int i = step;
+    while (i < PLAN_SEGMENTS - 1 && plan[i].speed >= 0)
+        i++;
+
+    return from_us_since_boot(active->startTime + plan[i].start);
+}
+
+// Where target is for a move starting at from
+int Motor::clampTarget(int target, int from) const
+{
+    if (options.continuous)
+    {
+        // Whichever way round is shorter
+        int ahead = wrapPosition(target - from);
+        return ahead > microStepsPerRevolution / 2 ? from + ahead - microStepsPerRevolution : from + ahead;
+    }
+
+    if (target < 0)
+        target = 0;
+
+    if (target > maxSteps)
+        target = maxSteps;
+
+    return target;
+}
+
+// Position the motor will come to rest at if it is stopped smoothly, counting
+// what the PIO backend has queued already
+int Motor::plannedStart() const
+{
+    return pioSm != -1 ? position + pioQueuedSteps() : position;
+}
+
+// Leg that comes to a stop at its target, turning around first if it has to
+fixed_t Motor::planStop(int &plan_step, int &motor_position, fixed_t newSpeed, const Target &leg)
+{
+    int target = leg.position;
+    fixed_t speedLimit = leg.speedLimit;
+    Profile profile = legProfile(leg);
+
+    // Get the distance we have left to move
+    //printf("target = %d\n", target);
+    //printf("motor_position = %d\n", motor_position);
+    int dist = target - motor_position;
+    bool newDirection = dist > 0;
+    dist = abs(dist);
+
+    if (dist == 0) // Hit the nail on the head
+        return newSpeed;
+
+    int maxsteps = dist / RAMP_STEP_PULSES;
+    int ramp_steps = motorSpeedStepDeltaSteps(newSpeed);
+    bool overshoot = profile == Linear ? linearSteps(newSpeed, 0) > dist : maxsteps < ramp_steps;
+    if (overshoot) // Not even enough room to brake
+    {
+        // Generate overshoot
+        if (profile == Linear)
+            newSpeed = planLinear(plan_step, motor_position, newSpeed, 0, newDirection);
+        else
+            newSpeed = planRamp(plan_step, motor_position, newSpeed, -RAMP_STEP_FIXED, 0, newDirection);
+
+        dist = target - motor_position;
+        newDirection = dist > 0;
+        dist = abs(dist);
+    }
+
+    dist = target - motor_position;
+    newDirection = dist > 0;
+    dist = abs(dist);
+    maxsteps = dist / RAMP_STEP_PULSES;
+    ramp_steps = motorSpeedStepDeltaSteps(newSpeed);
+    int steps_left = maxsteps - ramp_steps;
+
+    // Done in 64 bits, a long move can produce a ramp room far outside the fixed point range
+    int64_t ramp_room = (int64_t)INT_TO_FIXED(FIXED_TO_INT(newSpeed)) + (int64_t)RAMP_STEP_FIXED * steps_left / 2;
+    if (ramp_room > speedLimit)
+        ramp_room = speedLimit;
+    auto max_speed = (fixed_t)ramp_room;
+
+    // Linear ramps are laid out step by step, that works for short moves too
+    bool shaped = profile != Trapezoid && rampMaxSpeed(profile, newSpeed, dist, speedLimit, max_speed);
+
+    if (maxsteps < 5 && (profile != Linear || !shaped)) // Less than 250 units
+    {
+        planConstant(plan_step, motor_position, scaledSpeed(INT_TO_FIXED(200)), dist, newDirection); // Constant direct move
+        planConstant(plan_step, motor_position, 0, 0, newDirection);
+        newSpeed = 0;
+    }
+    else if (shaped)
+    {
+        newSpeed = planProfileRamp(profile, plan_step, motor_position, newSpeed, max_speed, newDirection);
+
+        int coast = abs(target - motor_position) - rampSteps(profile, newSpeed, 0);
+        if (coast > 0)
+            planConstant(plan_step, motor_position, newSpeed, coast, newDirection); // Coasting distance
+
+        newSpeed = planProfileRamp(profile, plan_step, motor_position, newSpeed, 0, newDirection);
+    }
+    else
+    {
+        if (max_speed <= newSpeed)
+        {
+            ramp_steps = motorSpeedStepDeltaSteps(newSpeed - max_speed);
+            ramp_steps += motorSpeedStepDeltaSteps(max_speed);
+            newSpeed = planRamp(plan_step, motor_position, newSpeed, -RAMP_STEP_FIXED, max_speed, newDirection);
+        }
+        else
+        {
+            ramp_steps = motorSpeedStepDeltaSteps(max_speed - newSpeed);
+            ramp_steps += motorSpeedStepDeltaSteps(max_speed);
+            newSpeed = planRamp(plan_step, motor_position, newSpeed, RAMP_STEP_FIXED, max_speed, newDirection);
+        }
+
+        // Code for debugging the travel planner
+        //printf("speed = %d\n", speed);
+        //printf("dist = %d\n", dist);
+        //printf("maxsteps = %d\n", maxsteps);
+        //printf("ramp_steps = %d\n", ramp_steps);
+        //printf("steps_left = %d\n", steps_left);
+        //printf("max_speed = %d\n", max_speed);
+
+        ramp_steps--; // Last is zero speed, it will not create any motion, so don't consider it for distance
+
+        planConstant(plan_step, motor_position, newSpeed, dist - ramp_steps * RAMP_STEP_PULSES, newDirection); // Coasting distance
+
+        newSpeed = planRamp(plan_step, motor_position, newSpeed, -RAMP_STEP_FIXED, 0, newDirection);
+    }
+
+    return newSpeed;
+}
+
+// Replaces whatever the motor was doing with a move to target. Builds the
+// plan, the caller starts it with startPlan(). Returns false if there is
+// nothing to do.
+bool Motor::planMove(fixed_t speedLimit, int target, Profile profile, int rampScale)
+{
+    if (!homed || (state != Stopped && state != Running))
+        return false;
+
+    foldPosition();
+    targets[0] = {clampTarget(target, plannedStart()), speedLimit, profile};
+    targetCount = 1;
+
+    return planTargets(rampScale);
+}
+
+// Adds a target behind the ones already queued and replans through all of
+// them. Returns false if the queue is full.
+bool Motor::queueTarget(double targetSpeed, int target, Profile profile)
+{
+    if (!homed || (state != Stopped && state != Running))
+        return false;
+
+    dropPassedTargets();
+    foldPosition();
+
+    int previous = targetCount > 0 ? targets[targetCount - 1].position : plannedStart();
+    target = clampTarget(target, previous);
+    if (target == previous && (targetCount > 0 || state != Running))
+        return true;
+
+    if (targetCount == TARGET_QUEUE)
+        return false;
+
+    targets[targetCount++] = {target, doubleToFixed(targetSpeed), profile};
+
+    holdMicrosteps();
+    if (planTargets(SPEED_STEP_PULSES))
+        startPlan();
+    releaseMicrosteps();
+
+    return true;
+}
+
+int Motor::queuedTargets() const
+{
+    return targetCount;
+}
+
+// Targets the motor has moved past come off the queue
+void Motor::dropPassedTargets()
+{
+    if (state != Running)
+    {
+        targetCount = 0;
+        return;
+    }
+
+    int passed = std::min((int)active->segments[step].leg, (int)targetCount);
+    for (int i = passed ; i < targetCount ; i++)
+        targets[i - passed] = targets[i];
+    targetCount -= passed;
+}
+
+// Steps a ramp from fromSpeed to toSpeed takes, the way planProfileRamp()
+// lays it out
+int Motor::rampSteps(Profile profile, fixed_t fromSpeed, fixed_t toSpeed) const
+{
+    if (profile == SCurve)
+        return curveSteps(fromSpeed, toSpeed);
+    if (profile == Linear)
+        return linearSteps(fromSpeed, toSpeed);
+
+    int entries = motorSpeedStepDeltaSteps(abs(toSpeed - fromSpeed));
+    if (entries > 0 && toSpeed == 0)
+        entries--; // Last is zero speed
+    return entries * RAMP_STEP_PULSES;
+}
+
+fixed_t Motor::planProfileRamp(Profile profile, int &planStep, int &motorPosition, fixed_t fromSpeed, fixed_t toSpeed,
+                               bool rampDirection)
+{
+    if (profile == SCurve)
+        return planCurve(planStep, motorPosition, fromSpeed, toSpeed, rampDirection);
+    if (profile == Linear)
+        return planLinear(planStep, motorPosition, fromSpeed, toSpeed, rampDirection);
+
+    return planRamp(planStep, motorPosition, fromSpeed, toSpeed > fromSpeed ? RAMP_STEP_FIXED : -RAMP_STEP_FIXED,
+                    toSpeed, rampDirection);
+}
+
+Profile Motor::legProfile(const Target &target) const
+{
+    if (target.profile == SCurve && options.jerk > 0)
+        return SCurve;
+
+    // The PIO backend runs whole entries without the CPU, not single steps
+    if (target.profile == Linear && options.acceleration > 0 && pioSm == -1)
+        return Linear;
+
+    return Trapezoid;
+}
+
+// Speeds to pass each queued target at. Going backwards, a junction can't be
+// faster than the next leg can brake from, going forwards it can't be faster
+// than the leg leading up to it can accelerate to. Junctions where the
+// direction changes are passed at a standstill, as is the last target.
+void Motor::planJunctions(int startPosition, fixed_t entrySpeed, fixed_t *exits) const
+{
+    exits[targetCount - 1] = 0;
+
+    for (int i = targetCount - 2 ; i >= 0 ; i--)
+    {
+        int from = i > 0 ? targets[i - 1].position : startPosition;
+        int here = targets[i].position;
+        int next = targets[i + 1].position;
+
+        exits[i] = 0;
+        if (here == from || next == here || (here > from) != (next > here))
+            continue;
+
+        Profile profile = legProfile(targets[i + 1]);
+        fixed_t exit = exits[i + 1];
+        int dist = abs(next - here);
+        exits[i] = fastestSpeed(exit, std::max(std::min(targets[i].speedLimit, targets[i + 1].speedLimit), exit),
+                                [&](fixed_t junction) { return rampSteps(profile, junction, exit) <= dist; });
+    }
+
+    fixed_t speedIn = entrySpeed;
+    for (int i = 0 ; i < targetCount - 1 ; i++)
+    {
+        int from = i > 0 ? targets[i - 1].position : startPosition;
+        int dist = abs(targets[i].position - from);
+        Profile profile = legProfile(targets[i]);
+
+        if (exits[i] > speedIn)
+        {
+            exits[i] = fastestSpeed(speedIn, exits[i],
+                                    [&](fixed_t junction) { return rampSteps(profile, speedIn, junction) <= dist; });
+        }
+        else if (rampSteps(profile, speedIn, exits[i]) > dist)
+        {
+            exits[i] = 0; // Too fast to slow down in time, planStop() overshoots
+        }
+
+        speedIn = exits[i];
+    }
+}
+
+// Leg that passes its target at exitSpeed without stopping
+fixed_t Motor::planBlend(int &planStep, int &motorPosition, fixed_t newSpeed, fixed_t exitSpeed, const Target &target)
+{
+    Profile profile = legProfile(target);
+    bool newDirection = target.position > motorPosition;
+    int dist = abs(target.position - motorPosition);
+
+    fixed_t low = std::max(newSpeed, exitSpeed);
+    fixed_t travelSpeed = fastestSpeed(low, std::max(target.speedLimit, low), [&](fixed_t top) {
+        return rampSteps(profile, newSpeed, top) + rampSteps(profile, top, exitSpeed) <= dist;
+    });
+
+    newSpeed = planProfileRamp(profile, planStep, motorPosition, newSpeed, travelSpeed, newDirection);
+
+    int coast = abs(target.position - motorPosition) - rampSteps(profile, newSpeed, exitSpeed);
+    if (coast > 0)
+        planConstant(planStep, motorPosition, newSpeed, coast, newDirection); // Coasting distance
+
+    return planProfileRamp(profile, planStep, motorPosition, newSpeed, exitSpeed, newDirection);
+}
+
+bool Motor::planTargets(int rampScale)
+{
+    int plan_step = 0;
+
+    trajectoryCancel();
+    velocityCancel();
+
+    // Snapshot. From here the motor keeps the speed it has, an entry whose
+    // timing is staged already starts at the next wrap.
+    uint32_t interrupts = save_and_disable_interrupts();
+    if (upcomingValid && upcomingStaged)
+        speed = upcoming.speed;
+    stepsToGo = 0;
+    upcomingValid = false;
+    planHeld = true;
+    planStart = plannedStart();
+    restore_interrupts(interrupts);
+
+    int start_position = planStart;
+
+    if (pioSm != -1)
+    {
+        setPioMode();
+
+        // Whatever is already queued in the state machine will still run
+        pioEntryValid = false;
+        pioLimit = false;
+    }
+
+    int motor_position = start_position;
+
+    int dist = targets[0].position - start_position;
+    bool newDirection = dist > 0;
+
+    if (targetCount == 1 && start_position == targets[0].position && state != Running) // No motion in the ocean
+    {
+        targetCount = 0;
+        planHeld = false;
+        return false;
+    }
+
+    setRampScale(rampScale);
+
+    fixed_t newSpeed = speed;
+
+    if (state == Running) // We are already moving
+    {
+        if (newDirection != direction) // But the wrong way!
+        {
+            if (legProfile(targets[0]) == Linear)
+                newSpeed = planLinear(plan_step, motor_position, newSpeed, 0, direction);
+            else
+                newSpeed = planRamp(plan_step, motor_position, newSpeed, -RAMP_STEP_FIXED, 0, direction);
+        }
+    }
+
+    fixed_t exits[TARGET_QUEUE];
+    planJunctions(motor_position, newSpeed, exits);
+
+    int legStart = 0;
+    for (int leg = 0 ; leg < targetCount ; leg++)
+    {
+        if (exits[leg] > 0)
+            newSpeed = planBlend(plan_step, motor_position, newSpeed, exits[leg], targets[leg]);
+        else
+            newSpeed = planStop(plan_step, motor_position, newSpeed, targets[leg]);
+
+        for ( ; legStart < plan_step ; legStart++)
+            staged->segments[legStart].leg = leg;
+    }
+
+    planEnd(plan_step, motor_position);
+    staged->segments[plan_step - 1].leg = targetCount - 1;
+
+    // Code to dump the finished acceleration plan
+//    int i;
+//
+//    printf("                Entries Steps Speed Delta Limit Dir Pos\n");
+//    for (i = 0 ; i < plan_step ; i++)
+//    {
+//        const Segment &segment = staged->segments[i];
+//        printf("Plan segment %d : %4d %5d %8.2lf %8.2lf %8.2lf %-3.3s %5d\n", i + 1, segment.entries, segment.steps,
+//               fixedToDouble(segment.speed), fixedToDouble(segment.delta), fixedToDouble(segment.limit),
+//               segment.direction ? "out" : "in", segment.expectedPosition);
+//    }
+//    printf("Final position %d, started at %d\n", motor_position, start_position);
+
+    step = 0;
+    segmentEntry = 0;
+
+    return true;
+}
+
+// Moves both motors so that they arrive together. The shorter move is
+// planned as a slowed down copy of the longer one, with its speeds and ramp
+// steps scaled by its share of the distance, so the two axes stay in
+// proportion all the way and the path between the end points is straight.
+// Motors starting from a standstill on the PWM start on the same clock.
+void Motor::runCoordinated(Motor *first, int firstTarget, Motor *second, int secondTarget, double targetSpeed,
+                           Profile profile)
+{
+    // Both axes or neither
+    if (!first->homed || !second->homed)
+        return;
+
+    first->foldPosition();
+    second->foldPosition();
+
+    int firstDist = abs(first->clampTarget(firstTarget, first->plannedStart()) - first->plannedStart());
+    int secondDist = abs(second->clampTarget(secondTarget, second->plannedStart()) - second->plannedStart());
+
+    Motor *lead = first;
+    Motor *follower = second;
+    int leadTarget = firstTarget;
+    int followerTarget = secondTarget;
+    if (secondDist > firstDist)
+    {
+        std::swap(lead, follower);
+        std::swap(leadTarget, followerTarget);
+        std::swap(firstDist, secondDist);
+    }
+
+    holdMicrosteps();
 
-    setDirection(newDirection);
+    fixed_t speedLimit = doubleToFixed(targetSpeed);
+    int leadScale = lead->options.microsteps * 5;
+    int followerScale = leadScale;
+    fixed_t followerLimit = speedLimit;
+    if (firstDist > 0)
+    {
+        followerScale = (int)(((int64_t)follower->options.microsteps * 5 * secondDist + firstDist / 2) / firstDist);
+        followerLimit = std::max((fixed_t)((int64_t)speedLimit * secondDist / firstDist), 1);
+    }
+
+    bool leadPlanned = lead->planMove(speedLimit, leadTarget, profile, leadScale);
+    bool followerPlanned = follower->planMove(followerLimit, followerTarget, profile, followerScale);
 
-    if (newSpeed < MIN_HZ)
+    // The scale is rounded to whole steps per ramp entry, which matters for
+    // short follower moves. Those get their speed limit searched for instead.
+    // Replanning is only safe from a standstill.
+    int64_t leadDuration = leadPlanned ? lead->planDuration() : 0;
+    if (leadPlanned && followerPlanned && follower->state == Stopped && secondDist > 0 &&
+        llabs(follower->planDuration() - leadDuration) > leadDuration / 64)
     {
-        setGpioMode();
+        fixed_t low = 1;
+        fixed_t high = speedLimit;
 
-        int period = (int)(1000000.0 / (newSpeed * 2.0));
+        while (high - low > 1)
+        {
+            fixed_t middle = low + (high - low) / 2;
+            follower->planMove(middle, followerTarget, profile, followerScale);
+            if (follower->planDuration() >= leadDuration)
+                low = middle;
+            else
+                high = middle;
+        }
 
-        enableMotor();
+        follower->planMove(low, followerTarget, profile, followerScale);
+    }
 
-        gpio_put(pins.step, false);
-        add_repeating_timer_us(period, alarmHandler, this, &timerData);
+    lead->holdStart = follower->holdStart = true;
+    lead->startPending = follower->startPending = false;
+
+    if (leadPlanned)
+        lead->startPlan();
+    if (followerPlanned)
+        follower->startPlan();
+
+    lead->holdStart = follower->holdStart = false;
+
+    uint32_t mask = 0;
+    if (lead->startPending)
+        mask |= 1u << lead->sliceNumber;
+    if (follower->startPending)
+        mask |= 1u << follower->sliceNumber;
+
+    if (mask)
+    {
+        uint32_t interrupts = save_and_disable_interrupts();
+        pwm_set_mask_enabled(pwm_hw->en | mask);
+        restore_interrupts(interrupts);
     }
-    else
+
+    releaseMicrosteps();
+}
+
+bool Motor::isRunning()
+{
+    return state == Running;
+}
+
+// Planned moves can go past what microsteps allow: the drivers go to full
+// steps, and no other running motor keeps them on microsteps
+bool Motor::canSlew() const
+{
+    if (modeMask == 0 || options.fullStepSpeed <= 0 || pioSm != -1)
+        return false;
+
+    for (Motor *motor : slices)
     {
-        setPwmMode();
-        setPwmFreq((float) newSpeed);
+        if (motor == nullptr || motor == this || motor->isIdle())
+            continue;
+
+        if (motor->velocityMode || motor->trajectoryActive || motor->homingSeek || motor->pioSm != -1 ||
+            motor->options.fullStepSpeed <= 0 || motor->options.microsteps != options.microsteps)
+            return false;
     }
 
-    state = Running;
+    return true;
 }
 
-void Motor::runToTarget(double targetSpeed, int target)
+// Stopped with nothing left that could start it again by itself
+bool __not_in_flash_func(Motor::isIdle)() const
 {
-    if (state != Stopped && state != Running)
+    return state == Stopped && !velocityMode && !trajectoryActive && trajectoryHead == trajectoryTail &&
+           targetCount == 0;
+}
+
+bool Motor::isHomed() const
+{
+    return homed;
+}
+
+void Motor::setCurrentPosition(int newPosition)
+{
+    if (isRunning())
         return;
 
-    int plan_step = 0;
+    this->position = newPosition;
+    publishSnapshot();
+}
 
-    if (target < 0.001)
-        target = 0;
+void Motor::setOptions(Options newOptions)
+{
+    if (isRunning())
+        return;
 
-    if (target > maxSteps)
-        target = maxSteps;
+    newOptions.backend = options.backend;
+    this->options = newOptions;
+}
 
-    setPwmMode();
+Options Motor::getOptions()
+{
+    return options;
+}
 
-    int motor_position = position;
-    int orig_position = position;
+int Motor::getCurrentPosition() const
+{
+    return wrapPosition(position);
+}
 
-    int dist = target - position;
-    bool newDirection = dist > 0;
+int64_t Motor::getTurns() const
+{
+    return turnsOf(position);
+}
 
-    if (position == target && state != Running) // No motion in the ocean
-        return;
+int __not_in_flash_func(Motor::wrapPosition)(int raw) const
+{
+    if (!options.continuous)
+        return raw;
 
-    stepsToGo = 0;
-    double newSpeed = speed;
+    int wrapped = raw % microStepsPerRevolution;
+    return wrapped < 0 ? wrapped + microStepsPerRevolution : wrapped;
+}
 
-    if (state == Running) // We are already moving
-    {
-        if (newDirection != direction) // But the wrong way!
-        {
-            do
-            {
-                newSpeed -= SPEED_STEP;
-                if (newSpeed < 0)
-                    newSpeed = 0;
-                plan[plan_step].expectedPosition = motor_position;
-                plan[plan_step].direction = direction;
-                plan[plan_step].steps = newSpeed > 0 ? SPEED_STEP_PULSES : 0;
-                motor_position = direction ? motor_position + plan[plan_step].steps : motor_position - plan[plan_step].steps;
-                plan[plan_step++].speed = newSpeed;
-            } while (newSpeed > 0.0);
+int64_t __not_in_flash_func(Motor::turnsOf)(int raw) const
+{
+    if (!options.continuous)
+        return 0;
 
-            direction = newDirection;
-        }
-    }
+    return turns + (raw - wrapPosition(raw)) / microStepsPerRevolution;
+}
 
-    // Get the distance we have left to move
-    //printf("target = %d\n", target);
-    //printf("motor_position = %d\n", motor_position);
-    dist = target - motor_position;
-    newDirection = dist > 0;
-    dist = abs(dist);
+// Nothing refers to the position while the motor is idle, so whole turns
+// can come off it then
+void Motor::foldPosition()
+{
+    if (!options.continuous || !isIdle() || plannedStart() != position)
+        return;
 
-    if (dist == 0) // Hit the nail on the head
-    {
-        plan[plan_step].expectedPosition = motor_position;
-        plan[plan_step].direction = direction;
-        plan[plan_step].steps = 0;
-        plan[plan_step++].speed = -1;
-    }
-    else
-    {
-        int maxsteps = dist / SPEED_STEP_PULSES;
-        int ramp_steps = motorSpeedStepDeltaSteps((int)newSpeed);
-        if (maxsteps < ramp_steps) // Not even enough room to brake
-        {
-            while (newSpeed > 0) // Generate overshoot
-            {
-                newSpeed -= SPEED_STEP;
-                if (newSpeed < 0)
-                    newSpeed = 0;
-                plan[plan_step].expectedPosition = motor_position;
-                plan[plan_step].direction = newDirection;
-                plan[plan_step].steps = newSpeed > 0 ? SPEED_STEP_PULSES : 0;
-                motor_position = newDirection ? motor_position + plan[plan_step].steps : motor_position - plan[plan_step].steps;
-                plan[plan_step++].speed = newSpeed;
-            }
+    int wrapped = wrapPosition(position);
+    if (wrapped == position)
+        return;
 
-            dist = target - motor_position;
-            newDirection = dist > 0;
-            dist = abs(dist);
-        }
+    uint32_t interrupts = save_and_disable_interrupts();
+    turns = turnsOf(position);
+    position = wrapped;
+    restore_interrupts(interrupts);
 
-        dist = target - motor_position;
-        newDirection = dist > 0;
-        dist = abs(dist);
-        maxsteps = dist / SPEED_STEP_PULSES;
-        ramp_steps = motorSpeedStepDeltaSteps((int)newSpeed);
-        int steps_left = maxsteps - ramp_steps;
+    publishSnapshot();
+}
+
+void __not_in_flash_func(Motor::recordEndstop)()
+{
+    EndstopEvent &event = planCheck.endstops[planCheck.endstopHits++ % ENDSTOP_EVENTS];
+    event.time = timeNow();
+    event.position = position;
+    event.speed = speed;
+}
 
-        double max_speed = (int)newSpeed + SPEED_STEP * ((double)steps_left / 2);
-        if (max_speed > targetSpeed)
-            max_speed = targetSpeed;
+PlanCheck Motor::getPlanCheck() const
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    PlanCheck copy = planCheck;
+    restore_interrupts(interrupts);
 
-        if (maxsteps < 5) // Less than 250 units
-        {
-            plan[plan_step].expectedPosition = motor_position;
-            plan[plan_step].direction = newDirection;
-            plan[plan_step].steps = dist;
-            motor_position = newDirection ? motor_position + plan[plan_step].steps : motor_position - plan[plan_step].steps;
-            plan[plan_step++].speed = 200; // Constant direct move
+    return copy;
+}
 
-            plan[plan_step].expectedPosition = motor_position;
-            plan[plan_step].direction = newDirection;
-            plan[plan_step].steps = 0;
-            plan[plan_step++].speed = 0;
+void Motor::resetPlanCheck()
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    planCheck = {};
+    restore_interrupts(interrupts);
+}
+
+// Only core1 writes the motion state, so this only has to keep its own
+// interrupts out
+void __not_in_flash_func(Motor::publishSnapshot)()
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+
+    snapshotSequence = snapshotSequence + 1;
+    __dmb();
+
+    MotorSnapshot &state = published.state;
+    int current = wrapPosition(position);
+    if (current != state.position)
+        state.lastStep = timeNow();
+    state.position = current;
+    state.turns = turnsOf(position);
+    state.speed = this->state == Running ? speed : 0;
+    state.direction = direction;
+    state.running = this->state == Running;
+    state.homing = this->state != Running && this->state != Stopped;
+    state.homed = homed;
+
+    // The PWM steps on by itself until the next publish. The rate is the
+    // one the counter runs at, not the planned speed it is rounded from.
+    published.position = position;
+    published.stride = 1 << modeShift;
+    published.rate = 0;
+    published.time = timeNow() << FIXED_SHIFT;
+    if (this->state == Running && pioSm == -1 && !onStepAlarm && !velocityOnTimer && pwmDiv != 0)
+    {
+        published.time = wrapTime();
+        if (velocityMode)
+        {
+            published.rate = velocityRate;
         }
         else
         {
-            if (max_speed <= newSpeed)
-            {
-                ramp_steps = motorSpeedStepDeltaSteps((int)(newSpeed - max_speed));
-                while (newSpeed > max_speed)
-                {
-                    newSpeed -= SPEED_STEP;
-                    if (newSpeed < max_speed)
-                        newSpeed = max_speed;
-
-                    plan[plan_step].expectedPosition = motor_position;
-                    plan[plan_step].direction = newDirection;
-                    plan[plan_step].steps = SPEED_STEP_PULSES;
-                    motor_position = newDirection ? motor_position + plan[plan_step].steps : motor_position - plan[plan_step].steps;
-                    plan[plan_step++].speed = newSpeed; // Constant direct move
-                }
-            }
-            else
-            {
-                ramp_steps = motorSpeedStepDeltaSteps((int)(max_speed - newSpeed));
-                ramp_steps += motorSpeedStepDeltaSteps((int)max_speed);
-                while (newSpeed < max_speed)
-                {
-                    newSpeed += SPEED_STEP;
-                    if (newSpeed > max_speed)
-                        newSpeed = max_speed;
-
-                    plan[plan_step].expectedPosition = motor_position;
-                    plan[plan_step].direction = newDirection;
-                    plan[plan_step].steps = SPEED_STEP_PULSES;
-                    motor_position = newDirection ? motor_position + plan[plan_step].steps : motor_position - plan[plan_step].steps;
-                    plan[plan_step++].speed = newSpeed; // Constant direct move
-                }
-            }
+            PwmTiming timing = modeTiming(stagedTiming);
+            published.rate = ((uint64_t)PWM_CLOCK * 16 << 32) / (((uint32_t)timing.top + 1) * timing.div);
+        }
+    }
+    publishPending = false;
 
-            // Code for debugging the travel planner
-            //printf("speed = %d\n", speed);
-            //printf("dist = %d\n", dist);
-            //printf("maxsteps = %d\n", maxsteps);
-            //printf("ramp_steps = %d\n", ramp_steps);
-            //printf("steps_left = %d\n", steps_left);
-            //printf("max_speed = %d\n", max_speed);
+    __dmb();
+    snapshotSequence = snapshotSequence + 1;
 
-            ramp_steps--; // Last is zero speed, it will not create any motion, so don't consider it for distance
+    restore_interrupts(interrupts);
+}
 
-            plan[plan_step].expectedPosition = motor_position;
-            plan[plan_step].direction = newDirection;
-            plan[plan_step].steps = dist - ramp_steps * SPEED_STEP_PULSES; // Coasting distance
-            motor_position = newDirection ? motor_position + plan[plan_step].steps : motor_position - plan[plan_step].steps;
-            plan[plan_step++].speed = newSpeed; // Constant direct move
+// After a wrap. Steps at the published rate are left to the reader.
+void __not_in_flash_func(Motor::publishWrap)()
+{
+    const MotorSnapshot &state = published.state;
+    if (publishPending || published.rate == 0 || this->state != Running || speed != state.speed ||
+        direction != state.direction || homed != state.homed || published.stride != 1 << modeShift)
+        publishSnapshot();
+}
 
-            while (newSpeed > 0.0)
-            {
-                newSpeed -= SPEED_STEP;
-                if (newSpeed < 0)
-                    newSpeed = 0;
-
-                plan[plan_step].expectedPosition = motor_position;
-                plan[plan_step].direction = newDirection;
-                plan[plan_step].steps = newSpeed > 0 ? SPEED_STEP_PULSES : 0;
-                motor_position = newDirection ? motor_position + plan[plan_step].steps : motor_position - plan[plan_step].steps;
-                plan[plan_step++].speed = newSpeed;
-            }
-        }
+// When the PWM last wrapped, microseconds with FIXED_SHIFT fraction bits.
+// The counter has run on since.
+uint64_t __not_in_flash_func(Motor::wrapTime)() const
+{
+    return (timeNow() << FIXED_SHIFT) - (((uint64_t)pwm_get_counter(sliceNumber) * pwmDiv << FIXED_SHIFT) / (16 * (PWM_CLOCK / 1000000)));
+}
 
-        plan[plan_step].expectedPosition = motor_position;
-        plan[plan_step].direction = direction;
-        plan[plan_step].steps = 0;
-        plan[plan_step++].speed = -1;
-    }
+// Motion state of several motors as of one instant, which is returned in
+// microseconds. Never blocks core1, a copy that overlapped a publish is
+// simply taken again. Motors on the PWM have stepped on at their published
+// rate since.
+uint64_t Motor::snapshot(Motor *const motors[], MotorSnapshot snapshots[], int count)
+{
+    for (;;)
+    {
+        uint32_t sequence = snapshotSequence;
+        __dmb();
 
-    // Code to dump the finished acceleration plan
-//    int i;
-//
-//    printf("                Steps Speed Dir Pos\n");
-//    for (i = 0 ; i < plan_step ; i++)
-//    {
-//        orig_position = plan[i].direction ? orig_position + plan[i].steps : orig_position - plan[i].steps;
-//        printf("Plan step %3d : %5d %8.2lf %-3.3s %5d\n", i + 1, plan[i].steps, plan[i].speed, plan[i].direction ? "out" : "in", orig_position);
-//    }
+        if (sequence & 1)
+            continue;
 
-    step = 0;
+        uint64_t now = time_us_64();
+        for (int i = 0 ; i < count ; i++)
+        {
+            Published copy = motors[i]->published;
+            snapshots[i] = copy.state;
+
+            uint64_t at = now << FIXED_SHIFT;
+            if (copy.rate == 0 || at <= copy.time)
+                continue;
+
+            // Steps whose period has ended by now
+            double seconds = (double)(at - copy.time) / (1000000.0 * (1 << FIXED_SHIFT));
+            auto steps = (int64_t)(seconds * (double)copy.rate / 4294967296.0);
+            if (steps == 0)
+                continue;
+
+            int raw = copy.position + (int)(copy.state.direction ? steps * copy.stride : -steps * copy.stride);
+            snapshots[i].position = motors[i]->wrapPosition(raw);
+            snapshots[i].turns = motors[i]->turnsOf(raw);
+            snapshots[i].lastStep = (copy.time >> FIXED_SHIFT) + (uint64_t)((double)steps * 1000000.0 * 4294967296.0 / (double)copy.rate);
+        }
 
-    motorSpeedStep();
+        __dmb();
+        if (snapshotSequence == sequence)
+            return now;
+    }
 }
 
-bool Motor::isRunning()
+// Motors created after this run their timers from pool, which fires on
+// the core that created it. Without one they use the default pool.
+void Motor::setAlarmPool(alarm_pool_t *pool)
 {
-    return state == Running;
+    alarmPool = pool;
 }
 
-void Motor::setCurrentPosition(int newPosition)
+// Mode pins of the drivers, as set up by the caller. Without them plans
+// stay on microsteps.
+void Motor::setModePins(int m0, int m1, int m2)
 {
-    if (isRunning())
-        return;
+    modePins[0] = m0;
+    modePins[1] = m1;
+    modePins[2] = m2;
+    modeMask = (1u << m0) | (1u << m1) | (1u << m2);
+}
 
-    this->position = newPosition;
+alarm_pool_t *Motor::timerPool()
+{
+    return alarmPool ? alarmPool : alarm_pool_get_default();
 }
 
-void Motor::setOptions(Options newOptions)
+#if MOTOR_STATS
+// Cycles from the wrap to here. A wrap more than half a period late on the
+// one before means some went by while the interrupt was still pending.
+uint32_t __not_in_flash_func(Motor::statsWrapLatency)()
 {
-    if (isRunning())
-        return;
+    uint32_t latency = (uint32_t)pwm_get_counter(sliceNumber) * pwmDiv / 16;
+    uint32_t wrapTime = time_us_32() - latency / (PWM_CLOCK / 1000000);
 
-    this->options = newOptions;
+    if (statsWrapValid && statsPeriod != 0)
+    {
+        uint64_t gap = (uint64_t)(wrapTime - statsWrapTime) * (PWM_CLOCK / 1000000);
+        if (gap > statsPeriod + statsPeriod / 2)
+            stats.wrap.missed += (uint32_t)((gap + statsPeriod / 2) / statsPeriod) - 1;
+    }
+
+    // The TOP the wrap latched, nothing has been staged since
+    statsPeriod = ((uint32_t)pwm_hw->slice[sliceNumber].top + 1) * pwmDiv / 16;
+    statsWrapTime = wrapTime;
+    statsWrapValid = true;
+
+    return latency;
 }
 
-Options Motor::getOptions()
+void __not_in_flash_func(Motor::statsRecord)(IsrStats &isr, uint32_t start, uint32_t latency)
 {
-    return options;
+    // SysTick counts down
+    uint32_t cycles = (start - systick_hw->cvr) & 0xffffff;
+
+    isr.count++;
+    isr.totalCycles += cycles;
+    isr.minCycles = std::min(isr.minCycles, cycles);
+    isr.maxCycles = std::max(isr.maxCycles, cycles);
+
+    int bucket = 0;
+    while (bucket < STATS_BUCKETS - 1 && cycles >= (uint32_t)STATS_FIRST_BUCKET << bucket)
+        bucket++;
+    isr.histogram[bucket]++;
+
+    isr.maxLatency = std::max(isr.maxLatency, latency);
+    if (latency > STATS_LATE_CYCLES)
+        isr.late++;
 }
 
-int Motor::getCurrentPosition() const
+// Taken on core1, so it doesn't tear against the interrupts
+MotorStats Motor::getStats() const
+{
+    uint32_t interrupts = save_and_disable_interrupts();
+    MotorStats copy = stats;
+    restore_interrupts(interrupts);
+
+    return copy;
+}
+
+void Motor::resetStats()
 {
-    return position;
+    uint32_t interrupts = save_and_disable_interrupts();
+    stats = {};
+    stats.wrap.minCycles = stats.alarm.minCycles = UINT32_MAX;
+    restore_interrupts(interrupts);
 }
+#endif
 
-bool Motor::performStep()
+bool __not_in_flash_func(Motor::performStep)()
 {
+    // The pulse came out on the mode of its time, the next one comes out
+    // on the mode as it is now
+    int stride = 1 << pulseShift;
+    pulseShift = modeShift;
+
+    // Slowing down past the endstop, the position isn't known until the
+    // approach sets it
+    bool limited = !options.continuous && !homingBrake;
+
     if (direction)
     {
-        position++;
-        if (position > maxSteps)
+        position += stride;
+        indexer += stride;
+        if (position > maxSteps && limited)
         {
             return false;
         }
     }
     else
     {
-        position--;
-        if (position <= 0)
+        position -= stride;
+        indexer -= stride;
+        if (position <= 0 && limited)
         {
             return false;
         }
@@ -628,3 +3114,179 @@ bool Motor::performStep()
     return true;
 }
 
+
+void Motor::initPio()
+{
+    if (!pioInitialized)
+    {
+        pioProgramOffset = pio_add_program(STEP_PIO, &stepper_program);
+
+        irq_set_exclusive_handler(STEP_PIO_IRQ, &Motor::pioInterruptHandler);
+        irq_set_enabled(STEP_PIO_IRQ, true);
+
+        pioInitialized = true;
+    }
+
+    pioSm = pio_claim_unused_sm(STEP_PIO, false);
+    if (pioSm == -1)
+    {
+        printf("No free PIO state machine, falling back to PWM\r\n");
+        options.backend = PwmBackend;
+        return;
+    }
+
+    pioMotors[pioSm] = this;
+
+    stepper_program_init(STEP_PIO, pioSm, pioProgramOffset, pins.step);
+    pio_set_irq0_source_enabled(STEP_PIO, (pio_interrupt_source)(pis_sm0_rx_fifo_not_empty + pioSm), true);
+}
+
+int Motor::pioQueuedSteps() const
+{
+    int queued = 0;
+
+    for (int i = 0 ; i < pioInFlightCount ; i++)
+        queued += pioInFlight[(pioInFlightHead + i) % 4];
+
+    return queued;
+}
+
+void __not_in_flash_func(Motor::pioFeed)()
+{
+    // The queued chunks run out while a new plan is built
+    if (planHeld)
+        return;
+
+    for (;;)
+    {
+        if (!pioEntryValid)
+        {
+            if (pioLimit || !nextPlanEntry(pioEntry))
+            {
+                if (pioInFlightCount)
+                    return;
+
+                state = Stopped;
+                finishPlan();
+                return;
+            }
+            pioEntryValid = true;
+        }
+
+        if (pioEntry.steps == 0)
+        {
+            if (pioEntry.speed == 0)
+            {
+                // Standstill, let the queued steps run out first
+                if (pioInFlightCount)
+                    return;
+                state = Stopped;
+            }
+            pioEntryValid = false;
+            continue;
+        }
+
+        if (pioEntry.direction != direction)
+        {
+            if (pioInFlightCount)
+                return;
+            setDirection(pioEntry.direction);
+        }
+
+        if (pio_sm_get_tx_fifo_level(STEP_PIO, pioSm) > 2 * (PIO_FIFO_CHUNKS - 1))
+            return;
+
+        int chunk = std::min(pioEntry.steps, PIO_MAX_SEGMENT_STEPS);
+
+        // Kept between 0 and maxSteps like performStep() does, counted
+        // from where the queued chunks end. Steps past that end the move.
+        if (!options.continuous && !homingBrake)
+        {
+            int end = position + pioQueuedSteps();
+            int room = direction ? maxSteps - end : end;
+            if (chunk > room)
+            {
+                chunk = room;
+                pioLimit = true;
+            }
+            if (chunk <= 0)
+            {
+                pioEntryValid = false;
+                continue;
+            }
+        }
+
+        // The PIO runs off the same system clock as the PWM
+        PioSegment segment = encodePioSegment(chunk, pioEntry.speed, PWM_CLOCK);
+
+        pioInFlight[(pioInFlightHead + pioInFlightCount) % 4] = direction ? chunk : -chunk;
+        pioInFlightCount++;
+
+        enableMotor();
+        speed = pioEntry.speed;
+        state = Running;
+
+        pio_sm_put(STEP_PIO, pioSm, segment.count);
+        pio_sm_put(STEP_PIO, pioSm, segment.delay);
+
+        pioEntry.steps -= chunk;
+        if (!pioEntry.steps || pioLimit)
+            pioEntryValid = false;
+    }
+}
+
+void Motor::pioStop()
+{
+    pio_sm_set_enabled(STEP_PIO, pioSm, false);
+    pio_sm_clear_fifos(STEP_PIO, pioSm);
+    pio_sm_restart(STEP_PIO, pioSm);
+    pio_sm_exec(STEP_PIO, pioSm, pio_encode_jmp(pioProgramOffset));
+    pio_sm_set_pins_with_mask(STEP_PIO, pioSm, 0, 1u << pins.step);
+    pio_sm_set_enabled(STEP_PIO, pioSm, true);
+
+    pioInFlightCount = 0;
+    pioEntryValid = false;
+    pioLimit = false;
+}
+
+void __not_in_flash_func(Motor::pioInterruptHandler)()
+{
+    for (int sm = 0 ; sm < 4 ; sm++)
+    {
+        if (pioMotors[sm] != nullptr && !pio_sm_is_rx_fifo_empty(STEP_PIO, sm))
+        {
+            pioMotors[sm]->handleSpecificPioInterrupt();
+            pioMotors[sm]->publishSnapshot();
+        }
+    }
+}
+
+void __not_in_flash_func(Motor::handleSpecificPioInterrupt)()
+{
+    while (!pio_sm_is_rx_fifo_empty(STEP_PIO, pioSm))
+    {
+        pio_sm_get(STEP_PIO, pioSm);
+
+        if (pioInFlightCount)
+        {
+            position += pioInFlight[pioInFlightHead];
+            pioInFlightHead = (pioInFlightHead + 1) % 4;
+            pioInFlightCount--;
+        }
+    }
+
+    if (options.endstop != -1 && !options.continuous)
+    {
+        if (!gpio_get(options.endstop))
+        {
+            // HALP! Hit endstop in normal run
+            recordEndstop();
+            pioStop();
+            state = Stopped;
+            position = 0;
+            return;
+        }
+    }
+
+    pioFeed();
+}
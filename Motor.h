@@ -5,7 +5,68 @@
 #define PILOMAR_MOTOR_H
 
 #include <pico/time.h>
-#include "list"
+#include <hardware/pwm.h>
+#include <hardware/timer.h>
+#include "Fixed.h"
+
+// Targets a motor can have queued up, including the one it is moving to
+#define TARGET_QUEUE 8
+
+// A plan starts with a reversal. Each queued target then needs up to an
+// overshoot, two S-curve ramps of five segments and a travelling segment,
+// and the plan finishes with the end marker.
+#define PLAN_SEGMENTS (2 + TARGET_QUEUE * 12)
+
+// Steps generated by the PIO backend without hearing from the CPU. This
+// bounds how stale the position can get while cruising.
+#define PIO_MAX_SEGMENT_STEPS 256
+
+// PWM register values are computed at plan time for this many plan
+// entries. Entries past that are computed as they are reached.
+#define PLAN_TIMINGS 160
+
+// Trajectory points a motor can hold, must be a power of two. Clients
+// append while it plays, /info tells them how many fit.
+#define TRAJECTORY_POINTS 64
+
+// Trajectory playback looks at the clock this often
+#define TRAJECTORY_TICK_MS 10
+
+// Smallest PWM clock divider, 1.0 in 8.4 format
+#define DIV_MIN ((0x01 << 4) + 0x0)
+
+// Timing of the step interrupts, for GET /stats. Compiled out it costs
+// nothing.
+#ifndef MOTOR_STATS
+#define MOTOR_STATS 0
+#endif
+
+// Endstop hits in normal running a motor remembers, older ones make way
+#define ENDSTOP_EVENTS 8
+
+// A plan segment that starts this much after its planned time is late
+#define PLAN_LATE_US 1000
+
+// Interrupt time histogram, each bucket twice as wide as the one before.
+// The last one takes everything longer.
+#define STATS_BUCKETS 8
+#define STATS_FIRST_BUCKET 256
+
+// An interrupt taken this many cycles after its wrap or alarm is late, 10 us
+#define STATS_LATE_CYCLES 1250
+
+enum Profile
+{
+    Trapezoid,          // Speed changes by SPEED_STEP every SPEED_STEP_PULSES
+    SCurve,             // Jerk limited ramps, needs Options.jerk
+    Linear              // Constant acceleration, needs Options.acceleration and the PWM backend
+};
+
+enum StepBackend
+{
+    PwmBackend,         // One PWM wrap interrupt per step
+    PioBackend          // PIO state machine, one interrupt per plan entry
+};
 
 struct Pins
 {
@@ -23,6 +84,68 @@ struct Options
     int endstop = -1;
     bool dirToEndstop = false;
     int microsteps = 8;
+    int jerk = 0;                           // S-curve change of the speed step per plan entry, Hz
+    int acceleration = 0;                   // Linear ramps, steps/s/s
+    int sCurveSpeedStep = 0;                // S-curve peak speed step, Hz, 0 for the trapezoid's
+    StepBackend backend = PwmBackend;       // Fixed at construction
+    int homingSpeed = 0;                    // Fast seek for the endstop, Hz, 0 to only approach slowly
+    int homingApproachSpeed = 0;            // Approach that sets zero, Hz, 0 for 250 * microsteps
+    int fullStepSpeed = 0;                  // Plans switch the drivers to full steps above this, Hz, 0 never
+    int startPosition = -1;                 // Known from before a restart, skips homing, -1 to home
+    bool continuous = false;                // Turns all the way round, positions wrap at a revolution
+};
+
+// Step interrupts of one kind, times in system clock cycles
+struct IsrStats
+{
+    uint32_t count;
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+    uint32_t histogram[STATS_BUCKETS];
+    uint32_t maxLatency;                    // From the wrap or alarm time to the handler
+    uint32_t late;                          // Latency over STATS_LATE_CYCLES
+    uint32_t missed;                        // Wraps that went by unhandled, alarm edges that were overdue
+};
+
+struct MotorStats
+{
+    IsrStats wrap;                          // PWM wrap, a step each
+    IsrStats alarm;                         // Step alarm below MIN_HZ, an edge each
+};
+
+struct EndstopEvent
+{
+    uint64_t time;                          // time_us_64() of the hit
+    int position;                           // Where the motor was counted to be
+    fixed_t speed;
+};
+
+// Each segment of a plan on the PWM is checked as it starts, against the
+// position and time it was planned for. Missed or extra steps show up as
+// a deviation, interrupts falling behind as lateness.
+struct PlanCheck
+{
+    uint32_t segments;                      // Segment starts checked
+    uint32_t deviations;                    // Off the position they were planned to start at
+    int maxDeviation;                       // Steps, either way
+    uint32_t late;                          // PLAN_LATE_US or more behind their planned time
+    int32_t maxLate;                        // Microseconds, negative if all were early
+    uint32_t endstopHits;                   // All of them, the last ENDSTOP_EVENTS are in endstops
+    EndstopEvent endstops[ENDSTOP_EVENTS];  // Ring, endstopHits % ENDSTOP_EVENTS is the next slot
+};
+
+// What a motor was doing as of its last step or change of motion
+struct MotorSnapshot
+{
+    int position;
+    fixed_t speed;                          // Microsteps a second
+    bool direction;                         // true while the position goes up
+    bool running;
+    bool homing;
+    bool homed;
+    uint64_t lastStep;                      // time_us_64() of the last step, 0 before the first
+    int64_t turns;                          // Whole revolutions, continuous axes only
 };
 
 class Motor
@@ -34,11 +157,37 @@ public:
     void setOptions(Options options);
     Options getOptions();
     void home();
-    void runToTarget(double targetSpeed, int target);
+    static void service();
+    void runToTarget(double targetSpeed, int target, Profile profile = Trapezoid);
+    bool queueTarget(double targetSpeed, int target, Profile profile = Trapezoid);
+    bool runAtVelocity(double rate, int timeoutMs = 0);
+    bool queueTrajectoryPoint(absolute_time_t time, int target, double velocity, bool hasVelocity);
+    void clearTrajectory();
+    [[nodiscard]] int trajectoryPoints() const;
+    [[nodiscard]] absolute_time_t trajectoryEnd() const;
+    [[nodiscard]] int trajectoryEndPosition() const;
+    [[nodiscard]] int queuedTargets() const;
+    static void runCoordinated(Motor *first, int firstTarget, Motor *second, int secondTarget, double targetSpeed,
+                               Profile profile = Trapezoid);
     bool isRunning();
+    [[nodiscard]] bool isIdle() const;
+    [[nodiscard]] bool canSlew() const;
+    [[nodiscard]] bool isHomed() const;
     void disableMotor() const;
     void setCurrentPosition(int position);
     [[nodiscard]] int getCurrentPosition() const;
+    [[nodiscard]] int64_t getTurns() const;
+    [[nodiscard]] int positionAt(absolute_time_t time) const;
+    [[nodiscard]] absolute_time_t arrivalTime() const;
+    static uint64_t snapshot(Motor *const motors[], MotorSnapshot snapshots[], int count);
+    [[nodiscard]] PlanCheck getPlanCheck() const;
+    void resetPlanCheck();
+    static void setAlarmPool(alarm_pool_t *pool);
+    static void setModePins(int m0, int m1, int m2);
+#if MOTOR_STATS
+    [[nodiscard]] MotorStats getStats() const;
+    void resetStats();
+#endif
 
 protected:
     unsigned sliceNumber;
@@ -54,45 +203,390 @@ private:
     };
 
     volatile State state = Stopped;         // State of motor
-    volatile double speed = 0;              // Current speed
+    volatile fixed_t speed = 0;             // Current speed
     volatile bool direction = false;        // Current direction
     volatile bool homed = false;            // true if motor has been homed
+    volatile bool homingSeek = false;       // Fast seek plan is running
+    volatile bool homingBrake = false;      // Slowing down past the endstop after the seek
+    volatile bool homingNext = false;       // The seek or brake ended in an interrupt, service() goes on
+    volatile bool finishNext = false;       // A move ended in an interrupt, service() calls back
     volatile int position = 0;              // Current absolute position
     volatile int stepsToGo = 0;             // Motor steps to go on this plan step
 
-    struct
+    // A plan is a short list of segments. Each segment expands into a
+    // number of plan entries, which are generated as the motor advances
+    // through the plan. Entry n (counting from 1) of a segment runs at
+    // speed + n * delta + n * (n - 1) / 2 * jerk, clamped to limit, for
+    // steps pulses. Entries that arrive at a standstill produce no pulses.
+    // A negative speed marks the end of the plan.
+    //
+    // A linear ramp has accel set instead and one step per entry. Entry n
+    // runs at sqrt(2 * accel * |index + n|), so index counts the steps from
+    // a standstill, negative while braking. The last entry is at limit.
+    struct Segment
+    {
+        fixed_t speed;                      // Speed before the first entry
+        fixed_t limit;                      // Speed the segment levels off at
+        fixed_t accel;                      // Linear ramps only, steps/s/s, 0 for the others
+        union
+        {
+            fixed_t delta;                  // Speed change for the first entry, 0 for constant speed
+            int index;                      // Linear ramps, steps from a standstill of the first entry
+        };
+        union
+        {
+            fixed_t jerk;                   // Change of delta per entry
+            uint32_t count;                 // Linear ramps, PWM counts of the first entry, see LINEAR_SHIFT
+        };
+        int entries;                        // Number of entries in the segment
+        int steps;                          // Motor steps per entry
+        int expectedPosition;               // Position at the start of the segment
+        int64_t start;                      // Microseconds into the plan, worked out as it starts
+        int16_t timings;                    // First entry in timings, -1 if none
+        uint16_t endTop;                    // Linear ramps, TOP of the last entry, 0 if not on the PWM
+        int8_t leg;                         // Target in targets the segment leads to
+        bool direction;
+    };
+    static_assert(sizeof(Segment) == 48, "Each motor keeps two plans of PLAN_SEGMENTS segments");
+
+    // Targets still to be reached, the first is the one the motor is moving
+    // to. Consecutive targets in the same direction are passed without
+    // stopping.
+    struct Target
     {
+        int position;
+        fixed_t speedLimit;
+        Profile profile;
+    } targets[TARGET_QUEUE] = {};
+    volatile int targetCount = 0;
+
+    struct PlanEntry
+    {
+        fixed_t speed;
         int steps;
-        double speed;
         bool direction;
-        int expectedPosition;
-    } plan[1024] = {};
-    int step = 0;
+        int timing;                         // Index into timings, -1 if not precomputed
+        uint16_t top;                       // Worked out on the way on linear ramps, 0 otherwise
+        int segment;                        // Segment this entry starts, -1 if not the first
+    };
+
+    struct PwmTiming
+    {
+        uint16_t top;
+        uint16_t div;                       // Clock divider in 1/16ths
+        uint16_t level;                     // Counts the step output is high
+    };
+
+    // The interrupts follow the active plan while a new one is built in
+    // the staged one. Building starts from a snapshot: the motor carries on
+    // at the speed it has, without looking at the active plan, and counts
+    // the steps it makes. startPlan() swaps the two in one critical
+    // section, and those steps come off the start of the new plan.
+    struct Plan
+    {
+        Segment segments[PLAN_SEGMENTS];
+        PwmTiming timings[PLAN_TIMINGS];
+        uint32_t div = DIV_MIN;             // Divider the timings use
+        uint32_t linearRate = 0;            // PWM counts per second with div
+        uint64_t startTime = 0;             // time_us_64() the motor was at the start position
+    } plans[2] = {};
+    Plan *active = &plans[0];
+    Plan *staged = &plans[1];
+    int step = 0;                           // Current segment of the active plan
+    int segmentEntry = 0;                   // Current entry within the segment
+    int planStart = 0;                      // Position the staged plan starts from
+    volatile bool planHeld = false;         // Snapshot taken, the PIO backend waits for the new plan
+
+    // All PWM entries of a plan share one divider. TOP and the compare
+    // level are double buffered by the PWM, so a speed change can be staged
+    // during the last pulse of an entry and take over exactly at the wrap
+    // that starts the next one. The divider is not buffered.
+    uint32_t pwmDiv = 0;                    // Divider the slice is running with
+    PlanEntry upcoming{};                   // Next entry, taken from the plan early
+    bool upcomingValid = false;
+    bool upcomingStaged = false;            // Its timing is waiting for the wrap
+
+    // Ramp of the plan being built. Coordinated moves stretch the move of
+    // the shorter axis in time by scaling both.
+    fixed_t rampStep = 0;                   // Speed change per ramp entry
+    int rampPulses = 1;                     // Motor steps per ramp entry
+    fixed_t rampAccel = 0;                  // Acceleration of linear ramps
+
+    // Linear ramps work out the period of each step from the one before
+    // while running, which takes a division instead of a square root
+    uint32_t linearCount = 0;               // Period of the current entry, see LINEAR_SHIFT
+    int linearIndex = 0;                    // Its steps from a standstill
+
+    bool holdStart = false;                 // Leave the slice disabled when starting
+    bool startPending = false;              // Slice was held and waits to be enabled
+
+    // The microstep mode pins are shared by all drivers. Fast plans switch
+    // them to full steps, so each pulse moves a whole step of microsteps
+    // at a fraction of the pulse rate. Positions stay in microsteps. The
+    // switch only happens with every stepping motor at a full step of the
+    // driver's indexer, which starts from one at the driver reset, and
+    // with no pulse of the old mode still uncounted. A pulse is counted on
+    // the mode it came out on. Any other motion needs microsteps, starting
+    // one drops back first.
+    static uint32_t modeMask;               // Mode pins, 0 if not set
+    static int modePins[3];
+    static int modeMicrosteps;              // Resolution the pins are at with modeShift 0
+    static volatile int modeShift;          // Microsteps per pulse as a shift, 0 normally
+    static volatile int fineHolds;          // Starts under way that need microsteps
+    volatile int indexer = 0;               // Microsteps moved since the driver reset
+    volatile int pulseShift = 0;            // modeShift the pulse not yet counted came out on
+    PwmTiming stagedTiming{};               // Last timing given to the slice, in microsteps
+
+    // Velocity mode runs at a signed rate in steps per second with 32
+    // fraction bits instead of following a plan. Each period is a whole
+    // number of PWM counts, or timer microseconds below MIN_HZ, and the
+    // remainder is carried over to the next one, so the average rate is
+    // exact. The rate changes by at most SPEED_STEP per SPEED_STEP_PULSES
+    // steps.
+    volatile bool velocityMode = false;
+    volatile int64_t velocityTarget = 0;    // Rate asked for
+    absolute_time_t velocityDeadline = nil_time; // Stop when reached, unless nil_time
+    uint64_t velocityRate = 0;              // Rate running at, direction holds the sign
+    uint64_t velocityPeriod = 0;            // Whole counts or microseconds per period
+    uint64_t velocityRemainder = 0;         // Fraction of a count per period, over velocityDivisor
+    uint64_t velocityDivisor = 0;
+    uint64_t velocityAccumulator = 0;
+    bool velocityOnTimer = false;           // Half step periods on velocityTimer, not the PWM
+    uint64_t velocityWait = 0;              // Microseconds to the next edge on the timer
+    repeating_timer_t velocityTimer{};
+    volatile bool velocityHold = false;     // Stop on reaching velocityHoldPosition at low speed
+    volatile int velocityHoldPosition = 0;
+
+    // Trajectory points to pass through at given times. Playback runs on
+    // trajectoryTimer and steers velocity mode along a cubic between the
+    // two points around the current time. Only queueTrajectoryPoint moves
+    // the tail and only playback moves the head.
+    struct TrajectoryPoint
+    {
+        uint64_t time;                      // Microseconds since boot
+        int position;
+        fixed_t velocity;                   // At the point, steps/s
+        bool hasVelocity;                   // Otherwise the line to the neighbour point is used
+    } trajectory[TRAJECTORY_POINTS] = {};
+    volatile uint32_t trajectoryHead = 0;
+    volatile uint32_t trajectoryTail = 0;
+    volatile bool trajectoryActive = false;
+    repeating_timer_t trajectoryTimer{};
 
     int microStepsPerRevolution;
     int maxSteps;
     Pins pins{};
     Options options;
 
-    static std::list<Motor *> instances;
+    // A continuous axis has no soft limits and position runs on past a
+    // revolution while it moves, so plans and targets stay in one frame.
+    // Whole turns are folded out into turns once it is idle. Targets are
+    // taken the short way round from where the motor is, or from the
+    // target queued before.
+    int64_t turns = 0;
+    void foldPosition();
+    [[nodiscard]] int wrapPosition(int raw) const;
+    [[nodiscard]] int64_t turnsOf(int raw) const;
+
+    static Motor *slices[NUM_PWM_SLICES];   // Motor driven by each PWM slice
 
     static bool initialized;
-    repeating_timer_t timerData{};
+    static alarm_pool_t *alarmPool;         // Timers fire on the core that created it
+
+    // Plan entries below MIN_HZ step on a hardware alarm of the motor's
+    // own. Each edge is due at an absolute time, half a period after the
+    // one before, so nothing drifts with the interrupt latency. Switching
+    // between the alarm and the PWM either way, the first step comes a
+    // period of the new speed after the last one.
+    static Motor *alarmMotors[NUM_TIMERS];  // Motor owning each hardware alarm
+    static uint32_t alarmMask;              // Alarms owned by motors
+    int stepAlarm = -1;
+    volatile bool onStepAlarm = false;
+    bool stepAlarmBusy = false;             // In the handler, which sets the alarm on its way out
+    bool stepAlarmLimit = false;            // Rising edge ran into a soft limit, stop at the falling one
+    uint64_t stepDue = 0;                   // Next edge, microseconds with FIXED_SHIFT fraction bits
+    uint64_t stepHalf = 0;                  // Half a period, same units
+
+    // Copy of the motion state for readers on core0, which can't read
+    // several fields of a running motor in one go. Core1 publishes it with
+    // its interrupts off, between two increments of the sequence. A reader
+    // copies it while the sequence is even and unchanged and tries again
+    // otherwise. One sequence for all motors makes a copy of several of
+    // them consistent as well.
+    //
+    // On the PWM it is only published when the rate, the direction or the
+    // state changes. The reader works out the steps made since from the
+    // rate.
+    struct Published
+    {
+        MotorSnapshot state;
+        int position;                       // Not wrapped, as counted at time
+        uint64_t time;                      // Microseconds with FIXED_SHIFT fraction bits
+        uint64_t rate;                      // Steps a second with 32 fraction bits, 0 if not stepping on the PWM
+        int stride;                         // Microsteps a step
+    };
+    static volatile uint32_t snapshotSequence;
+    Published published{};
+    bool publishPending = false;            // The PWM timing changed since the last publish
+
+    void publishSnapshot();
+    void publishWrap();
+    [[nodiscard]] uint64_t wrapTime() const;
+
+    PlanCheck planCheck{};
+
+    void checkSegmentStart(const PlanEntry &entry);
+    void recordEndstop();
+
+#if MOTOR_STATS
+    MotorStats stats{};
+    bool statsWrapValid = false;            // Wrap time below is from this run of the PWM
+    uint32_t statsWrapTime = 0;             // Microseconds, of the last wrap handled
+    uint32_t statsPeriod = 0;               // Cycles, of the period that wrap started
 
+    uint32_t statsWrapLatency();
+    static void statsRecord(IsrStats &isr, uint32_t start, uint32_t latency);
+    void statsRestart() { statsWrapValid = false; }
+#else
+    void statsRestart() {}
+#endif
+
+    // PIO backend. Entries are cut into chunks of at most
+    // PIO_MAX_SEGMENT_STEPS, queued in the state machine's TX FIFO.
+    // The position is updated as each chunk completes, and the endstop
+    // is only looked at between chunks.
+    static Motor *pioMotors[4];
+    static bool pioInitialized;
+    static unsigned pioProgramOffset;
+    int pioSm = -1;
+    bool pioEntryValid = false;             // Entry below is partially queued
+    PlanEntry pioEntry{};
+    bool pioLimit = false;                  // The queued chunks end at a limit, the rest of the plan is dropped
+    volatile int pioInFlight[4] = {};       // Signed steps of queued chunks
+    volatile int pioInFlightHead = 0;
+    volatile int pioInFlightCount = 0;
+
+    static alarm_pool_t *timerPool();
+    void homeSeek();
+    [[nodiscard]] fixed_t homingApproach() const;
     void setPwmMode() const;
+    void setPioMode() const;
     void setGpioMode() const;
     void enableMotor() const;
     void setDirection(bool forward);
-    [[nodiscard]] int motorSpeedStepDeltaSteps(int delta) const;
+    [[nodiscard]] int motorSpeedStepDeltaSteps(fixed_t delta) const;
+    void setRampScale(int pulses);
+    [[nodiscard]] fixed_t scaledSpeed(fixed_t unscaled) const;
+    [[nodiscard]] int clampTarget(int target, int from) const;
+    [[nodiscard]] int plannedStart() const;
+    bool planMove(fixed_t speedLimit, int target, Profile profile, int rampScale);
+    bool planTargets(int rampScale);
+    void dropPassedTargets();
+    void planJunctions(int startPosition, fixed_t entrySpeed, fixed_t *exits) const;
+    fixed_t planBlend(int &planStep, int &motorPosition, fixed_t newSpeed, fixed_t exitSpeed, const Target &target);
+    fixed_t planStop(int &planStep, int &motorPosition, fixed_t newSpeed, const Target &leg);
+    [[nodiscard]] Profile legProfile(const Target &target) const;
+    [[nodiscard]] int rampSteps(Profile profile, fixed_t fromSpeed, fixed_t toSpeed) const;
+    fixed_t planProfileRamp(Profile profile, int &planStep, int &motorPosition, fixed_t fromSpeed, fixed_t toSpeed,
+                            bool rampDirection);
+    void startPlan();
+    [[nodiscard]] int64_t planDuration() const;
+    [[nodiscard]] static int64_t segmentDuration(const Segment &segment, int entries, uint32_t div);
+    [[nodiscard]] static int64_t entryDuration(fixed_t entrySpeed, int steps, uint32_t div);
+    [[nodiscard]] static int64_t linearTime(fixed_t accel, int halfSteps);
+    [[nodiscard]] bool followingPlan() const;
+    fixed_t planRamp(int &planStep, int &motorPosition, fixed_t fromSpeed, fixed_t delta, fixed_t limit, bool rampDirection);
+    void planConstant(int &planStep, int &motorPosition, fixed_t constantSpeed, int steps, bool constantDirection);
+    void planEnd(int &planStep, int motorPosition);
+
+    // S-curve ramp: a constant entry up to the lowest speed if needed, a
+    // segment where the speed step grows by jerk per entry, a segment of
+    // constant speed steps, a segment where it shrinks again and a final
+    // entry below the lowest speed if needed
+    struct CurveLayout
+    {
+        fixed_t from;                       // Speed the jerk phases start at
+        fixed_t to;                         // Speed the jerk phases end at
+        fixed_t jerk;
+        fixed_t peak;                       // Largest speed step
+        fixed_t linearStep;                 // Speed step of the middle segment, at most peak
+        int jerkEntries;                    // Entries in each jerk phase
+        int linearEntries;
+        bool lead;                          // Constant entry at from first
+        bool trail;                         // Entry at the real target speed last
+    };
+    [[nodiscard]] CurveLayout curveLayout(fixed_t fromSpeed, fixed_t toSpeed) const;
+    [[nodiscard]] int curveSteps(fixed_t fromSpeed, fixed_t toSpeed) const;
+    bool rampMaxSpeed(Profile profile, fixed_t fromSpeed, int dist, fixed_t speedLimit, fixed_t &maxSpeed) const;
+    fixed_t planCurve(int &planStep, int &motorPosition, fixed_t fromSpeed, fixed_t toSpeed, bool curveDirection);
+    void planSegment(int &planStep, int &motorPosition, fixed_t fromSpeed, fixed_t delta, fixed_t jerk, fixed_t limit,
+                     int entries, bool segmentDirection);
+    static fixed_t linearSpeed(fixed_t accel, int index);
+    [[nodiscard]] int linearIndexOf(fixed_t atSpeed) const;
+    [[nodiscard]] fixed_t linearFloor() const;
+    [[nodiscard]] int linearSteps(fixed_t fromSpeed, fixed_t toSpeed) const;
+    fixed_t planLinear(int &planStep, int &motorPosition, fixed_t fromSpeed, fixed_t toSpeed, bool rampDirection);
+    void planTimings(int planSteps);
+    static fixed_t segmentEntrySpeed(const Segment &segment, int entry);
+    bool nextPlanEntry(PlanEntry &entry);
+    void finishPlan();
+    void finishMove();
     void motorSpeedStep();
-    void runStepper(double newSpeed, bool newDirection);
-    void setPwmFreq(float freq) const;
+    void runStepper(const PlanEntry &entry);
+    static uint32_t pwmDivFor(fixed_t freq);
+    static PwmTiming pwmTiming(fixed_t freq, uint32_t div);
+    [[nodiscard]] PwmTiming entryTiming(const PlanEntry &entry) const;
+    [[nodiscard]] bool canRetime(const PlanEntry &entry) const;
+    void applyPwmTiming(PwmTiming timing);
+    void stagePwmTiming(PwmTiming timing);
+    [[nodiscard]] PwmTiming modeTiming(PwmTiming timing) const;
+    [[nodiscard]] bool canTakeFullSteps() const;
+    [[nodiscard]] bool wantsFullSteps() const;
+    static void updateMode();
+    static void setMode(int shift);
+    static void holdMicrosteps();
+    static void releaseMicrosteps();
+    void stageUpcoming();
+    void setPwmFreq(fixed_t freq);
     bool performStep();
     static void interruptHandler();
     void handleSpecificInterrupt();
 
-    static bool alarmHandler(repeating_timer_t *t);
-    bool handleSpecificAlarm();
+    static void stepAlarmInterrupt();
+    static void stepAlarmHandler(uint alarm);
+    void handleStepAlarm();
+    void stepAlarmStart(fixed_t freq, uint64_t lastStep);
+    void stepAlarmRetime(fixed_t freq);
+    void stepAlarmStop();
+    void stepAlarmSet();
+    bool stepAlarmMissed();
+    [[nodiscard]] uint64_t lastStepTime() const;
+    [[nodiscard]] uint16_t pwmResumeCount(PwmTiming timing, uint64_t lastStep, bool pulseOut) const;
+
+    bool velocityRun(int64_t rate, int timeoutMs);
+    void velocityCheckDeadline();
+    uint64_t velocityNextRate();
+    bool velocityStep(bool onTimer);
+    bool velocitySetRate(uint64_t rate, bool onTimer);
+    bool velocityRetime();
+    uint64_t velocityInterval();
+    void velocityStop();
+    void velocityCancel();
+    static bool velocityAlarmHandler(repeating_timer_t *t);
+    bool handleVelocityAlarm(repeating_timer_t *t);
+
+    static void trajectorySample(const TrajectoryPoint &from, const TrajectoryPoint &to, uint64_t now,
+                                 int64_t &target, int64_t &rate);
+    void trajectoryCancel();
+    static bool trajectoryAlarmHandler(repeating_timer_t *t);
+    bool handleTrajectoryAlarm();
+
+    void initPio();
+    void pioFeed();
+    void pioStop();
+    [[nodiscard]] int pioQueuedSteps() const;
+    static void pioInterruptHandler();
+    void handleSpecificPioInterrupt();
 
 };
 
@@ -0,0 +1,46 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_PIOSEGMENT_H
+#define PILOMAR_PIOSEGMENT_H
+
+#include <cstdint>
+#include "Fixed.h"
+
+// Fixed cost of one step in the stepper PIO program, in PIO cycles
+#define PIO_STEP_OVERHEAD 5
+
+// The two words the stepper PIO program consumes for a run of steps at
+// constant speed. This has no SDK dependencies so it can be checked on
+// the host.
+struct PioSegment
+{
+    uint32_t count;                         // Steps minus one
+    uint32_t delay;                         // Loop count for each half step
+};
+
+inline PioSegment encodePioSegment(int steps, fixed_t speed, uint32_t clock)
+{
+    PioSegment segment{};
+
+    segment.count = (uint32_t)(steps - 1);
+
+    uint64_t period = ((uint64_t)clock << FIXED_SHIFT) / (uint32_t)speed;
+    if (period < PIO_STEP_OVERHEAD)
+        period = PIO_STEP_OVERHEAD;
+
+    uint64_t delay = (period - PIO_STEP_OVERHEAD) / 2;
+    if (delay > UINT32_MAX)
+        delay = UINT32_MAX;
+    segment.delay = (uint32_t)delay;
+
+    return segment;
+}
+
+// Step rate a segment actually runs at, for comparison with the request
+inline fixed_t decodePioSegmentSpeed(const PioSegment &segment, uint32_t clock)
+{
+    return (fixed_t)(((uint64_t)clock << FIXED_SHIFT) / (2 * (uint64_t)segment.delay + PIO_STEP_OVERHEAD));
+}
+
+#endif //PILOMAR_PIOSEGMENT_H
@@ -0,0 +1,137 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <cstddef>
+#include <cstring>
+#include <hardware/flash.h>
+#include <hardware/sync.h>
+#include <pico/multicore.h>
+#include "PositionLog.h"
+
+// Last sector of the flash, nothing else may be linked there
+#define POSITION_LOG_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#define POSITION_LOG_SLOTS (FLASH_SECTOR_SIZE / sizeof(Record))
+#define POSITION_LOG_MAGIC 0x506f5331
+
+int PositionLog::current = -1;
+uint32_t PositionLog::sequence = 0;
+bool PositionLog::clean = false;
+int32_t PositionLog::saved[POSITION_LOG_AXES] = {};
+
+bool PositionLog::load(int positions[POSITION_LOG_AXES])
+{
+    static_assert(FLASH_PAGE_SIZE % sizeof(Record) == 0, "Records must not cross a page");
+
+    // The log runs up to the last slot that isn't erased
+    current = -1;
+    for (int i = 0 ; i < (int)POSITION_LOG_SLOTS ; i++)
+    {
+        auto words = (const uint32_t *)slot(i);
+        for (unsigned j = 0 ; j < sizeof(Record) / sizeof(uint32_t) ; j++)
+        {
+            if (words[j] != 0xffffffff)
+            {
+                current = i;
+                break;
+            }
+        }
+    }
+
+    clean = false;
+    if (current == -1)
+        return false;
+
+    // A torn write leaves a bad check, that is a cold start
+    const Record *record = slot(current);
+    sequence = record->sequence;
+    if (record->magic != POSITION_LOG_MAGIC || record->check != checkOf(*record) || record->clean != 0xffffffff)
+        return false;
+
+    clean = true;
+    for (int i = 0 ; i < POSITION_LOG_AXES ; i++)
+        positions[i] = saved[i] = record->positions[i];
+
+    return true;
+}
+
+void PositionLog::markMoving()
+{
+    if (!clean)
+        return;
+
+    // Clearing bits needs no erase, the rest of the record is left as it is
+    Record stale;
+    memset(&stale, 0xff, sizeof(stale));
+    stale.clean = 0;
+
+    program(current, stale, false);
+    clean = false;
+}
+
+void PositionLog::save(const int positions[POSITION_LOG_AXES])
+{
+    Record record;
+    memset(&record, 0xff, sizeof(record));
+    record.magic = POSITION_LOG_MAGIC;
+    record.sequence = ++sequence;
+    for (int i = 0 ; i < POSITION_LOG_AXES ; i++)
+        record.positions[i] = saved[i] = positions[i];
+    record.check = checkOf(record);
+
+    // Back to the start of a full sector, only this erases
+    bool erase = current + 1 == (int)POSITION_LOG_SLOTS;
+    current = erase ? 0 : current + 1;
+    program(current, record, erase);
+    clean = true;
+}
+
+bool PositionLog::isSaved(const int positions[POSITION_LOG_AXES])
+{
+    if (!clean)
+        return false;
+
+    for (int i = 0 ; i < POSITION_LOG_AXES ; i++)
+    {
+        if (saved[i] != positions[i])
+            return false;
+    }
+
+    return true;
+}
+
+const PositionLog::Record *PositionLog::slot(int index)
+{
+    return (const Record *)(XIP_BASE + POSITION_LOG_OFFSET + index * sizeof(Record));
+}
+
+uint32_t PositionLog::checkOf(const Record &record)
+{
+    // FNV-1a over the words before the check
+    uint32_t check = 2166136261u;
+    auto words = (const uint32_t *)&record;
+    for (unsigned i = 0 ; i < offsetof(Record, check) / sizeof(uint32_t) ; i++)
+        check = (check ^ words[i]) * 16777619u;
+
+    return check;
+}
+
+void PositionLog::program(int index, const Record &record, bool erase)
+{
+    uint32_t offset = index * sizeof(Record);
+    uint8_t page[FLASH_PAGE_SIZE];
+
+    // Bytes left at 0xff don't change what is already in the page
+    memset(page, 0xff, sizeof(page));
+    memcpy(page + offset % FLASH_PAGE_SIZE, &record, sizeof(record));
+
+    // Core1 runs from flash too, it waits in RAM until this is done
+    multicore_lockout_start_blocking();
+    uint32_t interrupts = save_and_disable_interrupts();
+
+    if (erase)
+        flash_range_erase(POSITION_LOG_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(POSITION_LOG_OFFSET + offset - offset % FLASH_PAGE_SIZE, page, FLASH_PAGE_SIZE);
+
+    restore_interrupts(interrupts);
+    multicore_lockout_end_blocking();
+}
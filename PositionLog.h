@@ -0,0 +1,55 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_POSITIONLOG_H
+#define PILOMAR_POSITIONLOG_H
+
+#include <cstdint>
+
+// Axes kept in a record, stepper0 and stepper1
+#define POSITION_LOG_AXES 2
+
+// Positions of the axes, kept in flash so a restart can skip homing. Each
+// save appends a record to the sector, which is only erased once it is
+// full. A record is written clean while everything stands still and made
+// stale, by clearing its clean word in place, before anything moves again.
+// Only a clean last record is trusted at boot.
+//
+// Programming the flash stops XIP, so the writes park core1 and must only
+// happen while no motor is stepping. Called from core0 only.
+class PositionLog
+{
+public:
+    // Positions from the last record, false if the axes have to be homed
+    static bool load(int positions[POSITION_LOG_AXES]);
+
+    // Before anything starts moving, only writes if the last record is clean
+    static void markMoving();
+
+    // Everything has stopped, homed and with nothing left to run
+    static void save(const int positions[POSITION_LOG_AXES]);
+
+    [[nodiscard]] static bool isSaved(const int positions[POSITION_LOG_AXES]);
+
+private:
+    struct Record
+    {
+        uint32_t magic;
+        uint32_t sequence;
+        int32_t positions[POSITION_LOG_AXES];
+        uint32_t check;                     // Over everything above
+        uint32_t clean;                     // All ones when written, zero once stale
+        uint32_t spare[2];
+    };
+
+    static int current;                     // Slot of the last record, -1 if none
+    static uint32_t sequence;
+    static bool clean;
+    static int32_t saved[POSITION_LOG_AXES];
+
+    static const Record *slot(int index);
+    static uint32_t checkOf(const Record &record);
+    static void program(int index, const Record &record, bool erase);
+};
+
+#endif //PILOMAR_POSITIONLOG_H
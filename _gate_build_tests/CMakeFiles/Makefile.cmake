@@ -0,0 +1,70 @@
+# CMAKE generated file: DO NOT EDIT!
+# Generated by "Unix Makefiles" Generator, CMake Version 3.25
+
+# The generator used is:
+set(CMAKE_DEPENDS_GENERATOR "Unix Makefiles")
+
+# The top level Makefile was generated from the following files:
+set(CMAKE_MAKEFILE_DEPENDS
+  "CMakeCache.txt"
+  "CMakeFiles/3.25.1/CMakeCXXCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeSystem.cmake"
+  "/root/repo/tests/CMakeLists.txt"
+  "/usr/share/cmake-3.25/Modules/CMakeCXXInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCommonLanguageInclude.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeGenericSystem.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeInitializeConfigs.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeLanguageInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInitialize.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckCXXSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckIncludeFileCXX.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckLibraryExists.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/CMakeCommonCompilerMacros.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageHandleStandardArgs.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageMessage.cmake"
+  "/usr/share/cmake-3.25/Modules/FindThreads.cmake"
+  "/usr/share/cmake-3.25/Modules/Internal/CheckSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/UnixPaths.cmake"
+  )
+
+# The corresponding makefile is:
+set(CMAKE_MAKEFILE_OUTPUTS
+  "Makefile"
+  "CMakeFiles/cmake.check_cache"
+  )
+
+# Byproducts of CMake generate step:
+set(CMAKE_MAKEFILE_PRODUCTS
+  "CMakeFiles/CMakeDirectoryInformation.cmake"
+  )
+
+# Dependency information for all targets:
+set(CMAKE_DEPEND_INFO_FILES
+  "CMakeFiles/motor-host.dir/DependInfo.cmake"
+  "CMakeFiles/planner-test.dir/DependInfo.cmake"
+  "CMakeFiles/planner-bench.dir/DependInfo.cmake"
+  "CMakeFiles/pio-segment-test.dir/DependInfo.cmake"
+  "CMakeFiles/interrupt-test.dir/DependInfo.cmake"
+  "CMakeFiles/isr-bench.dir/DependInfo.cmake"
+  "CMakeFiles/pwm-timing-test.dir/DependInfo.cmake"
+  "CMakeFiles/scurve-test.dir/DependInfo.cmake"
+  "CMakeFiles/coordinated-test.dir/DependInfo.cmake"
+  "CMakeFiles/queue-test.dir/DependInfo.cmake"
+  "CMakeFiles/velocity-test.dir/DependInfo.cmake"
+  "CMakeFiles/trajectory-test.dir/DependInfo.cmake"
+  "CMakeFiles/mailbox-test.dir/DependInfo.cmake"
+  "CMakeFiles/homing-test.dir/DependInfo.cmake"
+  "CMakeFiles/position-log-test.dir/DependInfo.cmake"
+  "CMakeFiles/full-step-test.dir/DependInfo.cmake"
+  "CMakeFiles/linear-test.dir/DependInfo.cmake"
+  "CMakeFiles/prediction-test.dir/DependInfo.cmake"
+  "CMakeFiles/plan-check-test.dir/DependInfo.cmake"
+  "CMakeFiles/continuous-test.dir/DependInfo.cmake"
+  "CMakeFiles/snapshot-test.dir/DependInfo.cmake"
+  )
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/continuous-test.dir/ContinuousTest.cpp.o"
+  "CMakeFiles/continuous-test.dir/ContinuousTest.cpp.o.d"
+  "continuous-test"
+  "continuous-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/continuous-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
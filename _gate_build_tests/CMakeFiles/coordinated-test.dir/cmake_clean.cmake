@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/coordinated-test.dir/CoordinatedTest.cpp.o"
+  "CMakeFiles/coordinated-test.dir/CoordinatedTest.cpp.o.d"
+  "coordinated-test"
+  "coordinated-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/coordinated-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/full-step-test.dir/FullStepTest.cpp.o"
+  "CMakeFiles/full-step-test.dir/FullStepTest.cpp.o.d"
+  "full-step-test"
+  "full-step-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/full-step-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
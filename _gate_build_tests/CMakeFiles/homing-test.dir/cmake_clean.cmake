@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/homing-test.dir/HomingTest.cpp.o"
+  "CMakeFiles/homing-test.dir/HomingTest.cpp.o.d"
+  "homing-test"
+  "homing-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/homing-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
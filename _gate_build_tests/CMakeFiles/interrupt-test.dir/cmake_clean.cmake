@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/interrupt-test.dir/InterruptTest.cpp.o"
+  "CMakeFiles/interrupt-test.dir/InterruptTest.cpp.o.d"
+  "interrupt-test"
+  "interrupt-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/interrupt-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
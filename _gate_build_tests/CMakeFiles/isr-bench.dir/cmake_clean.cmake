@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/isr-bench.dir/IsrBench.cpp.o"
+  "CMakeFiles/isr-bench.dir/IsrBench.cpp.o.d"
+  "isr-bench"
+  "isr-bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/isr-bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
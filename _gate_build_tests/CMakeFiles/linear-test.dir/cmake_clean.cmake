@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/linear-test.dir/LinearTest.cpp.o"
+  "CMakeFiles/linear-test.dir/LinearTest.cpp.o.d"
+  "linear-test"
+  "linear-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/linear-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/mailbox-test.dir/MailboxTest.cpp.o"
+  "CMakeFiles/mailbox-test.dir/MailboxTest.cpp.o.d"
+  "mailbox-test"
+  "mailbox-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/mailbox-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
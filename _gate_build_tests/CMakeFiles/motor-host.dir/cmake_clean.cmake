@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/motor-host.dir/root/repo/Motor.cpp.o"
+  "CMakeFiles/motor-host.dir/root/repo/Motor.cpp.o.d"
+  "CMakeFiles/motor-host.dir/stubs/HostSim.cpp.o"
+  "CMakeFiles/motor-host.dir/stubs/HostSim.cpp.o.d"
+  "libmotor-host.a"
+  "libmotor-host.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/motor-host.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/pio-segment-test.dir/PioSegmentTest.cpp.o"
+  "CMakeFiles/pio-segment-test.dir/PioSegmentTest.cpp.o.d"
+  "CMakeFiles/pio-segment-test.dir/ReferencePlanner.cpp.o"
+  "CMakeFiles/pio-segment-test.dir/ReferencePlanner.cpp.o.d"
+  "pio-segment-test"
+  "pio-segment-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/pio-segment-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/plan-check-test.dir/PlanCheckTest.cpp.o"
+  "CMakeFiles/plan-check-test.dir/PlanCheckTest.cpp.o.d"
+  "plan-check-test"
+  "plan-check-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/plan-check-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/planner-bench.dir/PlannerBench.cpp.o"
+  "CMakeFiles/planner-bench.dir/PlannerBench.cpp.o.d"
+  "CMakeFiles/planner-bench.dir/ReferencePlanner.cpp.o"
+  "CMakeFiles/planner-bench.dir/ReferencePlanner.cpp.o.d"
+  "planner-bench"
+  "planner-bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/planner-bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/planner-test.dir/PlannerTest.cpp.o"
+  "CMakeFiles/planner-test.dir/PlannerTest.cpp.o.d"
+  "CMakeFiles/planner-test.dir/ReferencePlanner.cpp.o"
+  "CMakeFiles/planner-test.dir/ReferencePlanner.cpp.o.d"
+  "planner-test"
+  "planner-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/planner-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/position-log-test.dir/PositionLogTest.cpp.o"
+  "CMakeFiles/position-log-test.dir/PositionLogTest.cpp.o.d"
+  "CMakeFiles/position-log-test.dir/root/repo/PositionLog.cpp.o"
+  "CMakeFiles/position-log-test.dir/root/repo/PositionLog.cpp.o.d"
+  "position-log-test"
+  "position-log-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/position-log-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/prediction-test.dir/PredictionTest.cpp.o"
+  "CMakeFiles/prediction-test.dir/PredictionTest.cpp.o.d"
+  "prediction-test"
+  "prediction-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/prediction-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,21 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/tests/PwmTimingTest.cpp" "CMakeFiles/pwm-timing-test.dir/PwmTimingTest.cpp.o" "gcc" "CMakeFiles/pwm-timing-test.dir/PwmTimingTest.cpp.o.d"
+  "/root/repo/tests/ReferencePlanner.cpp" "CMakeFiles/pwm-timing-test.dir/ReferencePlanner.cpp.o" "gcc" "CMakeFiles/pwm-timing-test.dir/ReferencePlanner.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_gate_build_tests/CMakeFiles/motor-host.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/pwm-timing-test.dir/PwmTimingTest.cpp.o"
+  "CMakeFiles/pwm-timing-test.dir/PwmTimingTest.cpp.o.d"
+  "CMakeFiles/pwm-timing-test.dir/ReferencePlanner.cpp.o"
+  "CMakeFiles/pwm-timing-test.dir/ReferencePlanner.cpp.o.d"
+  "pwm-timing-test"
+  "pwm-timing-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/pwm-timing-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
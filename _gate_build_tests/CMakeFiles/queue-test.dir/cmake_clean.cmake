@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/queue-test.dir/QueueTest.cpp.o"
+  "CMakeFiles/queue-test.dir/QueueTest.cpp.o.d"
+  "queue-test"
+  "queue-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/queue-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/scurve-test.dir/SCurveTest.cpp.o"
+  "CMakeFiles/scurve-test.dir/SCurveTest.cpp.o.d"
+  "scurve-test"
+  "scurve-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/scurve-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
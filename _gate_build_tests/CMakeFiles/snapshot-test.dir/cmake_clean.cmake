@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/snapshot-test.dir/SnapshotTest.cpp.o"
+  "CMakeFiles/snapshot-test.dir/SnapshotTest.cpp.o.d"
+  "snapshot-test"
+  "snapshot-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/snapshot-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/trajectory-test.dir/TrajectoryTest.cpp.o"
+  "CMakeFiles/trajectory-test.dir/TrajectoryTest.cpp.o.d"
+  "trajectory-test"
+  "trajectory-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/trajectory-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/velocity-test.dir/VelocityTest.cpp.o"
+  "CMakeFiles/velocity-test.dir/VelocityTest.cpp.o.d"
+  "velocity-test"
+  "velocity-test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/velocity-test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
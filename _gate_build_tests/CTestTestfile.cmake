@@ -0,0 +1,42 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/tests
+# Build directory: /root/repo/_gate_build_tests
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(planner "/root/repo/_gate_build_tests/planner-test")
+set_tests_properties(planner PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;34;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(pio-segment "/root/repo/_gate_build_tests/pio-segment-test")
+set_tests_properties(pio-segment PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;42;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(interrupt "/root/repo/_gate_build_tests/interrupt-test")
+set_tests_properties(interrupt PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;46;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(pwm-timing "/root/repo/_gate_build_tests/pwm-timing-test")
+set_tests_properties(pwm-timing PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;53;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(scurve "/root/repo/_gate_build_tests/scurve-test")
+set_tests_properties(scurve PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;57;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(coordinated "/root/repo/_gate_build_tests/coordinated-test")
+set_tests_properties(coordinated PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;61;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(queue "/root/repo/_gate_build_tests/queue-test")
+set_tests_properties(queue PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;65;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(velocity "/root/repo/_gate_build_tests/velocity-test")
+set_tests_properties(velocity PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;69;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(trajectory "/root/repo/_gate_build_tests/trajectory-test")
+set_tests_properties(trajectory PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;73;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(mailbox "/root/repo/_gate_build_tests/mailbox-test")
+set_tests_properties(mailbox PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;79;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(homing "/root/repo/_gate_build_tests/homing-test")
+set_tests_properties(homing PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;83;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(position-log "/root/repo/_gate_build_tests/position-log-test")
+set_tests_properties(position-log PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;87;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(full-step "/root/repo/_gate_build_tests/full-step-test")
+set_tests_properties(full-step PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;91;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(linear "/root/repo/_gate_build_tests/linear-test")
+set_tests_properties(linear PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;95;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(prediction "/root/repo/_gate_build_tests/prediction-test")
+set_tests_properties(prediction PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;99;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(plan-check "/root/repo/_gate_build_tests/plan-check-test")
+set_tests_properties(plan-check PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;103;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(continuous "/root/repo/_gate_build_tests/continuous-test")
+set_tests_properties(continuous PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;107;add_test;/root/repo/tests/CMakeLists.txt;0;")
+add_test(snapshot "/root/repo/_gate_build_tests/snapshot-test")
+set_tests_properties(snapshot PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/tests/CMakeLists.txt;111;add_test;/root/repo/tests/CMakeLists.txt;0;")
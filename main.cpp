@@ -2,13 +2,17 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
 #include <cstdio>
+#include <cstdlib>
 #include <pico/time.h>
 #include <hardware/gpio.h>
 #include <vector>
 #include <pico/stdlib.h>
 #include <hardware/flash.h>
+#include <hardware/clocks.h>
 #include "pico/stdio.h"
 #include "Motor.h"
+#include "Motion.h"
+#include "PositionLog.h"
 #include "tusb.h"
 #include "tusb_lwip_glue.h"
 #include "webserver/WebServer-lwip.h"
@@ -47,15 +51,33 @@
 #define AZIMUTH_MAX_SPEED 8000
 #define AZIMUTH_STEPS_PER_REVOLUTION 384000
 #define AZIMUTH_MAX_STEPS 384000 //373334
+#define AZIMUTH_JERK 64 // S-curve, Hz per plan entry, the peak stays at SPEED_STEP
+#define AZIMUTH_ACCELERATION 24000 // Linear profile, steps/s/s
+#define AZIMUTH_FULL_STEP_SPEED 4000 // Above this planned moves run on full steps
+#define AZIMUTH_SLEW_SPEED 24000 // Planned moves only, on full steps
+// 1 lets the azimuth turn all the way round, moves and trajectories take the
+// short way across north. Only for a mount whose cabling can wind up without
+// limit, e.g. through a slip ring. Build with -DAZIMUTH_CONTINUOUS=1 or set it here.
+#ifndef AZIMUTH_CONTINUOUS
+#define AZIMUTH_CONTINUOUS 0
+#endif
 
 #define ELEVATION_MAX_SPEED 8000
 #define ELEVATION_STEPS_PER_REVOLUTION 384000
 #define ELEVATION_MAX_STEPS 120000
 #define ELEVATION_ZERO_POINT 22500
+#define ELEVATION_JERK 64
+#define ELEVATION_ACCELERATION 24000
+#define ELEVATION_HOMING_SPEED 4000 // Runs about 640 steps past the endstop before it stops
+#define ELEVATION_FULL_STEP_SPEED 4000
+#define ELEVATION_SLEW_SPEED 24000
 
 #define DOOR_MAX_STEPS 2125
 #define DOOR_MAX_SPEED 400
 
+// Saved positions are written once everything has stood still this long
+#define POSITION_SAVE_DELAY_MS 2000
+
 using namespace nlohmann;
 
 uint8_t macaddr[6];
@@ -65,6 +87,17 @@ uint8_t tud_network_mac_address[6];
 Motor *stepper0;
 Motor *stepper1;
 
+absolute_time_t trajectoryStart = nil_time;
+
+// Everything that can start a motor goes through here, so the saved
+// position is stale before the first step
+template <typename Function>
+static bool moveMotors(Function &&function)
+{
+    PositionLog::markMoving();
+    return Motion::call(function);
+}
+
 WebServerLwip webserver;
 
 class PilomarApi
@@ -73,7 +106,16 @@ public:
     static void Init()
     {
         UrlMapper::AddMapping("GET", "/info", &info);
+        UrlMapper::AddMapping("GET", "/position", &position);
+        UrlMapper::AddMapping("GET", "/checks", &checks);
+#if MOTOR_STATS
+        UrlMapper::AddMapping("GET", "/stats", &stats);
+#endif
         UrlMapper::AddMapping("POST", "/move", &move);
+#if MODE == MODE_CAMERA
+        UrlMapper::AddMapping("POST", "/velocity", &velocity);
+        UrlMapper::AddMapping("POST", "/trajectory", &trajectory);
+#endif
     }
 private:
 #if MODE == MODE_DOOR
@@ -86,6 +128,12 @@ private:
             return;
         }
 
+        if (!stepper0->isHomed() || !stepper1->isHomed())
+        {
+            response.setStatusCode(HttpStatus::Code::Conflict);
+            return;
+        }
+
         if (stepper0->isRunning() || stepper1->isRunning())
         {
             response.setStatusCode(HttpStatus::Code::PreconditionFailed);
@@ -93,6 +141,7 @@ private:
         }
 
         auto mode = payload.value<std::string>("mode", "move");
+        absolute_time_t arrival = nil_time;
 
         if (mode == "move")
         {
@@ -104,15 +153,23 @@ private:
                 response.setStatusCode(HttpStatus::Code::BadRequest);
                 return;
             }
-            stepper0->runToTarget(speed, position);
-            stepper1->runToTarget(speed, position);
+            moveMotors([&] {
+                stepper0->runToTarget(speed, position);
+                stepper1->runToTarget(speed, position);
+                arrival = latest(stepper0->arrivalTime(), stepper1->arrivalTime());
+                return true;
+            });
         }
         else if (mode == "learn")
         {
-            stepper0->setCurrentPosition(DOOR_MAX_STEPS);
-            stepper1->setCurrentPosition(DOOR_MAX_STEPS);
-            stepper0->runToTarget(DOOR_MAX_SPEED, 0);
-            stepper1->runToTarget(DOOR_MAX_SPEED, 0);
+            moveMotors([&] {
+                stepper0->setCurrentPosition(DOOR_MAX_STEPS);
+                stepper1->setCurrentPosition(DOOR_MAX_STEPS);
+                stepper0->runToTarget(DOOR_MAX_SPEED, 0);
+                stepper1->runToTarget(DOOR_MAX_SPEED, 0);
+                arrival = latest(stepper0->arrivalTime(), stepper1->arrivalTime());
+                return true;
+            });
         }
         else
         {
@@ -122,7 +179,8 @@ private:
 
         response.setBody(
                 json{
-                    {"result", "ok"}
+                    {"result", "ok"},
+                    {"arrival_us", timeJson(arrival)}
                 }.dump()
             );
     }
@@ -138,6 +196,13 @@ private:
             return;
         }
 
+        // Both axes in one request, they arrive together
+        if (!payload.contains("motor"))
+        {
+            moveBoth(payload, response);
+            return;
+        }
+
         auto motor = payload.value<std::string>("motor", "");
         Motor *m = nullptr;
         if (motor == "azimuth")
@@ -151,6 +216,13 @@ private:
             return;
         }
 
+        // Moves wait for homing to finish
+        if (!m->isHomed())
+        {
+            response.setStatusCode(HttpStatus::Code::Conflict);
+            return;
+        }
+
 //        if (m->isRunning())
 //        {
 //            response.setStatusCode(HttpStatus::Code::PreconditionFailed);
@@ -158,18 +230,148 @@ private:
 //        }
 
         int maxSpeed = motor == "elevation" ? ELEVATION_MAX_SPEED : AZIMUTH_MAX_SPEED;
+        int slewSpeed = motor == "elevation" ? ELEVATION_SLEW_SPEED : AZIMUTH_SLEW_SPEED;
         int maxSteps = motor == "elevation" ? ELEVATION_MAX_STEPS : AZIMUTH_MAX_STEPS;
 
         int position = payload.value("position", -1);
         auto speed = payload.value<double>("speed", (double)maxSpeed);
+        auto profile = payload.value<std::string>("profile", "trapezoid");
+        auto mode = payload.value<std::string>("mode", "replace");
+
+        if (position < 0 || position > maxSteps || speed < 0.0001 || speed > slewSpeed ||
+            (profile != "trapezoid" && profile != "scurve" && profile != "linear") || (mode != "replace" && mode != "queued"))
+        {
+            response.setStatusCode(HttpStatus::Code::BadRequest);
+            return;
+        }
+
+        // Past the max speed only on full steps, which the drivers can't
+        // always switch to
+        if (!m->canSlew())
+            speed = std::min(speed, (double)maxSpeed);
+
+        auto shape = profile == "scurve" ? SCurve : profile == "linear" ? Linear : Trapezoid;
+        absolute_time_t arrival = nil_time;
+
+        if (mode == "queued")
+        {
+            // Passes through the targets before it without stopping if it can
+            if (!moveMotors([&] {
+                    if (!m->queueTarget(speed, position, shape))
+                        return false;
+                    arrival = m->arrivalTime();
+                    return true;
+                }))
+            {
+                response.setStatusCode(HttpStatus::Code::ServiceUnavailable);
+                return;
+            }
+        }
+        else
+        {
+            moveMotors([&] {
+                m->runToTarget(speed, position, shape);
+                arrival = m->arrivalTime();
+                return true;
+            });
+        }
+
+        response.setBody(
+            json{
+                {"result", "ok"},
+                {"queued", m->queuedTargets()},
+                {"arrival_us", timeJson(arrival)}
+            }.dump()
+        );
+    }
+
+    static void moveBoth(const json& payload, HttpResponse& response)
+    {
+        int maxSpeed = std::min(AZIMUTH_MAX_SPEED, ELEVATION_MAX_SPEED);
+        int slewSpeed = std::min(AZIMUTH_SLEW_SPEED, ELEVATION_SLEW_SPEED);
+
+        int azimuth = payload.value("azimuth", -1);
+        int elevation = payload.value("elevation", -1);
+        auto speed = payload.value<double>("speed", (double)maxSpeed);
+        auto profile = payload.value<std::string>("profile", "trapezoid");
+        auto mode = payload.value<std::string>("mode", "replace");
 
-        if (position < 0 || position > maxSteps || speed < 0.0001 || speed > maxSpeed)
+        // Coordinated moves always replace what the axes are doing
+        if (azimuth < 0 || azimuth > AZIMUTH_MAX_STEPS || elevation < 0 || elevation > ELEVATION_MAX_STEPS ||
+            speed < 0.0001 || speed > slewSpeed || (profile != "trapezoid" && profile != "scurve" && profile != "linear") ||
+            mode != "replace")
         {
             response.setStatusCode(HttpStatus::Code::BadRequest);
             return;
         }
 
-        m->runToTarget(speed, position);
+        if (!stepper0->isHomed() || !stepper1->isHomed())
+        {
+            response.setStatusCode(HttpStatus::Code::Conflict);
+            return;
+        }
+
+        if (!stepper0->canSlew() || !stepper1->canSlew())
+            speed = std::min(speed, (double)maxSpeed);
+
+        // Speed is that of the axis with the longer way to go
+        absolute_time_t arrival = nil_time;
+        moveMotors([&] {
+            Motor::runCoordinated(stepper1, azimuth, stepper0, elevation, speed,
+                                  profile == "scurve" ? SCurve : profile == "linear" ? Linear : Trapezoid);
+            arrival = latest(stepper0->arrivalTime(), stepper1->arrivalTime());
+            return true;
+        });
+
+        response.setBody(
+            json{
+                {"result", "ok"},
+                {"arrival_us", timeJson(arrival)}
+            }.dump()
+        );
+    }
+
+    // Tracking and jogging. Rate is in steps per second and may be fractional,
+    // negative runs towards 0. With a timeout in ms the motor stops unless
+    // the request is repeated in time.
+    static void velocity(const HttpRequest& request, HttpResponse& response)
+    {
+        auto payload = json::parse(request.body(), nullptr, false);
+        if (payload.is_discarded())
+        {
+            response.setStatusCode(HttpStatus::Code::BadRequest);
+            return;
+        }
+
+        auto motor = payload.value<std::string>("motor", "");
+        Motor *m = nullptr;
+        if (motor == "azimuth")
+            m = stepper1;
+        else if (motor == "elevation")
+            m = stepper0;
+
+        int maxSpeed = motor == "elevation" ? ELEVATION_MAX_SPEED : AZIMUTH_MAX_SPEED;
+
+        auto rate = payload.value<double>("rate", 0.0);
+        int timeout = payload.value("timeout", 0);
+
+        if (!m || rate < -maxSpeed || rate > maxSpeed || timeout < 0)
+        {
+            response.setStatusCode(HttpStatus::Code::BadRequest);
+            return;
+        }
+
+        if (!m->isHomed())
+        {
+            response.setStatusCode(HttpStatus::Code::Conflict);
+            return;
+        }
+
+        if (!moveMotors([&] { return m->runAtVelocity(rate, timeout); }))
+        {
+            response.setStatusCode(HttpStatus::Code::PreconditionFailed);
+            return;
+        }
 
         response.setBody(
             json{
@@ -177,32 +379,381 @@ private:
             }.dump()
         );
     }
+
+    // A continuous azimuth takes any position, it is the same place every
+    // revolution
+    static int normaliseAzimuth(int azimuth)
+    {
+        if (!AZIMUTH_CONTINUOUS)
+            return azimuth;
+
+        azimuth %= AZIMUTH_STEPS_PER_REVOLUTION;
+        return azimuth < 0 ? azimuth + AZIMUTH_STEPS_PER_REVOLUTION : azimuth;
+    }
+
+    // Steps from one azimuth to the next, the short way round if continuous
+    static int azimuthDistance(int from, int to)
+    {
+        if (!AZIMUTH_CONTINUOUS)
+            return to - from;
+
+        int ahead = normaliseAzimuth(to - from);
+        return ahead > AZIMUTH_STEPS_PER_REVOLUTION / 2 ? ahead - AZIMUTH_STEPS_PER_REVOLUTION : ahead;
+    }
+
+    // Points are [time, azimuth, elevation] or [time, azimuth, elevation,
+    // azimuth velocity, elevation velocity], time in ms since the trajectory
+    // started, velocities in steps/s. The motors interpolate between them on
+    // their own clock. "append" adds to the end while it plays, "replace"
+    // starts a new trajectory at time 0 now.
+    static void trajectory(const HttpRequest& request, HttpResponse& response)
+    {
+        auto payload = json::parse(request.body(), nullptr, false);
+        if (payload.is_discarded() || !payload.contains("points") || !payload["points"].is_array())
+        {
+            response.setStatusCode(HttpStatus::Code::BadRequest);
+            return;
+        }
+
+        auto mode = payload.value<std::string>("mode", "append");
+        if (mode != "append" && mode != "replace")
+        {
+            response.setStatusCode(HttpStatus::Code::BadRequest);
+            return;
+        }
+
+        bool replace = mode == "replace" || is_nil_time(trajectoryStart);
+        const auto& points = payload["points"];
+
+        // Check everything first, a batch is taken whole or not at all
+        double last = -1.0;
+        int lastAzimuth = -1;
+        int lastElevation = -1;
+        if (!replace && !is_nil_time(stepper1->trajectoryEnd()))
+        {
+            // Appended points go on from the last queued one
+            last = (double)absolute_time_diff_us(trajectoryStart, stepper1->trajectoryEnd()) / 1000.0;
+            lastAzimuth = stepper1->trajectoryEndPosition();
+            lastElevation = stepper0->trajectoryEndPosition();
+        }
+
+        for (const auto& point : points)
+        {
+            if (!point.is_array() || (point.size() != 3 && point.size() != 5) ||
+                !std::all_of(point.begin(), point.end(), [](const json& v) { return v.is_number(); }))
+            {
+                response.setStatusCode(HttpStatus::Code::BadRequest);
+                return;
+            }
+
+            auto time = point[0].get<double>();
+            auto azimuth = normaliseAzimuth(point[1].get<int>());
+            auto elevation = point[2].get<int>();
+            auto azimuthVelocity = point.size() == 5 ? point[3].get<double>() : 0.0;
+            auto elevationVelocity = point.size() == 5 ? point[4].get<double>() : 0.0;
+
+            // Straight lines between the points must be possible
+            bool tooFast = lastAzimuth >= 0 &&
+                           (std::abs(azimuthDistance(lastAzimuth, azimuth)) > (time - last) * AZIMUTH_MAX_SPEED / 1000.0 ||
+                            std::abs(elevation - lastElevation) > (time - last) * ELEVATION_MAX_SPEED / 1000.0);
+
+            if (time < 0 || time <= last || azimuth < 0 || azimuth > AZIMUTH_MAX_STEPS || elevation < 0 ||
+                elevation > ELEVATION_MAX_STEPS || std::abs(azimuthVelocity) > AZIMUTH_MAX_SPEED ||
+                std::abs(elevationVelocity) > ELEVATION_MAX_SPEED || tooFast)
+            {
+                response.setStatusCode(HttpStatus::Code::BadRequest);
+                return;
+            }
+
+            last = time;
+            lastAzimuth = azimuth;
+            lastElevation = elevation;
+        }
+
+        if (!stepper0->isHomed() || !stepper1->isHomed())
+        {
+            response.setStatusCode(HttpStatus::Code::Conflict);
+            return;
+        }
+
+        int space = TRAJECTORY_POINTS;
+        if (!replace)
+            space -= std::max(stepper1->trajectoryPoints(), stepper0->trajectoryPoints());
+
+        if ((int)points.size() > space)
+        {
+            response.setStatusCode(HttpStatus::Code::ServiceUnavailable);
+            return;
+        }
+
+        if (replace)
+            trajectoryStart = get_absolute_time();
+
+        // The whole batch in one go, core1 reads the points straight from the request.
+        // If an axis refuses a point both are cleared, not left out of step.
+        if (!moveMotors([&] {
+                if (replace)
+                {
+                    stepper1->clearTrajectory();
+                    stepper0->clearTrajectory();
+                }
+
+                for (const auto& point : points)
+                {
+                    auto time = delayed_by_us(trajectoryStart, (uint64_t)(point[0].get<double>() * 1000.0));
+                    bool hasVelocity = point.size() == 5;
+
+                    if (!stepper1->queueTrajectoryPoint(time, normaliseAzimuth(point[1].get<int>()), hasVelocity ? point[3].get<double>() : 0.0, hasVelocity) ||
+                        !stepper0->queueTrajectoryPoint(time, point[2].get<int>(), hasVelocity ? point[4].get<double>() : 0.0, hasVelocity))
+                    {
+                        stepper1->clearTrajectory();
+                        stepper0->clearTrajectory();
+                        return false;
+                    }
+                }
+                return true;
+            }))
+        {
+            response.setStatusCode(HttpStatus::Code::ServiceUnavailable);
+            return;
+        }
+
+        response.setBody(
+            json{
+                {"result", "ok"},
+                {"time", (double)absolute_time_diff_us(trajectoryStart, get_absolute_time()) / 1000.0},
+                {"queued", stepper1->trajectoryPoints()}
+            }.dump()
+        );
+    }
 #pragma clang diagnostic pop
 #endif
+    // Times go out in microseconds on the clock of /info, null if unknown
+    static json timeJson(absolute_time_t time)
+    {
+        if (is_nil_time(time))
+            return nullptr;
+        return to_us_since_boot(time);
+    }
+
+    static absolute_time_t latest(absolute_time_t first, absolute_time_t second)
+    {
+        if (is_nil_time(first) || is_nil_time(second))
+            return nil_time;
+        return to_us_since_boot(first) > to_us_since_boot(second) ? first : second;
+    }
+
+    // Where the axes are going to be at time_us, and when they arrive,
+    // from the moves they are running. Nothing has to step to find out.
+    static void position(const HttpRequest& request, HttpResponse& response)
+    {
+        auto param = request.param("time_us");
+        char *end = nullptr;
+        uint64_t time = param ? strtoull(param->c_str(), &end, 10) : 0;
+        if (!param || end == param->c_str() || *end != '\0')
+        {
+            response.setStatusCode(HttpStatus::Code::BadRequest);
+            return;
+        }
+
+        int position0 = 0, position1 = 0;
+        absolute_time_t arrival0 = nil_time, arrival1 = nil_time;
+        Motion::call([&] {
+            position0 = stepper0->positionAt(from_us_since_boot(time));
+            position1 = stepper1->positionAt(from_us_since_boot(time));
+            arrival0 = stepper0->arrivalTime();
+            arrival1 = stepper1->arrivalTime();
+            return true;
+        });
+
+        response.setBody(
+            json{
+                {"time_us", time},
+#if MODE == MODE_DOOR
+                {"position_left", position0},
+                {"position_right", position1},
+                {"arrival_left_us", timeJson(arrival0)},
+                {"arrival_right_us", timeJson(arrival1)}
+#elif MODE == MODE_CAMERA
+                {"azimuth", position1},
+                {"elevation", position0},
+                {"arrival_azimuth_us", timeJson(arrival1)},
+                {"arrival_elevation_us", timeJson(arrival0)}
+#endif
+            }.dump()
+        );
+    }
+
+    static json planCheck(const PlanCheck &check)
+    {
+        // Oldest first
+        json endstops = json::array();
+        uint32_t first = check.endstopHits > ENDSTOP_EVENTS ? check.endstopHits - ENDSTOP_EVENTS : 0;
+        for (uint32_t i = first ; i < check.endstopHits ; i++)
+        {
+            const EndstopEvent &event = check.endstops[i % ENDSTOP_EVENTS];
+            endstops.push_back({
+                {"time_us", event.time},
+                {"position", event.position},
+                {"speed", fixedToDouble(event.speed)}
+            });
+        }
+
+        return json{
+            {"segments", check.segments},
+            {"deviations", check.deviations},
+            {"max_deviation_steps", check.maxDeviation},
+            {"late", check.late},
+            {"max_late_us", check.segments ? json(check.maxLate) : json(nullptr)},
+            {"endstop_hits", check.endstopHits},
+            {"endstops", endstops}
+        };
+    }
+
+    // Plan segments that started off their planned position or late, and
+    // endstop hits while running, since boot or the last ?reset=1
+    static void checks(const HttpRequest& request, HttpResponse& response)
+    {
+        bool reset = request.param("reset").value_or("0") == "1";
+        PlanCheck check0{}, check1{};
+
+        Motion::call([&] {
+            check0 = stepper0->getPlanCheck();
+            check1 = stepper1->getPlanCheck();
+            if (reset)
+            {
+                stepper0->resetPlanCheck();
+                stepper1->resetPlanCheck();
+            }
+            return true;
+        });
+
+        response.setBody(
+            json{
+                {"late_us", PLAN_LATE_US},
+#if MODE == MODE_DOOR
+                {"left", planCheck(check0)},
+                {"right", planCheck(check1)}
+#elif MODE == MODE_CAMERA
+                {"azimuth", planCheck(check1)},
+                {"elevation", planCheck(check0)}
+#endif
+            }.dump()
+        );
+    }
+
+    static json motion(const MotorSnapshot &snapshot)
+    {
+        return json{
+            {"position", snapshot.position},
+            {"speed", fixedToDouble(snapshot.speed)},
+            {"direction", snapshot.direction ? "up" : "down"},
+            {"state", snapshot.running ? "running" : snapshot.homing ? "homing" : "stopped"},
+            {"last_step_us", snapshot.lastStep},
+            {"turns", snapshot.turns}
+        };
+    }
+
+    // Positions and motion are from one instant, time_us. A client can go
+    // on from there at speed until the next poll.
     static void info(const HttpRequest& request, HttpResponse& response)
     {
+        Motor *const motors[2] = {stepper0, stepper1};
+        MotorSnapshot snapshots[2];
+        uint64_t time = Motor::snapshot(motors, snapshots, 2);
+
         response.setBody(
             json{
+                {"time_us", time},
 #if MODE == MODE_DOOR
                 {"type", "door"},
                 {"max_steps", DOOR_MAX_STEPS},
                 {"max_speed", DOOR_MAX_SPEED},
-                {"position_left", stepper0->getCurrentPosition()},
-                {"position_right", stepper1->getCurrentPosition()},
+                {"position_left", snapshots[0].position},
+                {"position_right", snapshots[1].position},
+                {"motion_left", motion(snapshots[0])},
+                {"motion_right", motion(snapshots[1])},
                 {"closed_position", 0},
                 {"open_position", DOOR_MAX_STEPS}
 #elif MODE == MODE_CAMERA
                 {"type", "camera"},
-                {"azimuth", stepper1->getCurrentPosition()},
-                {"elevation", stepper0->getCurrentPosition()},
+                {"azimuth", snapshots[1].position},
+                {"elevation", snapshots[0].position},
+                {"motion_azimuth", motion(snapshots[1])},
+                {"motion_elevation", motion(snapshots[0])},
+                {"homed_azimuth", snapshots[1].homed},
+                {"homed_elevation", snapshots[0].homed},
                 {"max_elevation", ELEVATION_MAX_STEPS},
                 {"max_azimuth", AZIMUTH_MAX_STEPS},
+                {"continuous_azimuth", AZIMUTH_CONTINUOUS != 0},
                 {"max_speed_azimuth", AZIMUTH_MAX_SPEED},
-                {"max_speed_elevation", ELEVATION_MAX_SPEED}
+                {"max_speed_elevation", ELEVATION_MAX_SPEED},
+                {"slew_speed_azimuth", AZIMUTH_SLEW_SPEED},
+                {"slew_speed_elevation", ELEVATION_SLEW_SPEED},
+                {"queued_azimuth", stepper1->queuedTargets()},
+                {"queued_elevation", stepper0->queuedTargets()},
+                {"max_queued", TARGET_QUEUE},
+                {"trajectory_points", stepper1->trajectoryPoints()},
+                {"max_trajectory_points", TRAJECTORY_POINTS}
 #endif
             }.dump()
         );
     }
+
+#if MOTOR_STATS
+    static json isrStats(const IsrStats &isr)
+    {
+        return json{
+            {"count", isr.count},
+            {"min_cycles", isr.count ? isr.minCycles : 0},
+            {"max_cycles", isr.maxCycles},
+            {"mean_cycles", isr.count ? isr.totalCycles / isr.count : 0},
+            {"histogram", isr.histogram},
+            {"max_latency_cycles", isr.maxLatency},
+            {"late", isr.late},
+            {"missed", isr.missed}
+        };
+    }
+
+    // Step interrupt timing per axis, since boot or the last ?reset=1.
+    // Histogram bucket n holds up to STATS_FIRST_BUCKET << n cycles, the
+    // last one the rest.
+    static void stats(const HttpRequest& request, HttpResponse& response)
+    {
+        bool reset = request.param("reset").value_or("0") == "1";
+        MotorStats stats0{}, stats1{};
+
+        Motion::call([&] {
+            stats0 = stepper0->getStats();
+            stats1 = stepper1->getStats();
+            if (reset)
+            {
+                stepper0->resetStats();
+                stepper1->resetStats();
+            }
+            return true;
+        });
+
+        json buckets = json::array();
+        for (int i = 0 ; i < STATS_BUCKETS - 1 ; i++)
+            buckets.push_back(STATS_FIRST_BUCKET << i);
+
+        response.setBody(
+            json{
+                {"clock_hz", clock_get_hz(clk_sys)},
+                {"late_cycles", STATS_LATE_CYCLES},
+                {"bucket_limits_cycles", buckets},
+#if MODE == MODE_DOOR
+                {"left", {{"wrap", isrStats(stats0.wrap)}, {"alarm", isrStats(stats0.alarm)}}},
+                {"right", {{"wrap", isrStats(stats1.wrap)}, {"alarm", isrStats(stats1.alarm)}}}
+#elif MODE == MODE_CAMERA
+                {"azimuth", {{"wrap", isrStats(stats1.wrap)}, {"alarm", isrStats(stats1.alarm)}}},
+                {"elevation", {{"wrap", isrStats(stats0.wrap)}, {"alarm", isrStats(stats0.alarm)}}}
+#endif
+            }.dump()
+        );
+    }
+#endif
 };
 
 void usbd_serial_init(void)
@@ -282,15 +833,30 @@ int main()
 //    Motor stepper1((Pins){STEP1, DIR1, EN1, -1, false, false}, AZIMUTH_STEPS_PER_REVOLUTION, AZIMUTH_MAX_STEPS);
 //
 
+    // Positions saved while everything stood still, so a restart can skip
+    // homing. Without them both axes home.
+    int positions[POSITION_LOG_AXES] = {-1, -1};
+    PositionLog::load(positions);
+
+    // Motors are created on core1 so their interrupts are taken there. They
+    // home in the background, all at once, while the network is already up.
+    Motion::start();
+    Motion::call([&] {
 #if MODE == MODE_DOOR
-    stepper0 = new Motor((Pins){STEP0, DIR0, EN0}, (Options){.autoPowerOff = true, .reverse = true, .microsteps = 1}, DOOR_MAX_STEPS, DOOR_MAX_STEPS);
-    stepper1 = new Motor((Pins){STEP1, DIR1, EN1}, (Options){.autoPowerOff = true, .reverse = true, .microsteps = 1}, DOOR_MAX_STEPS, DOOR_MAX_STEPS);
+        stepper0 = new Motor((Pins){STEP0, DIR0, EN0}, (Options){.autoPowerOff = true, .reverse = true, .microsteps = 1, .startPosition = positions[0]}, DOOR_MAX_STEPS, DOOR_MAX_STEPS);
+        stepper1 = new Motor((Pins){STEP1, DIR1, EN1}, (Options){.autoPowerOff = true, .reverse = true, .microsteps = 1, .startPosition = positions[1]}, DOOR_MAX_STEPS, DOOR_MAX_STEPS);
 #elif MODE == MODE_CAMERA
-    stepper0 = new Motor((Pins){STEP0, DIR0, EN0}, (Options){.reverse = true, .endstop = SPARE_B3, .dirToEndstop = false}, ELEVATION_STEPS_PER_REVOLUTION, ELEVATION_MAX_STEPS);
-    stepper1 = new Motor((Pins){STEP1, DIR1, EN1}, (Options){}, AZIMUTH_STEPS_PER_REVOLUTION, AZIMUTH_MAX_STEPS);
+        stepper0 = new Motor((Pins){STEP0, DIR0, EN0}, (Options){.reverse = true, .endstop = SPARE_B3, .dirToEndstop = false, .jerk = ELEVATION_JERK, .acceleration = ELEVATION_ACCELERATION, .homingSpeed = ELEVATION_HOMING_SPEED, .fullStepSpeed = ELEVATION_FULL_STEP_SPEED, .startPosition = positions[0]}, ELEVATION_STEPS_PER_REVOLUTION, ELEVATION_MAX_STEPS);
+        stepper1 = new Motor((Pins){STEP1, DIR1, EN1}, (Options){.jerk = AZIMUTH_JERK, .acceleration = AZIMUTH_ACCELERATION, .fullStepSpeed = AZIMUTH_FULL_STEP_SPEED, .startPosition = positions[1], .continuous = AZIMUTH_CONTINUOUS != 0}, AZIMUTH_STEPS_PER_REVOLUTION, AZIMUTH_MAX_STEPS);
+
+        // Set to 1/8 above, planned moves switch to full steps when fast
+        Motor::setModePins(STEP_M0, STEP_M1, STEP_M2);
 #endif
+        return true;
+    });
 
     uint64_t ticks = 0;
+    absolute_time_t saveAt = nil_time;
 
     while (true)
     {
@@ -312,6 +878,21 @@ int main()
         service_traffic();
         webserver.ProcessMessages(ApiServer::RequestHandler);
 
+        // Only written while nothing steps, the flash stalls both cores
+        if (stepper0->isIdle() && stepper1->isIdle() && stepper0->isHomed() && stepper1->isHomed())
+        {
+            int current[POSITION_LOG_AXES] = {stepper0->getCurrentPosition(), stepper1->getCurrentPosition()};
+
+            if (is_nil_time(saveAt))
+                saveAt = make_timeout_time_ms(POSITION_SAVE_DELAY_MS);
+            else if (time_reached(saveAt) && !PositionLog::isSaved(current))
+                PositionLog::save(current);
+        }
+        else
+        {
+            saveAt = nil_time;
+        }
+
         sleep_us(100);
     }
 }
@@ -0,0 +1,37 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_CHECK_H
+#define PILOMAR_CHECK_H
+
+#include <cstdarg>
+#include <cstdio>
+
+// Failed checks are printed and counted, the test goes on with the next one.
+// main() returns checkResult().
+inline int checkFailures = 0;
+inline int checkCount = 0;
+
+inline bool check(bool ok, const char *format, ...)
+{
+    checkCount++;
+    if (ok)
+        return true;
+
+    checkFailures++;
+    va_list args;
+    va_start(args, format);
+    printf("FAIL: ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    return false;
+}
+
+inline int checkResult(const char *name)
+{
+    printf("%s: %d checks, %d failed\n", name, checkCount, checkFailures);
+    return checkFailures == 0 ? 0 : 1;
+}
+
+#endif //PILOMAR_CHECK_H
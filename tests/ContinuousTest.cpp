@@ -0,0 +1,126 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Continuous axes: moves take the short way across north, positions wrap at
+// a revolution and the whole turns are counted.
+
+#include <cstdio>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define FIRST_STEP_PIN 2
+#define FIRST_DIR_PIN 3
+#define SECOND_STEP_PIN 6
+#define SECOND_DIR_PIN 7
+
+#define STEPS_PER_REVOLUTION 384000
+#define SPEED 8000
+
+static Motor *makeMotor(int step, int dir, int start)
+{
+    Options options;
+    options.startPosition = start;
+    options.continuous = true;
+    return new Motor((Pins){step, dir, 4}, options, STEPS_PER_REVOLUTION, STEPS_PER_REVOLUTION);
+}
+
+static bool settle()
+{
+    return HostSim::runUntilIdle(HostSim::now() + 120 * HostSim::TICKS_PER_SECOND);
+}
+
+// Where the motor is, how many steps it took since the last check and how
+// many turns it counts
+static void checkAt(const char *name, Motor *motor, int step, size_t &before, int position, size_t steps,
+                    int64_t turns)
+{
+    size_t made = HostSim::pulseTimes(step).size() - before;
+    before += made;
+    check(motor->getCurrentPosition() == position, "%s: at %d, not %d", name, motor->getCurrentPosition(),
+          position);
+    check(made == steps, "%s: %zu steps, not %zu", name, made, steps);
+    check(motor->getTurns() == turns, "%s: %lld turns, not %lld", name, (long long)motor->getTurns(),
+          (long long)turns);
+}
+
+static void checkAcrossNorth()
+{
+    HostSim::reset();
+    Motor *motor = makeMotor(FIRST_STEP_PIN, FIRST_DIR_PIN, 383000);
+    size_t before = 0;
+
+    motor->runToTarget(SPEED, 1000);
+    check(settle(), "over north: still going");
+    checkAt("over north", motor, FIRST_STEP_PIN, before, 1000, 2000, 1);
+
+    motor->runToTarget(SPEED, 383000);
+    check(settle(), "back: still going");
+    checkAt("back", motor, FIRST_STEP_PIN, before, 383000, 2000, 0);
+
+    // Each queued target measures from the one before
+    motor->queueTarget(SPEED, 500);
+    motor->queueTarget(SPEED, 383500);
+    motor->queueTarget(SPEED, 1500);
+    check(settle(), "queued: still going");
+    checkAt("queued", motor, FIRST_STEP_PIN, before, 1500, 1500 + 1000 + 2000, 1);
+
+    // Half a turn either way is the same distance, it gets there
+    motor->runToTarget(SPEED, 1500 + STEPS_PER_REVOLUTION / 2);
+    check(settle(), "half a turn: still going");
+    check(motor->getCurrentPosition() == 1500 + STEPS_PER_REVOLUTION / 2, "half a turn: at %d",
+          motor->getCurrentPosition());
+    check(HostSim::pulseTimes(FIRST_STEP_PIN).size() - before == STEPS_PER_REVOLUTION / 2,
+          "half a turn: %zu steps", HostSim::pulseTimes(FIRST_STEP_PIN).size() - before);
+    delete motor;
+
+    printf("across north: ends on target with the turns counted\n");
+}
+
+static void checkCoordinated()
+{
+    HostSim::reset();
+    Motor *first = makeMotor(FIRST_STEP_PIN, FIRST_DIR_PIN, 383000);
+    Motor *second = makeMotor(SECOND_STEP_PIN, SECOND_DIR_PIN, 1000);
+    size_t firstBefore = 0;
+    size_t secondBefore = 0;
+
+    Motor::runCoordinated(first, 1000, second, 382000, SPEED);
+    check(settle(), "coordinated: still going");
+    checkAt("coordinated up", first, FIRST_STEP_PIN, firstBefore, 1000, 2000, 1);
+    checkAt("coordinated down", second, SECOND_STEP_PIN, secondBefore, 382000, 3000, -1);
+    delete first;
+    delete second;
+
+    printf("coordinated: both the short way across north\n");
+}
+
+// From 10 down through zero and on past it
+static void checkVelocity()
+{
+    HostSim::reset();
+    Motor *motor = makeMotor(FIRST_STEP_PIN, FIRST_DIR_PIN, 10);
+
+    check(motor->runAtVelocity(-100), "velocity refused");
+    HostSim::runFor(1.0);
+    motor->runAtVelocity(0);
+    check(settle(), "velocity: still going");
+
+    int steps = (int)HostSim::pulseTimes(FIRST_STEP_PIN).size();
+    check(steps > 10, "velocity: %d steps, not past zero", steps);
+    check(motor->getCurrentPosition() == STEPS_PER_REVOLUTION + 10 - steps, "velocity: at %d after %d steps",
+          motor->getCurrentPosition(), steps);
+    check(motor->getTurns() == -1, "velocity: %lld turns", (long long)motor->getTurns());
+    delete motor;
+
+    printf("velocity: %d steps down through zero to %d\n", steps, STEPS_PER_REVOLUTION + 10 - steps);
+}
+
+int main()
+{
+    checkAcrossNorth();
+    checkCoordinated();
+    checkVelocity();
+
+    return checkResult("continuous");
+}
@@ -0,0 +1,127 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Coordinated moves of two axes. Both have to end on their targets at the
+// same time, and in between the follower's share of its travel has to stay
+// close to the lead's, so the path between the end points is straight.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define FIRST_STEP_PIN 2
+#define SECOND_STEP_PIN 6
+
+#define SPEED 8000
+
+// Arrival is planned to within 1/64 of the lead's duration. The last
+// pulses can be one step of the slower axis further apart.
+#define ARRIVAL 64
+
+struct Result
+{
+    double first;                           // Last pulse, seconds
+    double second;
+    double step;                            // Longest period of either axis, seconds
+    double deviation;                       // Largest difference of the shares of travel
+};
+
+static uint64_t longest(const std::vector<uint64_t> &times)
+{
+    uint64_t period = 0;
+    for (size_t i = 0 ; i + 1 < times.size() ; i++)
+        period = std::max(period, times[i + 1] - times[i]);
+    return period;
+}
+
+// Share of travel done at each pulse of the other axis
+static double deviation(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b)
+{
+    double worst = 0;
+    size_t done = 0;
+    for (size_t i = 0 ; i < b.size() ; i++)
+    {
+        while (done < a.size() && a[done] <= b[i])
+            done++;
+        worst = std::max(worst, fabs((double)done / a.size() - (double)(i + 1) / b.size()));
+    }
+    return worst;
+}
+
+static Result runMove(int firstTarget, int secondTarget)
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = 0;
+    Motor first((Pins){FIRST_STEP_PIN, 3, 4}, options, 384000, 384000);
+    Motor second((Pins){SECOND_STEP_PIN, 7, 8}, options, 384000, 384000);
+
+    uint64_t start = HostSim::now();
+    Motor::runCoordinated(&first, firstTarget, &second, secondTarget, SPEED);
+    check(HostSim::runUntilIdle(start + 120 * HostSim::TICKS_PER_SECOND), "%d / %d: still going after 2 minutes",
+          firstTarget, secondTarget);
+    check(first.getCurrentPosition() == firstTarget && second.getCurrentPosition() == secondTarget,
+          "%d / %d: ended at %d / %d", firstTarget, secondTarget, first.getCurrentPosition(),
+          second.getCurrentPosition());
+
+    std::vector<uint64_t> a = HostSim::pulseTimes(FIRST_STEP_PIN);
+    std::vector<uint64_t> b = HostSim::pulseTimes(SECOND_STEP_PIN);
+    Result result = {0, 0, 0, 0};
+    if (a.empty() || b.empty())
+        return result;
+
+    result.first = (double)(a.back() - start) / HostSim::TICKS_PER_SECOND;
+    result.second = (double)(b.back() - start) / HostSim::TICKS_PER_SECOND;
+    result.step = (double)std::max(longest(a), longest(b)) / HostSim::TICKS_PER_SECOND;
+    result.deviation = std::max(deviation(a, b), deviation(b, a));
+    return result;
+}
+
+static void checkMove(int firstTarget, int secondTarget, double straight)
+{
+    Result result = runMove(firstTarget, secondTarget);
+
+    double lead = std::max(result.first, result.second);
+    check(fabs(result.first - result.second) <= lead / ARRIVAL + result.step, "%d / %d: arrived at %.3f / %.3f s", firstTarget,
+          secondTarget, result.first, result.second);
+    check(result.deviation <= straight, "%d / %d: %.2f%% off the straight line", firstTarget, secondTarget,
+          100 * result.deviation);
+
+    printf("%6d / %-6d  last steps at %7.3f / %7.3f s, %.2f%% off the straight line\n", firstTarget, secondTarget,
+           result.first, result.second, 100 * result.deviation);
+}
+
+// Ramp entries used to be counted from the speed truncated to whole Hz, a
+// limit below 1 Hz counted none and ran past the target
+static void checkSlowLimit()
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = 0;
+    Motor motor((Pins){FIRST_STEP_PIN, 3, 4}, options, 384000, 384000);
+
+    uint64_t start = HostSim::now();
+    motor.runToTarget(0.5, 1000);
+    check(HostSim::runUntilIdle(start + 3000 * HostSim::TICKS_PER_SECOND), "0.5 Hz: still going after 3000 s");
+    check(motor.getCurrentPosition() == 1000, "0.5 Hz: ended at %d, not 1000", motor.getCurrentPosition());
+}
+
+int main()
+{
+    checkMove(100000, 50000, 0.001);
+    checkMove(100000, 1000, 0.05);
+    checkMove(20000, 19000, 0.001);
+    checkMove(5000, 100000, 0.001);
+    checkMove(4000, 200, 0.01);
+    checkMove(300, 100, 0.05);
+    checkSlowLimit();
+
+    return checkResult("coordinated");
+}
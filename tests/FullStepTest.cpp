@@ -0,0 +1,169 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Fast plans on full steps, with the drivers modelled. The motors have to
+// end on target with the drivers where they think they are and the mode
+// back on 1/8. Every full step has to start on a full step of the driver.
+
+#include <algorithm>
+#include <cstdio>
+#include <hardware/gpio.h>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define FIRST_STEP_PIN 2
+#define FIRST_DIR_PIN 3
+#define SECOND_STEP_PIN 6
+#define SECOND_DIR_PIN 7
+
+#define M0 12
+#define M1 13
+#define M2 14
+
+#define FULL_STEP_SPEED 4000
+#define SLEW_SPEED 24000
+
+#define START 12345
+#define TARGET 300000
+
+// 1/32 steps of the indexer in one 1/8 microstep
+#define INDEXER_STRIDE 4
+
+struct Axis
+{
+    Motor *motor;
+    int step;
+    int driverStart;
+};
+
+static Motor *makeMotor(int step, int dir, int start, int fullStepSpeed = FULL_STEP_SPEED)
+{
+    HostSim::attachDriver(step, dir, M0, M1, M2);
+
+    Options options;
+    options.startPosition = start;
+    options.fullStepSpeed = fullStepSpeed;
+    return new Motor((Pins){step, dir, 4}, options, 384000, 384000);
+}
+
+// The drivers start on 1/8, M0 and M1 high
+static void reset()
+{
+    HostSim::reset();
+    const int pins[] = {M0, M1, M2};
+    for (int pin : pins)
+    {
+        gpio_init(pin);
+        gpio_set_dir(pin, true);
+    }
+    gpio_put(M0, true);
+    gpio_put(M1, true);
+    gpio_put(M2, false);
+}
+
+static bool onEighths()
+{
+    return gpio_get_out_level(M0) && gpio_get_out_level(M1) && !gpio_get_out_level(M2);
+}
+
+// Fastest pulse rate of an axis, Hz
+static double peakRate(int pin)
+{
+    std::vector<uint64_t> times = HostSim::pulseTimes(pin);
+    uint64_t shortest = UINT64_MAX;
+    for (size_t i = 0 ; i + 1 < times.size() ; i++)
+        shortest = std::min(shortest, times[i + 1] - times[i]);
+    return times.size() < 2 ? 0 : (double)HostSim::TICKS_PER_SECOND / shortest;
+}
+
+static void checkAxis(const char *name, const Axis &axis, int start, int target)
+{
+    int moved = (HostSim::driverPosition(axis.step) - axis.driverStart) / INDEXER_STRIDE;
+    check(axis.motor->getCurrentPosition() == target, "%s: ended at %d, not %d", name,
+          axis.motor->getCurrentPosition(), target);
+    check(moved == target - start, "%s: the driver moved %d, not %d", name, moved, target - start);
+    check(HostSim::driverOffGrid(axis.step) == 0, "%s: %d pulses off the driver's grid", name,
+          HostSim::driverOffGrid(axis.step));
+}
+
+static void checkSingle(double speed, int fullStepSpeed)
+{
+    reset();
+    Motor::setModePins(M0, M1, M2);
+    Axis axis = {makeMotor(FIRST_STEP_PIN, FIRST_DIR_PIN, START, fullStepSpeed), FIRST_STEP_PIN, 0};
+    axis.driverStart = HostSim::driverPosition(FIRST_STEP_PIN);
+
+    uint64_t began = HostSim::now();
+    axis.motor->runToTarget(speed, TARGET);
+    check(HostSim::runUntilIdle(began + 120 * HostSim::TICKS_PER_SECOND), "%.0f Hz: still going", speed);
+    double seconds = (double)(HostSim::now() - began) / HostSim::TICKS_PER_SECOND;
+
+    char name[32];
+    snprintf(name, sizeof(name), "%.0f Hz", speed);
+    checkAxis(name, axis, START, TARGET);
+    check(onEighths(), "%s: the mode did not end on 1/8", name);
+    printf("%d -> %d at %5.0f Hz, %s: %5.1f s, pulses at up to %5.0f Hz\n", START, TARGET, speed,
+           fullStepSpeed ? "full steps" : "microsteps", seconds, peakRate(FIRST_STEP_PIN));
+
+    delete axis.motor;
+}
+
+static void checkCoordinated(int secondTarget)
+{
+    reset();
+    Motor::setModePins(M0, M1, M2);
+    Axis first = {makeMotor(FIRST_STEP_PIN, FIRST_DIR_PIN, START), FIRST_STEP_PIN, 0};
+    Axis second = {makeMotor(SECOND_STEP_PIN, SECOND_DIR_PIN, START), SECOND_STEP_PIN, 0};
+    first.driverStart = HostSim::driverPosition(FIRST_STEP_PIN);
+    second.driverStart = HostSim::driverPosition(SECOND_STEP_PIN);
+
+    uint64_t began = HostSim::now();
+    Motor::runCoordinated(first.motor, TARGET, second.motor, secondTarget, SLEW_SPEED);
+    check(HostSim::runUntilIdle(began + 120 * HostSim::TICKS_PER_SECOND), "%d / %d: still going", TARGET,
+          secondTarget);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%d / %d", TARGET, secondTarget);
+    checkAxis(name, first, START, TARGET);
+    checkAxis(name, second, START, secondTarget);
+    check(onEighths(), "%s: the mode did not end on 1/8", name);
+    printf("%d / %d coordinated: pulses at up to %5.0f / %5.0f Hz\n", TARGET, secondTarget,
+           peakRate(FIRST_STEP_PIN), peakRate(SECOND_STEP_PIN));
+
+    delete first.motor;
+    delete second.motor;
+}
+
+// Past the max speed only where the drivers can go to full steps
+static void checkSlew()
+{
+    reset();
+    Motor::setModePins(M0, M1, M2);
+    Motor *motor = makeMotor(FIRST_STEP_PIN, FIRST_DIR_PIN, 0);
+    Motor *other = makeMotor(SECOND_STEP_PIN, SECOND_DIR_PIN, 0, 0);
+    check(motor->canSlew(), "can't slew with the mode pins set");
+
+    // Another motor tracking keeps the drivers on microsteps
+    other->runAtVelocity(100);
+    check(!motor->canSlew(), "can slew with another motor in velocity mode");
+    other->runAtVelocity(0);
+    HostSim::runUntilIdle(HostSim::now() + 10 * HostSim::TICKS_PER_SECOND);
+    check(motor->canSlew(), "can't slew once the other motor has stopped");
+
+    delete motor;
+    delete other;
+}
+
+int main()
+{
+    checkSingle(8000, 0);
+    checkSingle(SLEW_SPEED, FULL_STEP_SPEED);
+    checkSlew();
+
+    const int secondTargets[] = {20000, 100000, 300003};
+    for (int secondTarget : secondTargets)
+        checkCoordinated(secondTarget);
+
+    return checkResult("full steps");
+}
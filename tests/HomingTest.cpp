@@ -0,0 +1,122 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Homing in the background. The constructor returns straight away, the
+// motor refuses moves until it has found the endstop and backed off it,
+// and takes them afterwards. The fast seek has to end in the same place
+// as the slow search.
+
+#include <cstdio>
+#include <cstdlib>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define STEP_PIN 2
+#define DIR_PIN 3
+#define ENDSTOP_PIN 10
+
+#define MAX_STEPS 120000
+
+// 125 full steps at 8 microsteps
+#define BACKOFF 1000
+
+// The endstop pulls the pin low
+#define OPEN true
+#define HIT false
+
+static void checkBackground()
+{
+    HostSim::reset();
+    HostSim::setInput(ENDSTOP_PIN, OPEN);
+
+    Options options;
+    options.endstop = ENDSTOP_PIN;
+    options.dirToEndstop = true;
+    uint64_t start = HostSim::now();
+    Motor motor((Pins){STEP_PIN, DIR_PIN, 4}, options, 384000, MAX_STEPS);
+
+    check(HostSim::now() == start, "the constructor waited for homing");
+    check(!motor.isHomed(), "homed without an endstop");
+    check(!motor.queueTarget(8000, 1000), "a target was taken while homing");
+    check(!motor.runAtVelocity(100), "velocity mode was taken while homing");
+
+    HostSim::runFor(1);
+    size_t seeking = HostSim::pulseTimes(STEP_PIN).size();
+    check(seeking > 0, "no steps towards the endstop");
+    check(!motor.isHomed(), "homed before the endstop");
+
+    // Backs off 125 full steps once it is found
+    HostSim::setInput(ENDSTOP_PIN, HIT);
+    HostSim::runFor(0.01);
+    HostSim::setInput(ENDSTOP_PIN, OPEN);
+    for (int ms = 0 ; ms < 2000 && !motor.isHomed() ; ms++)
+    {
+        HostSim::runFor(0.001);
+        Motor::service();
+    }
+    check(motor.isHomed(), "not homed after backing off");
+    check(motor.getCurrentPosition() == 0, "homed at %d", motor.getCurrentPosition());
+
+    check(motor.queueTarget(8000, 1000), "a target was refused once homed");
+    check(HostSim::runUntilIdle(HostSim::now() + 60 * HostSim::TICKS_PER_SECOND), "still going");
+    check(motor.getCurrentPosition() == 1000, "ended at %d, not 1000", motor.getCurrentPosition());
+
+    printf("background: %zu steps before the endstop was set\n", seeking);
+}
+
+// Homing from start steps above the trigger, with the endstop following
+// the carriage. It has to end HOMING_BACKOFF steps above the trigger with
+// the position at 0.
+static void checkSeek(int start, int homingSpeed)
+{
+    HostSim::reset();
+    HostSim::attachCarriage(STEP_PIN, DIR_PIN, ENDSTOP_PIN, start);
+
+    Options options;
+    options.endstop = ENDSTOP_PIN;
+    options.homingSpeed = homingSpeed;
+    uint64_t began = HostSim::now();
+    Motor motor((Pins){STEP_PIN, DIR_PIN, 4}, options, 384000, MAX_STEPS);
+
+    // The seek counts its steps from wherever the motor was, the position
+    // can run one ahead while a pulse is out
+    HostSim::runFor(0.5);
+    int moved = start - HostSim::carriagePosition(STEP_PIN);
+    check(abs(abs(motor.getCurrentPosition()) - moved) <= 1, "%d steps at %d Hz: at %d after %d steps of the seek",
+          start, homingSpeed, motor.getCurrentPosition(), moved);
+
+    // service() stands in for the core1 loop, it goes on once a seek ends
+    for (int ms = 0 ; ms < 120000 && !motor.isHomed() ; ms++)
+    {
+        HostSim::runFor(0.001);
+        Motor::service();
+    }
+    double seconds = (double)(HostSim::now() - began) / HostSim::TICKS_PER_SECOND;
+
+    int carriage = HostSim::carriagePosition(STEP_PIN);
+    if (!check(motor.isHomed(), "%d steps at %d Hz: not homed after 2 minutes", start, homingSpeed))
+        return;
+    check(motor.getCurrentPosition() == 0, "%d steps at %d Hz: homed at %d", start, homingSpeed,
+          motor.getCurrentPosition());
+    check(carriage == BACKOFF, "%d steps at %d Hz: stopped %d steps from the endstop", start, homingSpeed, carriage);
+    check(-HostSim::carriageLowest(STEP_PIN) < BACKOFF, "%d steps at %d Hz: braked %d steps past the endstop", start,
+          homingSpeed, -HostSim::carriageLowest(STEP_PIN));
+
+    printf("%6d steps at %4d Hz: homed in %5.1f s, %4d steps past the endstop\n", start, homingSpeed, seconds,
+           -HostSim::carriageLowest(STEP_PIN));
+}
+
+int main()
+{
+    checkBackground();
+
+    // Elevation: the far end of its travel, mid travel and close by
+    const int starts[] = {MAX_STEPS + 1000, MAX_STEPS / 2, 2000};
+    const int speeds[] = {0, 4000, 8000};
+    for (int start : starts)
+        for (int speed : speeds)
+            checkSeek(start, speed);
+
+    return checkResult("homing");
+}
@@ -0,0 +1,109 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Several motors on the one PWM wrap interrupt. Slices that wrap together
+// come to the handler in one call, each has to get its step. The end of a
+// move is only noted there, service() calls back and powers off.
+
+#include <cstdio>
+#include <hardware/gpio.h>
+#include <hardware/regs/intctrl.h>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define MOTORS 4
+#define ENABLE_PIN 20
+
+struct Run
+{
+    double speed;
+    int target;
+};
+
+static void checkRuns(const char *name, const Run runs[MOTORS])
+{
+    HostSim::reset();
+
+    Motor *motors[MOTORS];
+    for (int i = 0 ; i < MOTORS ; i++)
+    {
+        Options options;
+        options.startPosition = 0;
+        motors[i] = new Motor((Pins){2 + 2 * i, 3 + 2 * i, 20 + i}, options, 384000, 120000);
+    }
+
+    uint64_t start = HostSim::now();
+    for (int i = 0 ; i < MOTORS ; i++)
+        motors[i]->runToTarget(runs[i].speed, runs[i].target);
+    check(HostSim::runUntilIdle(start + 60 * HostSim::TICKS_PER_SECOND), "%s: still going after a minute", name);
+
+    size_t steps = 0;
+    for (int i = 0 ; i < MOTORS ; i++)
+    {
+        size_t pulses = HostSim::pulseTimes(2 + 2 * i).size();
+        check(motors[i]->getCurrentPosition() == runs[i].target, "%s: motor %d ended at %d, not %d", name, i,
+              motors[i]->getCurrentPosition(), runs[i].target);
+        check(pulses == (size_t)runs[i].target, "%s: motor %d made %zu steps for %d", name, i, pulses, runs[i].target);
+        steps += pulses;
+        delete motors[i];
+    }
+
+    printf("%-16s %6zu steps, %6u wrap interrupts\n", name, steps, HostSim::interrupts(PWM_IRQ_WRAP));
+}
+
+static int finished = 0;
+
+static bool onFinish(void *)
+{
+    finished++;
+    return false;
+}
+
+static void checkFinish()
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = 0;
+    options.autoPowerOff = true;
+    options.callback = onFinish;
+    Motor motor((Pins){2, 3, ENABLE_PIN}, options, 384000, 120000);
+
+    // A plan, then velocity mode slowing down to a stop
+    for (int run = 0 ; run < 2 ; run++)
+    {
+        finished = 0;
+        if (run == 0)
+        {
+            motor.runToTarget(8000, 2000);
+        }
+        else
+        {
+            motor.runAtVelocity(1000);
+            HostSim::runFor(0.5);
+            motor.runAtVelocity(0);
+        }
+        check(HostSim::runUntilIdle(HostSim::now() + 60 * HostSim::TICKS_PER_SECOND), "finish %d: still going", run);
+        check(finished == 0 && !gpio_get_out_level(ENABLE_PIN), "finish %d: called back from the interrupt", run);
+
+        Motor::service();
+        check(finished == 1, "finish %d: called back %d times", run, finished);
+        check(gpio_get_out_level(ENABLE_PIN), "finish %d: still powered", run);
+    }
+}
+
+int main()
+{
+    // Same plan on all of them, every wrap comes to all slices at once
+    const Run together[MOTORS] = {{8000, 20000}, {8000, 20000}, {8000, 20000}, {8000, 20000}};
+    checkRuns("together", together);
+    check(HostSim::interrupts(PWM_IRQ_WRAP) < 20000 + 100, "together: one interrupt for all four slices");
+
+    const Run apart[MOTORS] = {{8000, 20000}, {3000, 7000}, {1234.5, 5000}, {5, 200}};
+    checkRuns("apart", apart);
+
+    checkFinish();
+
+    return checkResult("interrupts");
+}
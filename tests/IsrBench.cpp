@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Host time spent in the step interrupt handlers. x86 numbers, they show
+// how the cost scales, not what it is on the RP2040.
+
+#include <cstdio>
+#include <hardware/regs/intctrl.h>
+#include "HostSim.h"
+#include "Motor.h"
+
+#define ROUNDS 20
+
+// Mean handler time per wrap interrupt, with motors running the same move
+static void benchMotors(int count)
+{
+    uint64_t nanos = 0;
+    uint64_t calls = 0;
+    for (int round = 0 ; round < ROUNDS ; round++)
+    {
+        HostSim::reset();
+
+        Motor *motors[4];
+        for (int i = 0 ; i < count ; i++)
+        {
+            Options options;
+            options.startPosition = 0;
+            motors[i] = new Motor((Pins){2 + 2 * i, 3 + 2 * i, 20 + i}, options, 384000, 120000);
+        }
+
+        for (int i = 0 ; i < count ; i++)
+            motors[i]->runToTarget(8000, 100000);
+        HostSim::runUntilIdle(HostSim::now() + 60 * HostSim::TICKS_PER_SECOND);
+
+        nanos += HostSim::interruptNanos(PWM_IRQ_WRAP);
+        calls += HostSim::interrupts(PWM_IRQ_WRAP);
+
+        for (int i = 0 ; i < count ; i++)
+            delete motors[i];
+    }
+
+    printf("%d motors  %6.1f ns per wrap interrupt, %6.1f ns per slice\n", count, (double)nanos / calls,
+           (double)nanos / calls / count);
+}
+
+// Mean handler time per wrap interrupt of one motor, over a move that is
+// all ramps and over a long one
+static void benchProfile(const char *name, Profile profile)
+{
+    double mean[2];
+    int targets[2] = {2600, 100000};
+    for (int move = 0 ; move < 2 ; move++)
+    {
+        uint64_t nanos = 0;
+        uint64_t calls = 0;
+        for (int round = 0 ; round < ROUNDS ; round++)
+        {
+            HostSim::reset();
+
+            Options options;
+            options.startPosition = 0;
+            options.jerk = 64;
+            options.acceleration = 24000;
+            Motor motor((Pins){2, 3, 4}, options, 384000, 120000);
+
+            motor.runToTarget(8000, targets[move], profile);
+            HostSim::runUntilIdle(HostSim::now() + 60 * HostSim::TICKS_PER_SECOND);
+
+            nanos += HostSim::interruptNanos(PWM_IRQ_WRAP);
+            calls += HostSim::interrupts(PWM_IRQ_WRAP);
+        }
+        mean[move] = (double)nanos / calls;
+    }
+
+    printf("%-10s %6.1f ns per wrap interrupt over 2600 steps, %6.1f ns over 100000\n", name, mean[0], mean[1]);
+}
+
+int main()
+{
+    for (int count = 1 ; count <= 4 ; count++)
+        benchMotors(count);
+
+    benchProfile("trapezoid", Trapezoid);
+    benchProfile("s-curve", SCurve);
+    benchProfile("linear", Linear);
+
+    return 0;
+}
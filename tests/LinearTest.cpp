@@ -0,0 +1,186 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// The linear profile: its ramps against v = sqrt(2 * a * n), its time
+// against the trapezoid and the S-curve and moves of all kinds ending on
+// their targets.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <hardware/pwm.h>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define STEP_PIN 2
+#define DIR_PIN 3
+#define ENABLE_PIN 4
+
+#define STEPS_PER_REVOLUTION 384000
+#define MAX_STEPS 120000
+
+// The camera axes
+#define ACCELERATION 24000
+#define JERK 64
+
+// Time of a move from its first step to its last, seconds
+static double moveTime(Profile profile, double speed, int target, std::vector<uint64_t> &times)
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = 0;
+    options.jerk = JERK;
+    options.acceleration = ACCELERATION;
+    Motor motor((Pins){STEP_PIN, DIR_PIN, ENABLE_PIN}, options, STEPS_PER_REVOLUTION, MAX_STEPS);
+
+    motor.runToTarget(speed, target, profile);
+    check(HostSim::runUntilIdle(HostSim::now() + 120 * HostSim::TICKS_PER_SECOND), "profile %d: still going",
+          profile);
+    check(motor.getCurrentPosition() == target, "profile %d: ended at %d, not %d", profile,
+          motor.getCurrentPosition(), target);
+
+    times = HostSim::pulseTimes(STEP_PIN);
+    return times.size() < 2 ? 0 : (double)(times.back() - times.front()) / HostSim::TICKS_PER_SECOND;
+}
+
+// Step n of the ramp runs at sqrt(2 * a * (first + n)). The recurrence is
+// started 1/(64 * n^2) fast, past that the periods are within a few PWM
+// counts.
+static void checkRamp()
+{
+    std::vector<uint64_t> trapezoid;
+    std::vector<uint64_t> times;
+    double trapezoidTime = moveTime(Trapezoid, 8000, 100000, trapezoid);
+    double linearTime = moveTime(Linear, 8000, 100000, times);
+    check(times.size() == 100000, "linear: %zu steps for 100000", times.size());
+    check(linearTime < trapezoidTime, "linear: %.3f s, the trapezoid %.3f s", linearTime, trapezoidTime);
+
+    // Over a long move the S-curve is no slower than the trapezoid
+    std::vector<uint64_t> sCurve;
+    double sCurveTime = moveTime(SCurve, 8000, 100000, sCurve);
+    check(sCurveTime <= trapezoidTime, "s-curve: %.3f s, the trapezoid %.3f s", sCurveTime, trapezoidTime);
+
+    // One count of the divider the plan runs on
+    double count = pwm_hw->slice[pwm_gpio_to_slice_num(STEP_PIN)].div / 16.0 / 125e6;
+
+    // The first step is the slowest the PWM can make, that is index 2 here
+    double first = round(pow(1.0 / ((double)(times[1] - times[0]) / HostSim::TICKS_PER_SECOND), 2) /
+                         (2 * ACCELERATION));
+    size_t top = 0;
+    double worst = 0;
+    for (size_t n = 0 ; n + 1 < times.size() ; n++)
+    {
+        double period = (double)(times[n + 1] - times[n]) / HostSim::TICKS_PER_SECOND;
+        if (period <= 1.0 / 8000 + count)
+        {
+            top = n;
+            break;
+        }
+
+        double index = first + n;
+        double wanted = 1 / sqrt(2.0 * ACCELERATION * index);
+        double error = fabs(period - wanted) / wanted - 1 / (64 * index * index);
+        worst = std::max(worst, error);
+        check(error < 5e-4, "linear: ramp step %zu at %.3f Hz, %.3f Hz wanted", n, 1 / period, 1 / wanted);
+    }
+    check(top > 0, "linear: never got to 8000 Hz");
+
+    double rampTime = (double)(times[top] - times[0]) / HostSim::TICKS_PER_SECOND;
+    printf("0 -> 100000 at 8000 Hz: %.3f s, the trapezoid %.3f s, the S-curve %.3f s\n", linearTime, trapezoidTime,
+           sCurveTime);
+    printf("8000 Hz after %zu steps and %.3f s, the speed within %.2e of sqrt(2an) past the head start\n", top,
+           rampTime, worst);
+}
+
+static void checkMoves()
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = 1000;
+    options.acceleration = ACCELERATION;
+    Motor motor((Pins){STEP_PIN, DIR_PIN, ENABLE_PIN}, options, STEPS_PER_REVOLUTION, MAX_STEPS);
+
+    check(!motor.canSlew(), "can slew without mode pins");
+
+    // Short moves either way, down to a single step
+    int target = 1000;
+    for (int steps = 1 ; steps <= 300 ; steps++)
+    {
+        target += steps & 1 ? steps : -steps;
+        motor.runToTarget(8000, target, Linear);
+        HostSim::runUntilIdle(HostSim::now() + 10 * HostSim::TICKS_PER_SECOND);
+        if (!check(motor.getCurrentPosition() == target, "%d steps: ended at %d, not %d", steps,
+                   motor.getCurrentPosition(), target))
+            break;
+    }
+
+    // Queued behind a running move
+    motor.runToTarget(8000, 20000, Linear);
+    check(motor.queueTarget(4000, 5000, Linear), "queued move not taken");
+    HostSim::runUntilIdle(HostSim::now() + 60 * HostSim::TICKS_PER_SECOND);
+    check(motor.getCurrentPosition() == 5000, "queued: ended at %d, not 5000", motor.getCurrentPosition());
+
+    // Turned round on the ramp, at full speed and while braking
+    for (double after : {0.1, 0.5, 1.5})
+    {
+        motor.runToTarget(8000, 25000, Linear);
+        HostSim::runFor(after);
+        motor.runToTarget(8000, 2000, Linear);
+        HostSim::runUntilIdle(HostSim::now() + 60 * HostSim::TICKS_PER_SECOND);
+        check(motor.getCurrentPosition() == 2000, "reversed after %.1f s: ended at %d, not 2000", after,
+              motor.getCurrentPosition());
+    }
+}
+
+static void checkCoordinated()
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = 0;
+    options.acceleration = ACCELERATION;
+    Motor first((Pins){STEP_PIN, DIR_PIN, ENABLE_PIN}, options, STEPS_PER_REVOLUTION, MAX_STEPS);
+    Motor second((Pins){6, 7, 5}, options, STEPS_PER_REVOLUTION, MAX_STEPS);
+
+    Motor::runCoordinated(&first, 30000, &second, 7000, 8000, Linear);
+    HostSim::runUntilIdle(HostSim::now() + 60 * HostSim::TICKS_PER_SECOND);
+    check(first.getCurrentPosition() == 30000 && second.getCurrentPosition() == 7000,
+          "coordinated: ended at %d and %d, not 30000 and 7000", first.getCurrentPosition(),
+          second.getCurrentPosition());
+}
+
+// Last, the mode pins stay set for the rest of the run
+static void checkFullSteps()
+{
+    HostSim::reset();
+    Motor::setModePins(8, 9, 10);
+
+    Options options;
+    options.startPosition = 0;
+    options.acceleration = ACCELERATION;
+    options.fullStepSpeed = 4000;
+    Motor motor((Pins){STEP_PIN, DIR_PIN, ENABLE_PIN}, options, STEPS_PER_REVOLUTION, MAX_STEPS);
+    check(motor.canSlew(), "full steps: can't slew with the mode pins set");
+
+    for (int target : {100000, 3, 40000, 39000, 0})
+    {
+        motor.runToTarget(24000, target, Linear);
+        HostSim::runUntilIdle(HostSim::now() + 60 * HostSim::TICKS_PER_SECOND);
+        check(motor.getCurrentPosition() == target, "full steps: ended at %d, not %d", motor.getCurrentPosition(),
+              target);
+    }
+}
+
+int main()
+{
+    checkRamp();
+    checkMoves();
+    checkCoordinated();
+    checkFullSteps();
+
+    return checkResult("linear");
+}
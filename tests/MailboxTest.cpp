@@ -0,0 +1,54 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// The mailbox between two threads standing in for the cores. Every item
+// has to come out once, in order, however full the ring runs.
+
+#include <cstdio>
+#include <thread>
+#include "Mailbox.h"
+#include "Check.h"
+
+#define ITEMS 1000000
+
+struct Item
+{
+    uint32_t sequence;
+    uint32_t check;
+};
+
+int main()
+{
+    static Mailbox<Item, 16> mailbox;
+
+    std::thread producer([]
+    {
+        for (uint32_t i = 0 ; i < ITEMS ; i++)
+            while (!mailbox.push({i, ~i}))
+                std::this_thread::yield();
+    });
+
+    uint32_t received = 0;
+    uint32_t wrong = 0;
+    while (received < ITEMS)
+    {
+        Item item;
+        if (!mailbox.pop(item))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (item.sequence != received || item.check != ~received)
+            wrong++;
+        received++;
+    }
+    producer.join();
+
+    Item item;
+    check(wrong == 0, "%u items out of order or torn", wrong);
+    check(!mailbox.pop(item), "an item left over");
+    printf("%d items through a 16 item ring\n", ITEMS);
+
+    return checkResult("mailbox");
+}
@@ -0,0 +1,169 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// The (count, delay) words for the stepper PIO program, and moves on the PIO
+// backend. HostSim runs the program's cycle count, 2 * delay + 5 for each
+// step and 4 more between segments for the push and the pulls.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <hardware/regs/intctrl.h>
+#include "HostSim.h"
+#include "Motor.h"
+#include "PioSegment.h"
+#include "Check.h"
+#include "ReferencePlanner.h"
+
+#define CLOCK 125000000
+
+// Push, then the pulls and the out of the next segment
+#define PIO_SEGMENT_GAP 4
+
+#define ENDSTOP_PIN 10
+
+static void checkEncoding()
+{
+    int checked = 0;
+    // Below about 0.015 Hz the delay is clamped
+    for (double hz = 0.015 ; hz < 100000 ; hz *= 1.0007, checked++)
+    {
+        fixed_t speed = doubleToFixed(hz);
+        if (speed <= 0)
+            continue;
+
+        PioSegment segment = encodePioSegment(PIO_MAX_SEGMENT_STEPS, speed, CLOCK);
+        check(segment.count == PIO_MAX_SEGMENT_STEPS - 1, "count %u for %d steps", segment.count, PIO_MAX_SEGMENT_STEPS);
+
+        // The delay loop counts two cycles a turn, rounding down
+        double wanted = (double)CLOCK * (1 << FIXED_SHIFT) / speed;
+        double cycles = 2.0 * segment.delay + PIO_STEP_OVERHEAD;
+        if (!check(cycles <= wanted && cycles > wanted - 2, "%.4f Hz: %.0f cycles a step for %.2f", hz, cycles, wanted))
+            break;
+
+        fixed_t decoded = decodePioSegmentSpeed(segment, CLOCK);
+        if (!check(decoded >= speed, "%.4f Hz decodes to %.4f", hz, fixedToDouble(decoded)))
+            break;
+    }
+    printf("encoding: %d speeds from 0.015 Hz to 100 kHz\n", checked);
+
+    check(encodePioSegment(1, 1, CLOCK).delay == UINT32_MAX, "slower than the delay can count is clamped");
+}
+
+static void checkMove(const char *name, int start, double speed, int target)
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = start;
+    options.backend = PioBackend;
+    Motor motor((Pins){2, 3, 4}, options, 384000, 120000);
+
+    uint64_t began = HostSim::now();
+    motor.runToTarget(speed, target);
+    check(HostSim::runUntilIdle(began + 120 * HostSim::TICKS_PER_SECOND), "%s: still going after 2 minutes", name);
+    check(motor.getCurrentPosition() == target, "%s: ended at %d, not %d", name, motor.getCurrentPosition(), target);
+
+    std::vector<RefStep> expected = referenceSteps(referencePlan({start, 0, false, false}, speed, target, 8, 120000));
+    std::vector<uint64_t> times = HostSim::pulseTimes(2);
+    if (!check(times.size() == expected.size(), "%s: %zu steps, the reference made %zu", name, times.size(),
+               expected.size()))
+        return;
+
+    // Within the loop's two cycle resolution of the planned speed, which
+    // is fixed point
+    int wrong = 0;
+    for (size_t i = 0 ; i + 1 < times.size() ; i++)
+    {
+        double cycles = (double)(times[i + 1] - times[i]) / HostSim::TICKS_PER_CYCLE;
+        double wanted = CLOCK / expected[i].speed;
+        double slack = cycles - wanted;
+        if (slack > 0.5)
+            slack -= PIO_SEGMENT_GAP; // A segment starts here
+        if (slack < -2.5 || slack > 0.5)
+        {
+            if (wrong++ < 5)
+                check(false, "%s: step %zu took %.0f cycles, the reference %.1f", name, i + 1, cycles, wanted);
+        }
+    }
+    check(wrong == 0, "%s: %d of %zu steps off the reference", name, wrong, times.size());
+
+    uint32_t interrupts = HostSim::interrupts(PIO0_IRQ_0);
+    check(interrupts < times.size() / 100, "%s: %u interrupts for %zu steps", name, interrupts, times.size());
+    printf("%-12s %6zu steps, %.3f s, %u interrupts\n", name, times.size(),
+           (double)(times.back() - times.front()) / HostSim::TICKS_PER_SECOND, interrupts);
+}
+
+// An endstop hit stops the queued chunks. The plan is left as it was, a
+// new move after it runs off its own.
+static void checkEndstop()
+{
+    HostSim::reset();
+    HostSim::setInput(ENDSTOP_PIN, true);
+
+    Options options;
+    options.startPosition = 50000;
+    options.endstop = ENDSTOP_PIN;
+    options.backend = PioBackend;
+    Motor motor((Pins){2, 3, 4}, options, 384000, 120000);
+
+    motor.runToTarget(8000, 10000);
+    HostSim::runFor(0.5);
+    HostSim::setInput(ENDSTOP_PIN, false);
+    HostSim::runFor(0.1);
+    check(!motor.isRunning(), "endstop: still running");
+    check(motor.getCurrentPosition() == 0, "endstop: at %d, not 0", motor.getCurrentPosition());
+    check(motor.positionAt(get_absolute_time()) == 0, "endstop: predicted at %d", motor.positionAt(get_absolute_time()));
+    check(motor.getPlanCheck().endstopHits == 1, "endstop: %u hits", motor.getPlanCheck().endstopHits);
+
+    size_t steps = HostSim::pulseTimes(2).size();
+    HostSim::setInput(ENDSTOP_PIN, true);
+    motor.runToTarget(8000, 5000);
+    check(HostSim::runUntilIdle(HostSim::now() + 120 * HostSim::TICKS_PER_SECOND), "after the endstop: still going");
+    check(motor.getCurrentPosition() == 5000, "after the endstop: ended at %d, not 5000", motor.getCurrentPosition());
+    check(HostSim::pulseTimes(2).size() - steps == 5000, "after the endstop: %zu steps",
+          HostSim::pulseTimes(2).size() - steps);
+    printf("endstop      stopped at 0, the next move ran\n");
+}
+
+// Moves right up to either limit and back, none of it is cut off
+static void checkLimits()
+{
+    const int maxSteps = 120000;
+    const int starts[] = {1000, maxSteps - 1000};
+    const int ends[] = {0, maxSteps};
+
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        HostSim::reset();
+
+        Options options;
+        options.startPosition = starts[i];
+        options.backend = PioBackend;
+        Motor motor((Pins){2, 3, 4}, options, 384000, maxSteps);
+
+        motor.queueTarget(8000, ends[i]);
+        motor.queueTarget(8000, starts[i]);
+        check(HostSim::runUntilIdle(HostSim::now() + 120 * HostSim::TICKS_PER_SECOND), "limit %d: still going",
+              ends[i]);
+        check(motor.getCurrentPosition() == starts[i], "limit %d: ended at %d, not %d", ends[i],
+              motor.getCurrentPosition(), starts[i]);
+        check(HostSim::pulseTimes(2).size() == 2000, "limit %d: %zu steps, not 2000", ends[i],
+              HostSim::pulseTimes(2).size());
+    }
+    printf("limits       out to 0 and %d and back\n", maxSteps);
+}
+
+int main()
+{
+    checkEncoding();
+
+    checkMove("long move", 0, 8000, 100000);
+    checkMove("backwards", 100000, 8000, 30000);
+    checkMove("slow limit", 0, 1234.5, 20000);
+    checkEndstop();
+    checkLimits();
+
+    return checkResult("pio");
+}
@@ -0,0 +1,168 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// The segment checks of plans on the PWM: moves that run as planned show no
+// deviation and start their segments on time. Endstop hits in normal running
+// go into the ring, the last ENDSTOP_EVENTS of them.
+
+#include <algorithm>
+#include <cstdio>
+#include <hardware/gpio.h>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define STEP_PIN 2
+#define DIR_PIN 3
+#define ENABLE_PIN 4
+#define ENDSTOP_PIN 10
+
+#define M0 12
+#define M1 13
+#define M2 14
+
+#define STEPS_PER_REVOLUTION 384000
+#define MAX_STEPS 240000
+
+#define ACCELERATION 24000
+#define JERK 64
+#define FULL_STEP_SPEED 4000
+
+// The endstop pulls the pin low
+#define OPEN true
+#define HIT false
+
+#define HITS 10
+
+static const char *const PROFILES[] = {"trapezoid", "s-curve", "linear"};
+
+struct Run
+{
+    const char *name;
+    Profile profile;
+    int start;
+    double speed;
+    int target;
+    double retargetAt;                      // Seconds into the move, 0 for none
+    int retarget;
+    bool fullSteps;
+};
+
+static const Run runs[] = {
+    {"short", Trapezoid, 0, 8000, 2000},
+    {"long", Trapezoid, 0, 8000, 200000},
+    {"short", SCurve, 0, 8000, 2000},
+    {"long", SCurve, 0, 8000, 200000},
+    {"short", Linear, 0, 8000, 2000},
+    {"long", Linear, 0, 8000, 200000},
+    {"retarget", Trapezoid, 0, 8000, 20000, 0.5, 30000},
+    {"retarget", Linear, 0, 8000, 20000, 0.5, 30000},
+    {"full steps", Trapezoid, 0, 24000, 200000, 0, 0, true},
+    {"reversal", Trapezoid, 10000, 8000, 30000, 1.0, 0},
+    {"reversal", SCurve, 10000, 8000, 30000, 1.0, 0},
+    {"reversal", Linear, 10000, 8000, 30000, 1.0, 0},
+};
+
+// The drivers start on 1/8, M0 and M1 high
+static void setModePins()
+{
+    const int pins[] = {M0, M1, M2};
+    for (int pin : pins)
+    {
+        gpio_init(pin);
+        gpio_set_dir(pin, true);
+    }
+    gpio_put(M0, true);
+    gpio_put(M1, true);
+    gpio_put(M2, false);
+    Motor::setModePins(M0, M1, M2);
+}
+
+static void checkRun(const Run &run)
+{
+    HostSim::reset();
+    setModePins();
+    if (run.fullSteps)
+        HostSim::attachDriver(STEP_PIN, DIR_PIN, M0, M1, M2);
+
+    Options options;
+    options.startPosition = run.start;
+    options.jerk = JERK;
+    options.acceleration = ACCELERATION;
+    options.fullStepSpeed = run.fullSteps ? FULL_STEP_SPEED : 0;
+    Motor motor((Pins){STEP_PIN, DIR_PIN, ENABLE_PIN}, options, STEPS_PER_REVOLUTION, MAX_STEPS);
+
+    int target = run.target;
+    motor.runToTarget(run.speed, run.target, run.profile);
+    if (run.retargetAt > 0)
+    {
+        HostSim::runFor(run.retargetAt);
+        motor.runToTarget(run.speed, run.retarget, run.profile);
+        target = run.retarget;
+    }
+    check(HostSim::runUntilIdle(HostSim::now() + 120 * HostSim::TICKS_PER_SECOND), "%s %s: still going",
+          PROFILES[run.profile], run.name);
+    check(motor.getCurrentPosition() == target, "%s %s: ended at %d, not %d", PROFILES[run.profile], run.name,
+          motor.getCurrentPosition(), target);
+
+    PlanCheck planCheck = motor.getPlanCheck();
+    check(planCheck.segments > 0, "%s %s: no segments checked", PROFILES[run.profile], run.name);
+    check(planCheck.deviations == 0, "%s %s: %u segments off their position, by up to %d steps",
+          PROFILES[run.profile], run.name, planCheck.deviations, planCheck.maxDeviation);
+    check(planCheck.late == 0, "%s %s: %u segments late, by up to %d us", PROFILES[run.profile],
+          run.name, planCheck.late, planCheck.maxLate);
+
+    printf("%-9s %-10s %4u segments, %u off, %u late, latest %+6d us\n", PROFILES[run.profile], run.name,
+           planCheck.segments, planCheck.deviations, planCheck.late, planCheck.maxLate);
+
+    motor.resetPlanCheck();
+    planCheck = motor.getPlanCheck();
+    check(planCheck.segments == 0 && planCheck.endstopHits == 0, "%s %s: not cleared", PROFILES[run.profile],
+          run.name);
+}
+
+static void checkEndstops()
+{
+    HostSim::reset();
+    HostSim::setInput(ENDSTOP_PIN, OPEN);
+
+    Options options;
+    options.startPosition = 0;
+    options.endstop = ENDSTOP_PIN;
+    Motor motor((Pins){STEP_PIN, DIR_PIN, ENABLE_PIN}, options, STEPS_PER_REVOLUTION, MAX_STEPS);
+
+    uint64_t times[HITS];
+    for (int hit = 0 ; hit < HITS ; hit++)
+    {
+        HostSim::setInput(ENDSTOP_PIN, OPEN);
+        motor.runToTarget(2000, 100000);
+        HostSim::runFor(0.1);
+        times[hit] = time_us_64();
+        HostSim::setInput(ENDSTOP_PIN, HIT);
+        HostSim::runFor(0.01);
+        check(!motor.isRunning(), "hit %d: still running", hit);
+    }
+
+    PlanCheck planCheck = motor.getPlanCheck();
+    check(planCheck.endstopHits == HITS, "%u endstop hits, not %d", planCheck.endstopHits, HITS);
+
+    // Oldest first from the next slot, each just after the pin went low
+    for (int i = 0 ; i < ENDSTOP_EVENTS ; i++)
+    {
+        const EndstopEvent &event = planCheck.endstops[(planCheck.endstopHits + i) % ENDSTOP_EVENTS];
+        int hit = HITS - ENDSTOP_EVENTS + i;
+        check(event.time >= times[hit] && event.time < times[hit] + 10000, "event %d: at %llu us, the hit was at %llu",
+              i, (unsigned long long)event.time, (unsigned long long)times[hit]);
+        check(event.speed > 0, "event %d: no speed", i);
+    }
+    printf("endstops  %u hits, the last %d kept\n", planCheck.endstopHits, ENDSTOP_EVENTS);
+}
+
+int main()
+{
+    for (const Run &run : runs)
+        checkRun(run);
+    checkEndstops();
+
+    return checkResult("plan-check");
+}
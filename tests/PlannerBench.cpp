@@ -0,0 +1,42 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Time taken to plan a move, the motor's fixed point planner against the
+// double one it replaced. This runs on the host, which has an FPU, so the
+// doubles come out far cheaper than the soft float on the RP2040 and the
+// ratio says nothing about the target. It is here to catch the fixed point
+// planner getting slower.
+
+#include <chrono>
+#include <cstdio>
+#include "HostSim.h"
+#include "Motor.h"
+#include "ReferencePlanner.h"
+
+#define ROUNDS 20000
+
+int main()
+{
+    HostSim::reset();
+
+    Options options;
+    Motor motor((Pins){2, 3, 4}, options, 384000, 120000);
+
+    // Replanning on the way, like a client sending new targets
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0 ; i < ROUNDS ; i++)
+        motor.runToTarget(8000, 100000 + (i & 1) * 10000);
+    auto fixed = std::chrono::steady_clock::now() - start;
+
+    size_t entries = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0 ; i < ROUNDS ; i++)
+        entries += referencePlan({0, 248, true, true}, 8000, 100000 + (i & 1) * 10000, 8, 120000).size();
+    auto reference = std::chrono::steady_clock::now() - start;
+
+    printf("fixed point runToTarget  %8.0f ns\n", std::chrono::duration<double, std::nano>(fixed).count() / ROUNDS);
+    printf("double reference plan    %8.0f ns, %zu entries\n",
+           std::chrono::duration<double, std::nano>(reference).count() / ROUNDS, entries / ROUNDS);
+
+    return 0;
+}
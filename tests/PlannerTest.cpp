@@ -0,0 +1,204 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Runs trapezoid moves through the motor on the simulated PWM and timer, and
+// compares every step period with the planner the firmware had before speeds
+// went to fixed point, see ReferencePlanner.h.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <hardware/pwm.h>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+#include "ReferencePlanner.h"
+
+#define STEP_PIN 2
+#define DIR_PIN 3
+#define ENABLE_PIN 4
+
+#define STEPS_PER_REVOLUTION 384000
+#define MAX_STEPS 120000
+
+// From Motor.cpp
+#define MAX_WRAP 62500
+#define MIN_HZ 10
+
+// Slowest on the PWM, the divider of a plan is set by it
+static double slowestSpeed(const std::vector<RefStep> &steps)
+{
+    double slowest = INFINITY;
+    for (const RefStep &step : steps)
+    {
+        if (step.speed >= MIN_HZ)
+            slowest = std::min(slowest, step.speed);
+    }
+    return slowest;
+}
+
+// The slice is only switched on where a stretch on the PWM starts: at the
+// start, after a reversal and back from the timer
+static uint32_t pwmRuns(const std::vector<RefStep> &steps)
+{
+    uint32_t runs = 0;
+    for (size_t i = 0 ; i < steps.size() ; i++)
+    {
+        if (steps[i].speed >= MIN_HZ &&
+            (i == 0 || steps[i - 1].speed < MIN_HZ || steps[i - 1].direction != steps[i].direction))
+            runs++;
+    }
+    return runs;
+}
+
+struct Move
+{
+    const char *name;
+    int microsteps;
+    int start;
+    double speed;
+    int target;
+    double retargetAt;                      // Seconds into the move, 0 for none
+    double retargetSpeed;
+    int retarget;
+};
+
+static const Move moves[] = {
+    {"long move", 8, 0, 8000, 10000},
+    {"full travel", 8, 0, 8000, MAX_STEPS},
+    {"slow limit", 8, 0, 3000, 5000},
+    {"fractional limit", 8, 1000, 1234.5, 21000},
+    {"no room to reach the limit", 8, 0, 8000, 300},
+    {"short move", 8, 500, 8000, 400},
+    {"door move", 8, 0, 400, 4000},
+    {"below the PWM", 8, 0, 5, 200},
+    {"down to the timer", 8, 0, 1245, 10000},
+    {"backwards", 8, 50000, 8000, 20000},
+    {"16 microsteps", 16, 0, 16000, 40000},
+    {"past the end", 8, 100000, 8000, 200000},
+    {"longer on the way", 8, 0, 8000, 20000, 0.5, 8000, 30000},
+    {"faster on the way", 8, 0, 3000, 20000, 0.5, 8000, 20000},
+    {"slower on the way", 8, 0, 8000, 100000, 1.00005, 15, 5500},
+    {"overshoot", 8, 0, 8000, 20000, 1.5, 8000, 12000},
+    {"turned around", 8, 10000, 8000, 30000, 1.0, 8000, 0},
+};
+
+// A period comes out within a count of the PWM, whose divider fits the
+// slowest speed of the plan. Below MIN_HZ the timer counts microseconds.
+static double tolerance(double speed, double slowest)
+{
+    if (speed < MIN_HZ)
+        return 2e-6;
+    return 1.0 / (MAX_WRAP * slowest) + 1.0 / 125e6 + (1.0 / 4096) / (speed * speed);
+}
+
+static void runMove(const Move &move)
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = move.start;
+    options.microsteps = move.microsteps;
+    Motor motor((Pins){STEP_PIN, DIR_PIN, ENABLE_PIN}, options, STEPS_PER_REVOLUTION, MAX_STEPS);
+
+    uint64_t start = HostSim::now();
+    motor.runToTarget(move.speed, move.target);
+    std::vector<RefStep> expected = referenceSteps(referencePlan({move.start, 0, false, false}, move.speed,
+                                                                 move.target, move.microsteps, MAX_STEPS));
+    double slowest = slowestSpeed(expected);
+    int finalTarget = std::min(std::max(move.target, 0), MAX_STEPS);
+
+    // The step in progress when the new target comes goes on as it was, the
+    // new plan counts it as its first. A plan that needs a coarser divider
+    // restarts the slice, its first period follows on from the last step.
+    size_t transition = SIZE_MAX;
+    double transitionSpeed = 0;
+    uint32_t restarts = 0;
+    if (move.retargetAt > 0)
+    {
+        HostSim::runUntil(start + (uint64_t)(move.retargetAt * HostSim::TICKS_PER_SECOND));
+        size_t made = HostSim::pulseTimes(STEP_PIN).size();
+        check(made > 1 && made < expected.size(), "%s: %zu steps before the new target", move.name, made);
+        if (made <= 1 || made >= expected.size())
+            return;
+
+        RefState state = {motor.getCurrentPosition(), expected[made].speed, expected[made - 1].direction, true};
+        motor.runToTarget(move.retargetSpeed, move.retarget);
+        std::vector<RefStep> after = referenceSteps(referencePlan(state, move.retargetSpeed, move.retarget,
+                                                                  move.microsteps, MAX_STEPS));
+        transitionSpeed = std::min(expected[made - 1].speed, after[0].speed);
+        if (slowestSpeed(after) < slowest)
+            restarts++;
+        slowest = std::min(slowest, slowestSpeed(after));
+        expected.resize(made - 1);
+        expected.insert(expected.end(), after.begin(), after.end());
+        transition = made - 1;
+        finalTarget = std::min(std::max(move.retarget, 0), MAX_STEPS);
+    }
+
+    check(HostSim::runUntilIdle(start + 120 * HostSim::TICKS_PER_SECOND), "%s: still going after 2 minutes", move.name);
+    check(!motor.isRunning(), "%s: not stopped", move.name);
+    check(motor.getCurrentPosition() == finalTarget, "%s: ended at %d, not %d", move.name,
+          motor.getCurrentPosition(), finalTarget);
+
+    std::vector<uint64_t> times = HostSim::pulseTimes(STEP_PIN);
+    if (!check(times.size() == expected.size(), "%s: %zu steps, the reference made %zu", move.name, times.size(),
+               expected.size()))
+        return;
+
+    // The period of a step is the time to the next one, the last has none
+    int wrong = 0;
+    double worst = 0;
+    for (size_t i = 0 ; i + 1 < times.size() ; i++)
+    {
+        if (i == transition)
+        {
+            double period = (double)(times[i + 1] - times[i]) / HostSim::TICKS_PER_SECOND;
+            check(period <= 1.0 / transitionSpeed + tolerance(transitionSpeed, slowest),
+                  "%s: step %zu took %.9f s at the new target, no more than %.9f s wanted", move.name, i + 1, period,
+                  1.0 / transitionSpeed);
+            continue;
+        }
+
+        // Going over to the timer, the PWM finishes its period and the timer
+        // starts a whole one of its own from there
+        double wanted = 1.0 / expected[i].speed;
+        double allowed = tolerance(expected[i].speed, slowest);
+        if (expected[i].speed >= MIN_HZ && expected[i + 1].speed < MIN_HZ)
+        {
+            wanted += 1.0 / expected[i + 1].speed;
+            allowed += tolerance(expected[i + 1].speed, slowest);
+        }
+
+        double period = (double)(times[i + 1] - times[i]) / HostSim::TICKS_PER_SECOND;
+        double error = fabs(period - wanted);
+        worst = std::max(worst, error / wanted);
+        if (error > allowed)
+        {
+            if (wrong++ < 5)
+                check(false, "%s: step %zu took %.9f s, %.3f Hz, the reference runs it at %.3f Hz", move.name, i + 1,
+                      period, 1.0 / period, expected[i].speed);
+        }
+    }
+    check(wrong == 0, "%s: %d of %zu steps off the reference", move.name, wrong, times.size());
+
+    // New entries and new targets follow on at the wrap, the running slice
+    // is left alone
+    uint slice = pwm_gpio_to_slice_num(STEP_PIN);
+    uint32_t runs = pwmRuns(expected) + restarts;
+    check(HostSim::pwmStarts(slice) == runs && HostSim::pwmStops(slice) == runs,
+          "%s: the PWM started %u and stopped %u times for %u runs", move.name, HostSim::pwmStarts(slice),
+          HostSim::pwmStops(slice), runs);
+
+    printf("%-28s %6zu steps, %.3f s, worst period error %.2e\n", move.name, times.size(),
+           (double)(times.back() - times.front()) / HostSim::TICKS_PER_SECOND, worst);
+}
+
+int main()
+{
+    for (const Move &move : moves)
+        runMove(move);
+
+    return checkResult("planner");
+}
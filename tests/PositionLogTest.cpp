@@ -0,0 +1,96 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// The position log on a simulated flash sector. Anything but a clean last
+// record has to give a cold start, and the sector is only erased when the
+// log wraps.
+
+#include <cstdio>
+#include <cstring>
+#include <hardware/flash.h>
+#include "HostSim.h"
+#include "PositionLog.h"
+#include "Check.h"
+
+#define SECTOR (hostFlash + PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+
+// 32 byte records
+#define SLOTS (FLASH_SECTOR_SIZE / 32)
+
+static void checkRoundTrip()
+{
+    HostSim::eraseFlash();
+
+    int positions[POSITION_LOG_AXES] = {1, 2};
+    check(!PositionLog::load(positions), "an erased sector loaded");
+
+    const int saved[POSITION_LOG_AXES] = {12345, -678};
+    PositionLog::save(saved);
+    check(PositionLog::isSaved(saved), "not saved after a save");
+    check(PositionLog::load(positions) && positions[0] == 12345 && positions[1] == -678, "loaded %d, %d",
+          positions[0], positions[1]);
+
+    PositionLog::markMoving();
+    check(!PositionLog::isSaved(saved), "still saved once moving");
+    check(!PositionLog::load(positions), "a stale record loaded");
+
+    // A stale record stays stale, marking it again writes nothing
+    uint32_t programs = HostSim::flashPrograms();
+    PositionLog::markMoving();
+    check(HostSim::flashPrograms() == programs, "a stale record was marked again");
+}
+
+static void checkWear()
+{
+    HostSim::eraseFlash();
+
+    int positions[POSITION_LOG_AXES];
+    PositionLog::load(positions);
+    for (int i = 0 ; i < 300 ; i++)
+    {
+        const int saved[POSITION_LOG_AXES] = {i, -i};
+        PositionLog::save(saved);
+        PositionLog::markMoving();
+    }
+    const int last[POSITION_LOG_AXES] = {300, -300};
+    PositionLog::save(last);
+
+    check(PositionLog::load(positions) && positions[0] == 300, "loaded %d after wrapping", positions[0]);
+    check(HostSim::flashErases() == 301 / SLOTS, "%u erases for 301 saves", HostSim::flashErases());
+    printf("301 saves and 300 marks: %u page programs, %u sector erases\n", HostSim::flashPrograms(),
+           HostSim::flashErases());
+}
+
+static void checkDamage()
+{
+    int positions[POSITION_LOG_AXES];
+
+    // A torn write, one word of the record cleared
+    HostSim::eraseFlash();
+    PositionLog::load(positions);
+    const int saved[POSITION_LOG_AXES] = {100, 200};
+    PositionLog::save(saved);
+    SECTOR[8] = 0;
+    check(!PositionLog::load(positions), "a corrupted record loaded");
+
+    // Something else's data in the sector
+    HostSim::eraseFlash();
+    for (size_t i = 0 ; i < FLASH_SECTOR_SIZE ; i++)
+        SECTOR[i] = (uint8_t)(i * 7 + 3);
+    check(!PositionLog::load(positions), "foreign data loaded");
+
+    // The next save erases and starts again at the first slot
+    PositionLog::save(saved);
+    check(HostSim::flashErases() == 1, "%u erases after foreign data", HostSim::flashErases());
+    check(SECTOR[32] == 0xff, "the slot after the first was not erased");
+    check(PositionLog::load(positions) && positions[0] == 100, "the save after foreign data did not load");
+}
+
+int main()
+{
+    checkRoundTrip();
+    checkWear();
+    checkDamage();
+
+    return checkResult("position log");
+}
@@ -0,0 +1,127 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Positions and arrival times predicted from the plan as it starts, against
+// the steps the PWM makes afterwards.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define STEP_PIN 2
+#define DIR_PIN 3
+#define ENABLE_PIN 4
+
+#define STEPS_PER_REVOLUTION 384000
+#define MAX_STEPS 240000
+
+#define SPEED 8000
+#define ACCELERATION 24000
+#define JERK 64
+
+static const char *const PROFILES[] = {"trapezoid", "s-curve", "linear"};
+
+// Times the position is predicted at along a move
+#define SAMPLES 200
+
+// How far off the prediction may be, microseconds and steps, and the
+// resolution the arrival is found with
+#define ARRIVAL_ERROR 1000
+#define ARRIVAL_STEP 10
+#define POSITION_ERROR 8
+
+struct Prediction
+{
+    double arrival;                         // Predicted arrival minus the actual one, microseconds
+    int position;                           // Largest position error, steps
+};
+
+static Motor *makeMotor(int start)
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = start;
+    options.jerk = JERK;
+    options.acceleration = ACCELERATION;
+    return new Motor((Pins){STEP_PIN, DIR_PIN, ENABLE_PIN}, options, STEPS_PER_REVOLUTION, MAX_STEPS);
+}
+
+// Predicts the plan the motor is on now at SAMPLES times, then runs it to
+// each of them and compares. Like the plan, the motor counts a step when
+// its period is over, and it arrives when the last one is.
+static Prediction follow(Motor *motor, const char *name, int target)
+{
+    absolute_time_t now = time_us_64();
+    absolute_time_t arrival = motor->arrivalTime();
+    std::vector<int> predicted;
+    for (int i = 0 ; i < SAMPLES ; i++)
+        predicted.push_back(motor->positionAt(now + (arrival - now) * i / SAMPLES));
+
+    Prediction result = {0, 0};
+    for (int i = 0 ; i < SAMPLES ; i++)
+    {
+        HostSim::runUntil((now + (arrival - now) * i / SAMPLES) * HostSim::TICKS_PER_US);
+        result.position = std::max(result.position, abs(predicted[i] - motor->getCurrentPosition()));
+    }
+
+    uint64_t limit = HostSim::now() + 120 * HostSim::TICKS_PER_SECOND;
+    while (motor->getCurrentPosition() != target && HostSim::now() < limit)
+        HostSim::runUntil(HostSim::now() + ARRIVAL_STEP * HostSim::TICKS_PER_US);
+    result.arrival = (double)arrival - (double)HostSim::now() / HostSim::TICKS_PER_US;
+
+    check(HostSim::runUntilIdle(limit), "%s: still going", name);
+    check(motor->getCurrentPosition() == target, "%s: ended at %d, not %d", name, motor->getCurrentPosition(),
+          target);
+    return result;
+}
+
+static void report(const char *name, const Prediction &prediction)
+{
+    check(fabs(prediction.arrival) <= ARRIVAL_ERROR, "%s: arrival off by %.0f us", name, prediction.arrival);
+    check(prediction.position <= POSITION_ERROR, "%s: position off by %d steps", name, prediction.position);
+    printf("%-28s arrival %+7.1f us, position within %d steps\n", name, prediction.arrival, prediction.position);
+}
+
+static void checkMove(Profile profile, int distance)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s %d steps", PROFILES[profile], distance);
+
+    Motor *motor = makeMotor(0);
+    motor->runToTarget(SPEED, distance, profile);
+    report(name, follow(motor, name, distance));
+    delete motor;
+}
+
+// A new target the other way, predicted from the plan that turns round
+static void checkReversal(Profile profile)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s reversal", PROFILES[profile]);
+
+    Motor *motor = makeMotor(10000);
+    motor->runToTarget(SPEED, 30000, profile);
+    HostSim::runFor(1.0);
+    motor->runToTarget(SPEED, 0, profile);
+    report(name, follow(motor, name, 0));
+    delete motor;
+}
+
+int main()
+{
+    const Profile profiles[] = {Trapezoid, SCurve, Linear};
+    const int distances[] = {300, 2000, 20000, 200000};
+    for (Profile profile : profiles)
+    {
+        for (int distance : distances)
+            checkMove(profile, distance);
+        checkReversal(profile);
+    }
+
+    return checkResult("prediction");
+}
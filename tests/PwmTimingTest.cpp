@@ -0,0 +1,79 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// The PWM period of every step against the exact quotient it stands for,
+// (TOP + 1) = clock * 16 / (div * speed), for the divider the plan runs on.
+// The speed limits are swept from 10 Hz to 32 kHz, the ramps to each limit
+// add the speeds in between.
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+#include "ReferencePlanner.h"
+
+#define CLOCK 125000000
+#define MIN_HZ 10
+#define LIMITS 2000
+
+// Largest period error against the speed asked for
+static double worst = 0;
+
+static int checkLimit(double limit)
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = 0;
+    Motor motor((Pins){2, 3, 4}, options, 384000, 120000);
+
+    // Room to ramp up and down and cruise a little
+    int target = (int)std::min(120000.0, 2 * ceil(limit / 248) * 40 + 400);
+    motor.runToTarget(limit, target);
+    HostSim::runUntilIdle(HostSim::now() + 120 * HostSim::TICKS_PER_SECOND);
+    check(motor.getCurrentPosition() == target, "%.3f Hz: ended at %d, not %d", limit, motor.getCurrentPosition(), target);
+
+    std::vector<RefStep> expected = referenceSteps(referencePlan({0, 0, false, false}, limit, target, 8, 120000));
+    std::vector<uint64_t> times = HostSim::pulseTimes(2);
+    if (!check(times.size() == expected.size(), "%.3f Hz: %zu steps, the reference made %zu", limit, times.size(),
+               expected.size()))
+        return 0;
+
+    // One divider for the whole plan
+    uint64_t div = pwm_hw->slice[pwm_gpio_to_slice_num(2)].div;
+
+    int checked = 0;
+    for (size_t i = 0 ; i + 1 < times.size() ; i++)
+    {
+        if (expected[i].speed < MIN_HZ || expected[i + 1].speed < MIN_HZ)
+            continue;
+
+        uint64_t speed = (uint64_t)doubleToFixed(expected[i].speed);
+        uint64_t counts = ((uint64_t)CLOCK * 16 << FIXED_SHIFT) / (div * speed);
+        uint64_t ticks = times[i + 1] - times[i];
+        if (!check(ticks == counts * div, "%.3f Hz: step %zu at %.3f Hz took %llu counts of %llu/16, not %llu", limit,
+                   i + 1, expected[i].speed, (unsigned long long)(ticks / div), (unsigned long long)div,
+                   (unsigned long long)counts))
+            return checked;
+        worst = std::max(worst, fabs((double)ticks / CLOCK / 16 * expected[i].speed - 1));
+        checked++;
+    }
+    return checked;
+}
+
+int main()
+{
+    int checked = 0;
+    for (int i = 0 ; i < LIMITS ; i++)
+    {
+        // Not round numbers, the fractions have to come out right too
+        double limit = 10 * pow(3200, (i + 0.37) / LIMITS);
+        checked += checkLimit(limit);
+    }
+    printf("%d step periods at %d speed limits from 10 Hz to 32 kHz, worst error %.4f%%\n", checked, LIMITS,
+           worst * 100);
+
+    return checkResult("pwm timing");
+}
@@ -0,0 +1,123 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Queued targets against waiting for each move to end before the next.
+// Every run has to pass each target in order and stop on the last one.
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define STEP_PIN 2
+#define SPEED 8000
+#define JERK 64
+
+#define LEGS 4
+#define LEG_STEPS 2000
+
+#define TICKS 8
+#define TICK_STEPS 500
+#define TICK_SECONDS 0.25
+
+// Seconds from the first target to the end of the last move. Target i is
+// handed over at arrivals[i] seconds, when queueing, or once the motor is
+// stopped and that time has come, when waiting.
+static double runTargets(const std::vector<int> &targets, const std::vector<double> &arrivals, Profile profile,
+                         bool queue)
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = 0;
+    options.jerk = JERK;
+    Motor motor((Pins){STEP_PIN, 3, 4}, options, 384000, 384000);
+
+    uint64_t start = HostSim::now();
+    uint64_t limit = start + 120 * HostSim::TICKS_PER_SECOND;
+    std::vector<int> reached;
+    for (size_t i = 0 ; i < targets.size() ; i++)
+    {
+        HostSim::runUntil(start + (uint64_t)(arrivals[i] * HostSim::TICKS_PER_SECOND));
+        if (queue)
+        {
+            check(motor.queueTarget(SPEED, targets[i], profile), "target %zu refused", i);
+            continue;
+        }
+
+        HostSim::runUntilIdle(limit);
+        reached.push_back(motor.getCurrentPosition());
+        motor.runToTarget(SPEED, targets[i], profile);
+    }
+    check(HostSim::runUntilIdle(limit), "still going after 2 minutes");
+    check(motor.getCurrentPosition() == targets.back(), "ended at %d, not %d", motor.getCurrentPosition(),
+          targets.back());
+    check(motor.queuedTargets() == 0, "%d targets left queued", motor.queuedTargets());
+
+    // Every target is on the way, the pulses only ever go forward here
+    check(HostSim::pulseTimes(STEP_PIN).size() == (size_t)targets.back(), "%zu steps for %d",
+          HostSim::pulseTimes(STEP_PIN).size(), targets.back());
+    if (!queue)
+        for (size_t i = 1 ; i < reached.size() ; i++)
+            check(reached[i] == targets[i - 1], "waited at %d, not %d", reached[i], targets[i - 1]);
+
+    return (double)(HostSim::now() - start) / HostSim::TICKS_PER_SECOND;
+}
+
+static void compare(const char *name, const std::vector<int> &targets, const std::vector<double> &arrivals)
+{
+    const Profile profiles[] = {Trapezoid, SCurve};
+    for (Profile profile : profiles)
+    {
+        double waiting = runTargets(targets, arrivals, profile, false);
+        double queued = runTargets(targets, arrivals, profile, true);
+        check(queued < waiting, "%s: queued %.3f s, waiting %.3f s", name, queued, waiting);
+        printf("%-28s %-9s  waiting %6.3f s, queued %6.3f s\n", name, profile == SCurve ? "s-curve" : "trapezoid",
+               waiting, queued);
+    }
+}
+
+// A full queue refuses the next target and keeps what it has
+static void checkFull()
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = 0;
+    Motor motor((Pins){STEP_PIN, 3, 4}, options, 384000, 384000);
+
+    for (int i = 1 ; i <= TARGET_QUEUE ; i++)
+        check(motor.queueTarget(SPEED, i * LEG_STEPS), "target %d refused", i);
+    check(!motor.queueTarget(SPEED, (TARGET_QUEUE + 1) * LEG_STEPS), "a full queue took one more");
+    check(motor.queuedTargets() == TARGET_QUEUE, "%d queued", motor.queuedTargets());
+
+    check(HostSim::runUntilIdle(HostSim::now() + 120 * HostSim::TICKS_PER_SECOND), "full: still going");
+    check(motor.getCurrentPosition() == TARGET_QUEUE * LEG_STEPS, "full: ended at %d", motor.getCurrentPosition());
+}
+
+int main()
+{
+    std::vector<int> legs;
+    std::vector<double> together;
+    for (int i = 1 ; i <= LEGS ; i++)
+    {
+        legs.push_back(i * LEG_STEPS);
+        together.push_back(0);
+    }
+    compare("4 x 2000 steps", legs, together);
+
+    std::vector<int> ticks;
+    std::vector<double> every;
+    for (int i = 1 ; i <= TICKS ; i++)
+    {
+        ticks.push_back(i * TICK_STEPS);
+        every.push_back((i - 1) * TICK_SECONDS);
+    }
+    compare("500 steps every 0.25 s", ticks, every);
+
+    checkFull();
+
+    return checkResult("queue");
+}
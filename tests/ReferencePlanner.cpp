@@ -0,0 +1,146 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <cmath>
+#include <cstdlib>
+#include "ReferencePlanner.h"
+
+std::vector<RefEntry> referencePlan(RefState state, double targetSpeed, int target, int microsteps, int maxSteps)
+{
+    const int speedStep = 31 * microsteps;
+    const int pulses = 5 * microsteps;
+    // The original truncated to whole Hz first, so a limit just above a
+    // multiple of the speed step counted one ramp entry short of the ones
+    // it planned. Counted in full as the fixed point planner does.
+    auto deltaSteps = [&](double delta) { return (int)ceil(delta / speedStep); };
+
+    std::vector<RefEntry> plan;
+    int motor_position = state.position;
+    auto add = [&](double speed, int steps, bool direction)
+    {
+        plan.push_back({speed, steps, direction});
+        motor_position = direction ? motor_position + steps : motor_position - steps;
+    };
+
+    if (target < 0.001)
+        target = 0;
+    if (target > maxSteps)
+        target = maxSteps;
+
+    int dist = target - state.position;
+    bool newDirection = dist > 0;
+
+    if (state.position == target && !state.running)
+        return plan;
+
+    double newSpeed = state.speed;
+    bool direction = state.direction;
+
+    if (state.running && newDirection != direction)
+    {
+        do
+        {
+            newSpeed -= speedStep;
+            if (newSpeed < 0)
+                newSpeed = 0;
+            add(newSpeed, newSpeed > 0 ? pulses : 0, direction);
+        } while (newSpeed > 0.0);
+
+        direction = newDirection;
+    }
+
+    dist = target - motor_position;
+    newDirection = dist > 0;
+    dist = abs(dist);
+
+    if (dist == 0)
+    {
+        add(-1, 0, direction);
+        return plan;
+    }
+
+    int maxsteps = dist / pulses;
+    int ramp_steps = deltaSteps(newSpeed);
+    if (maxsteps < ramp_steps)
+    {
+        while (newSpeed > 0)
+        {
+            newSpeed -= speedStep;
+            if (newSpeed < 0)
+                newSpeed = 0;
+            add(newSpeed, newSpeed > 0 ? pulses : 0, newDirection);
+        }
+    }
+
+    dist = target - motor_position;
+    newDirection = dist > 0;
+    dist = abs(dist);
+    maxsteps = dist / pulses;
+    ramp_steps = deltaSteps(newSpeed);
+    int steps_left = maxsteps - ramp_steps;
+
+    double max_speed = (int)newSpeed + speedStep * ((double)steps_left / 2);
+    if (max_speed > targetSpeed)
+        max_speed = targetSpeed;
+
+    if (maxsteps < 5)
+    {
+        add(200, dist, newDirection);
+        add(0, 0, newDirection);
+    }
+    else
+    {
+        if (max_speed <= newSpeed)
+        {
+            // The original left the ramp down out of this and ran past the
+            // target when slowing to the new limit. Counted as the fixed
+            // point planner does since the target queue.
+            ramp_steps = deltaSteps(newSpeed - max_speed);
+            ramp_steps += deltaSteps(max_speed);
+            while (newSpeed > max_speed)
+            {
+                newSpeed -= speedStep;
+                if (newSpeed < max_speed)
+                    newSpeed = max_speed;
+                add(newSpeed, pulses, newDirection);
+            }
+        }
+        else
+        {
+            ramp_steps = deltaSteps(max_speed - newSpeed);
+            ramp_steps += deltaSteps(max_speed);
+            while (newSpeed < max_speed)
+            {
+                newSpeed += speedStep;
+                if (newSpeed > max_speed)
+                    newSpeed = max_speed;
+                add(newSpeed, pulses, newDirection);
+            }
+        }
+
+        ramp_steps--;
+        add(newSpeed, dist - ramp_steps * pulses, newDirection);
+
+        while (newSpeed > 0.0)
+        {
+            newSpeed -= speedStep;
+            if (newSpeed < 0)
+                newSpeed = 0;
+            add(newSpeed, newSpeed > 0 ? pulses : 0, newDirection);
+        }
+    }
+
+    add(-1, 0, direction);
+    return plan;
+}
+
+std::vector<RefStep> referenceSteps(const std::vector<RefEntry> &plan)
+{
+    std::vector<RefStep> steps;
+    for (const RefEntry &entry : plan)
+    {
+        for (int i = 0 ; entry.speed > 0 && i < entry.steps ; i++)
+            steps.push_back({entry.speed, entry.direction});
+    }
+    return steps;
+}
@@ -0,0 +1,39 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_REFERENCEPLANNER_H
+#define PILOMAR_REFERENCEPLANNER_H
+
+#include <vector>
+
+// The trapezoid planner as it was before speeds went to fixed point, kept
+// to hold the motor's plans against
+
+struct RefEntry
+{
+    double speed;                           // -1 ends the plan
+    int steps;
+    bool direction;
+};
+
+struct RefState
+{
+    int position;
+    double speed;
+    bool direction;
+    bool running;
+};
+
+struct RefStep
+{
+    double speed;
+    bool direction;
+};
+
+// Motor::runToTarget() with doubles, from before the fixed point planner
+std::vector<RefEntry> referencePlan(RefState state, double targetSpeed, int target, int microsteps, int maxSteps);
+
+// One entry per step, in the order they are made
+std::vector<RefStep> referenceSteps(const std::vector<RefEntry> &plan);
+
+#endif //PILOMAR_REFERENCEPLANNER_H
@@ -0,0 +1,91 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// S-curve moves against trapezoid ones over the same distances. Both have to
+// end on target. The speed of each plan entry is read back from the pulse
+// times, and the change of the speed step from one entry to the next is the
+// jerk the driver sees. For the S-curve it stays within Options.jerk.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define STEP_PIN 2
+#define JERK 64
+#define SPEED 8000
+
+// Speed steps of a few Hz at 8000 Hz are PWM rounding, not a new entry
+#define QUANTUM 0.004
+
+// S-curve plan entries are SPEED_STEP_PULSES long, 5 steps a microstep
+#define ENTRY_STEPS (5 * 8)
+
+struct Result
+{
+    double seconds;
+    double peak;                            // Largest speed step
+    double jerk;                            // Largest change of the speed step
+};
+
+static Result runMove(int distance, Profile profile)
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = 0;
+    options.jerk = JERK;
+    Motor motor((Pins){STEP_PIN, 3, 4}, options, 384000, 384000);
+
+    uint64_t start = HostSim::now();
+    motor.runToTarget(SPEED, distance, profile);
+    check(HostSim::runUntilIdle(start + 120 * HostSim::TICKS_PER_SECOND), "%d steps: still going after 2 minutes",
+          distance);
+    check(motor.getCurrentPosition() == distance, "%d steps: ended at %d", distance, motor.getCurrentPosition());
+
+    std::vector<uint64_t> times = HostSim::pulseTimes(STEP_PIN);
+    Result result = {(double)(HostSim::now() - start) / HostSim::TICKS_PER_SECOND, 0, 0};
+    if (times.size() < 2)
+        return result;
+
+    // Both profiles start and stop at the planner's start speed, that jump
+    // is not part of the ramp
+    std::vector<double> speeds;
+    for (size_t i = 0 ; i + 1 < times.size() ; i += ENTRY_STEPS)
+        speeds.push_back((double)HostSim::TICKS_PER_SECOND / (double)(times[i + 1] - times[i]));
+
+    double last = 0;
+    for (size_t i = 0 ; i + 1 < speeds.size() ; i++)
+    {
+        double step = speeds[i + 1] - speeds[i];
+        if (fabs(step) <= QUANTUM * std::max(speeds[i], speeds[i + 1]))
+            step = 0;
+        result.peak = std::max(result.peak, fabs(step));
+        result.jerk = std::max(result.jerk, fabs(step - last));
+        last = step;
+    }
+    return result;
+}
+
+int main()
+{
+    const int distances[] = {300, 2000, 20000, 100000, 383999};
+    for (int distance : distances)
+    {
+        Result trapezoid = runMove(distance, Trapezoid);
+        Result curve = runMove(distance, SCurve);
+
+        check(curve.jerk <= JERK + QUANTUM * SPEED, "%d steps: the S-curve speed step changed by %.1f Hz", distance,
+              curve.jerk);
+        check(curve.peak <= trapezoid.peak + QUANTUM * SPEED, "%d steps: the S-curve speed step reached %.1f Hz",
+              distance, curve.peak);
+
+        printf("%6d steps  trapezoid %7.3f s, jerk %5.1f Hz   s-curve %7.3f s, jerk %5.1f Hz\n", distance,
+               trapezoid.seconds, trapezoid.jerk, curve.seconds, curve.jerk);
+    }
+
+    return checkResult("s-curve");
+}
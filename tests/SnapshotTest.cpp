@@ -0,0 +1,165 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Snapshots taken all along moves of every kind, against the motors'
+// counted positions at the same time. On the PWM the snapshot is only
+// published when the rate changes, the steps in between are worked out
+// from the rate. They may be a step apart where an entry changes, on full
+// steps that is a full step of microsteps.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <hardware/gpio.h>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define FIRST_STEP_PIN 2
+#define FIRST_DIR_PIN 3
+#define SECOND_STEP_PIN 6
+#define SECOND_DIR_PIN 7
+
+#define M0 12
+#define M1 13
+#define M2 14
+
+#define STEPS_PER_REVOLUTION 384000
+#define MAX_STEPS 240000
+
+#define ACCELERATION 24000
+#define JERK 64
+#define FULL_STEP_SPEED 4000
+
+// Not a divisor of any step period
+#define SAMPLE_US 1379
+
+// Microsteps to a step on full steps, the drivers are on 1/8
+#define FULL_STEP 8
+
+enum Kind
+{
+    Move,
+    Coordinated,
+    Velocity
+};
+
+struct Run
+{
+    const char *name;
+    Kind kind;
+    Profile profile;
+    double speed;
+    int target;
+    bool fullSteps;
+};
+
+static const Run runs[] = {
+    {"trapezoid", Move, Trapezoid, 8000, 50000},
+    {"s-curve", Move, SCurve, 8000, 50000},
+    {"linear", Move, Linear, 8000, 50000},
+    {"below the PWM", Move, Trapezoid, 5, 100},
+    {"full steps", Move, Trapezoid, 24000, 200000, true},
+    {"coordinated", Coordinated, Trapezoid, 8000, 50000},
+    {"velocity", Velocity, Trapezoid, 3000, 0},
+};
+
+// The drivers start on 1/8, M0 and M1 high
+static void setModePins()
+{
+    const int pins[] = {M0, M1, M2};
+    for (int pin : pins)
+    {
+        gpio_init(pin);
+        gpio_set_dir(pin, true);
+    }
+    gpio_put(M0, true);
+    gpio_put(M1, true);
+    gpio_put(M2, false);
+    Motor::setModePins(M0, M1, M2);
+}
+
+static Motor *makeMotor(int step, int dir, bool fullSteps)
+{
+    if (fullSteps)
+        HostSim::attachDriver(step, dir, M0, M1, M2);
+
+    Options options;
+    options.startPosition = 0;
+    options.jerk = JERK;
+    options.acceleration = ACCELERATION;
+    options.fullStepSpeed = fullSteps ? FULL_STEP_SPEED : 0;
+    return new Motor((Pins){step, dir, 4}, options, STEPS_PER_REVOLUTION, MAX_STEPS);
+}
+
+static void checkRun(const Run &run)
+{
+    HostSim::reset();
+    setModePins();
+    Motor *motors[2] = {makeMotor(FIRST_STEP_PIN, FIRST_DIR_PIN, run.fullSteps),
+                        makeMotor(SECOND_STEP_PIN, SECOND_DIR_PIN, run.fullSteps)};
+
+    switch (run.kind)
+    {
+    case Move:
+        motors[0]->runToTarget(run.speed, run.target, run.profile);
+        break;
+    case Coordinated:
+        Motor::runCoordinated(motors[0], run.target, motors[1], run.target / 3, run.speed, run.profile);
+        break;
+    case Velocity:
+        motors[0]->runAtVelocity(run.speed);
+        break;
+    }
+
+    uint64_t limit = HostSim::now() + 120 * HostSim::TICKS_PER_SECOND;
+    uint64_t stopAt = HostSim::now() + 5 * HostSim::TICKS_PER_SECOND;
+    int allowed = run.fullSteps ? FULL_STEP : 1;
+    int worst = 0;
+    int samples = 0;
+    bool stopping = false;
+    while ((motors[0]->isRunning() || motors[1]->isRunning()) && HostSim::now() < limit)
+    {
+        if (run.kind == Velocity && !stopping && HostSim::now() >= stopAt)
+        {
+            motors[0]->runAtVelocity(0);
+            stopping = true;
+        }
+
+        HostSim::runUntil(HostSim::now() + SAMPLE_US * HostSim::TICKS_PER_US);
+        MotorSnapshot snapshots[2];
+        Motor::snapshot(motors, snapshots, 2);
+        for (int i = 0 ; i < 2 ; i++)
+        {
+            int off = abs(snapshots[i].position - motors[i]->getCurrentPosition());
+            worst = std::max(worst, off);
+            if (off > allowed)
+                check(false, "%s: motor %d at %d, the snapshot says %d", run.name, i,
+                      motors[i]->getCurrentPosition(), snapshots[i].position);
+        }
+        samples++;
+        if (worst > allowed)
+            break;
+    }
+    check(!motors[0]->isRunning() && !motors[1]->isRunning(), "%s: still going", run.name);
+
+    // Standing still the snapshot is exact
+    MotorSnapshot snapshots[2];
+    Motor::snapshot(motors, snapshots, 2);
+    for (int i = 0 ; i < 2 ; i++)
+        check(snapshots[i].position == motors[i]->getCurrentPosition() && !snapshots[i].running,
+              "%s: motor %d stopped at %d, the snapshot says %d", run.name, i, motors[i]->getCurrentPosition(),
+              snapshots[i].position);
+
+    printf("%-14s %6d snapshots, within %d microsteps\n", run.name, samples, worst);
+    delete motors[0];
+    delete motors[1];
+}
+
+int main()
+{
+    for (const Run &run : runs)
+        checkRun(run);
+
+    return checkResult("snapshot");
+}
@@ -0,0 +1,91 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Trajectory playback along a sine, one point a second with the velocity
+// given. The motor has to follow the curve and stop on the last point.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <pico/time.h>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define STEP_PIN 2
+
+#define SECONDS 60
+#define PERIOD 60.0
+
+// Where the curve starts and is centered
+#define CENTER 50000
+
+// How often the position is compared with the curve
+#define SAMPLE_MS 10
+
+struct Sine
+{
+    int amplitude;
+    double settle;                          // Seconds of start transient not counted
+    double within;                          // Largest error allowed after it, steps
+};
+
+static const Sine sines[] = {{2000, 0, 4}, {20000, 5, 15}};
+
+static double sinePosition(const Sine &sine, double t)
+{
+    return CENTER + sine.amplitude * sin(2 * M_PI * t / PERIOD);
+}
+
+static double sineVelocity(const Sine &sine, double t)
+{
+    return sine.amplitude * 2 * M_PI / PERIOD * cos(2 * M_PI * t / PERIOD);
+}
+
+static void checkSine(const Sine &sine)
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = CENTER;
+    Motor motor((Pins){STEP_PIN, 3, 4}, options, 384000, 120000);
+
+    absolute_time_t start = get_absolute_time();
+    int last = CENTER;
+    for (int t = 0 ; t <= SECONDS ; t++)
+    {
+        last = (int)lround(sinePosition(sine, t));
+        check(motor.queueTrajectoryPoint(delayed_by_us(start, t * 1000000ull), last, sineVelocity(sine, t), true),
+              "%d steps: point %d refused", sine.amplitude, t);
+    }
+    check(motor.trajectoryEndPosition() == last, "%d steps: ends at %d, not %d", sine.amplitude,
+          motor.trajectoryEndPosition(), last);
+    check(!motor.queueTrajectoryPoint(delayed_by_us(start, SECONDS * 1000000ull), CENTER, 0, false),
+          "%d steps: a point no later than the last taken", sine.amplitude);
+
+    double worst = 0;
+    for (int ms = SAMPLE_MS ; ms <= SECONDS * 1000 ; ms += SAMPLE_MS)
+    {
+        HostSim::runUntil(HostSim::TICKS_PER_US * (start + ms * 1000ull));
+        double t = ms / 1000.0;
+        if (t >= sine.settle)
+            worst = std::max(worst, fabs(motor.getCurrentPosition() - sinePosition(sine, t)));
+    }
+
+    check(HostSim::runUntilIdle(HostSim::now() + 60 * HostSim::TICKS_PER_SECOND), "%d steps: still going",
+          sine.amplitude);
+    check(motor.getCurrentPosition() == last, "%d steps: ended at %d, not %d", sine.amplitude,
+          motor.getCurrentPosition(), last);
+    check(motor.trajectoryEndPosition() == -1, "%d steps: %d points left", sine.amplitude,
+          motor.trajectoryPoints());
+    check(worst <= sine.within, "%d steps: %.1f steps off the curve", sine.amplitude, worst);
+    printf("%5d step amplitude: within %.1f steps after %.0f s\n", sine.amplitude, worst, sine.settle);
+}
+
+int main()
+{
+    for (const Sine &sine : sines)
+        checkSine(sine);
+
+    return checkResult("trajectory");
+}
@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Velocity mode against rate * time, on the PWM and on the timer below
+// MIN_HZ, and handing over to a plan. The position has to count every
+// pulse the driver sees.
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "HostSim.h"
+#include "Motor.h"
+#include "Check.h"
+
+#define STEP_PIN 2
+
+// Parts per million the average rate may be off
+#define RATE_PPM 0.1
+
+struct Rate
+{
+    double rate;                            // Steps per second
+    double seconds;                         // Simulated time to run for
+};
+
+// Sidereal-type rates and ones either side of MIN_HZ, each for up to an
+// hour or about 2M steps
+static const Rate rates[] = {{0.0123, 3600}, {4.456, 3600}, {9.99, 3600}, {1234.57, 1620}, {7999.9, 250}};
+
+// Half a step at 4 Hz is 125 ms, these land on either half
+static const double takeovers[] = {0.05, 0.1, 0.2, 0.3, 0.4, 0.6, 1.1, 1.2};
+
+static void checkRate(const Rate &run)
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = 0;
+    Motor motor((Pins){STEP_PIN, 3, 4}, options, 384000, 120000000);
+
+    check(motor.runAtVelocity(run.rate), "%.4f steps/s refused", run.rate);
+    HostSim::runFor(run.seconds);
+
+    // From past the ramp to the last pulse
+    std::vector<uint64_t> times = HostSim::pulseTimes(STEP_PIN);
+    if (!check(times.size() > 10, "%.4f steps/s: %zu pulses", run.rate, times.size()))
+        return;
+
+    size_t first = times.size() / 10;
+    double seconds = (double)(times.back() - times[first]) / HostSim::TICKS_PER_SECOND;
+    double measured = (double)(times.size() - 1 - first) / seconds;
+    double ppm = fabs(measured - run.rate) / run.rate * 1e6;
+    check(ppm < RATE_PPM, "%.4f steps/s: ran at %.9f", run.rate, measured);
+    printf("%10.4f steps/s  %8zu pulses in %6.0f s, %.4f ppm off\n", run.rate, times.size(), run.seconds, ppm);
+}
+
+static void checkTakeover(double after)
+{
+    HostSim::reset();
+
+    Options options;
+    options.startPosition = 1000;
+    Motor motor((Pins){STEP_PIN, 3, 4}, options, 384000, 120000);
+
+    motor.runAtVelocity(4);
+    HostSim::runFor(after);
+
+    // The plan ramps down to the 4 Hz it started from, the last steps take
+    // a while
+    motor.runToTarget(8000, 2000);
+    check(HostSim::runUntilIdle(HostSim::now() + 60 * HostSim::TICKS_PER_SECOND), "after %.2f s: still going",
+          after);
+
+    size_t pulses = HostSim::pulseTimes(STEP_PIN).size();
+    check(motor.getCurrentPosition() == 2000, "after %.2f s: ended at %d, not 2000", after,
+          motor.getCurrentPosition());
+    check(pulses == 1000, "after %.2f s: %zu pulses for 1000 steps", after, pulses);
+}
+
+int main()
+{
+    for (const Rate &run : rates)
+        checkRate(run);
+    for (double after : takeovers)
+        checkTakeover(after);
+
+    return checkResult("velocity");
+}
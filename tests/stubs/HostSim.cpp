@@ -0,0 +1,1025 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <deque>
+#include <pico/time.h>
+#include <hardware/flash.h>
+#include <hardware/gpio.h>
+#include <hardware/irq.h>
+#include <hardware/pio.h>
+#include <hardware/pwm.h>
+#include <hardware/timer.h>
+#include <hardware/regs/intctrl.h>
+#include <hardware/structs/iobank0.h>
+#include <hardware/structs/timer.h>
+#include "stepper.pio.h"
+#include "HostSim.h"
+
+#define NUM_GPIOS 30
+#define NUM_IRQS 32
+#define NUM_SMS 4
+#define FIFO_DEPTH 4
+
+// Cycles from a PIO segment start to its first rising edge: pull, out, pull
+#define PIO_LEAD_CYCLES 3
+
+struct pio_hw_t
+{
+};
+
+namespace
+{
+    struct Slice
+    {
+        bool enabled;
+        bool irqEnabled;
+        uint32_t div;                       // PWM clock divider in 1/16
+        uint16_t top;
+        uint16_t topBuffered;
+        uint16_t level;
+        uint16_t levelBuffered;
+        uint16_t counter;                   // Counter value at since
+        uint64_t since;
+        uint64_t pulseStart;                // Rising edge of the pulse still high, if any
+        bool held;                          // Stopped with the output high, a restart carries on with it
+        uint32_t starts;
+        uint32_t stops;
+    };
+
+    // A repeating timer is an alarm in the pool, the structure only says
+    // what to call. Adding one again before it is cancelled makes a second
+    // alarm, like on the SDK.
+    struct Timer
+    {
+        int32_t id;
+        repeating_timer_t *timer;
+        uint64_t due;
+    };
+
+    // Hardware alarm, it raises TIMER_IRQ_0 + alarm when it goes off
+    struct Alarm
+    {
+        bool claimed;
+        bool armed;
+        uint64_t due;
+    };
+
+    struct StateMachine
+    {
+        bool claimed;
+        bool enabled;
+        bool running;
+        int pin;
+        std::deque<uint32_t> tx;
+        uint rx;
+        uint64_t freeAt;                    // When the program is back at its first pull
+        uint64_t pushAt;
+    };
+
+    struct Gpio
+    {
+        bool out;
+        bool level;
+        bool input;
+    };
+
+    uint64_t ticks;
+    Slice slices[NUM_PWM_SLICES];
+    uint32_t pwmInterrupts;
+    std::vector<Timer> timers;
+    int32_t lastTimerId;
+    Alarm alarms[NUM_TIMERS];
+    uint32_t timerInterrupts;               // INTR, before INTE masks it
+    StateMachine sms[NUM_SMS];
+    uint32_t pioInterruptSources;
+    Gpio gpios[NUM_GPIOS];
+    irq_handler_t handlers[NUM_IRQS];
+    bool irqEnabled[NUM_IRQS];
+    uint32_t irqCounts[NUM_IRQS];
+    uint64_t irqNanos[NUM_IRQS];
+    std::vector<HostSim::Pulse> recorded;
+    uint32_t flashProgramCount;
+    uint32_t flashEraseCount;
+
+    // Axis driven by a step and direction pin pair, it holds the endstop
+    // input low while it is at or below 0
+    struct Carriage
+    {
+        int step;
+        int dir;
+        int endstop;
+        int position;
+        int lowest;
+    };
+    std::vector<Carriage> carriages;
+
+    // DRV8825 on a step and direction pin pair. M0 to M2 select 1 << mode
+    // microsteps a step, its indexer counts in 1/32 steps.
+    struct Driver
+    {
+        int step;
+        int dir;
+        int modes[3];
+        int position;
+        int lastMove;                       // To take the last pulse back
+        int offGrid;                        // Pulses taken from between steps of their mode
+        bool lastOffGrid;
+    };
+    std::vector<Driver> drivers;
+
+    pio_hw_t pioBlock;
+    pwm_hw_t pwmRegisters;
+    iobank0_hw_t iobank0Registers;
+    timer_hw_t timerRegisters;
+
+    uint64_t microseconds()
+    {
+        return ticks / HostSim::TICKS_PER_US;
+    }
+
+    void interrupt(uint num)
+    {
+        if (irqEnabled[num] && handlers[num])
+        {
+            auto start = std::chrono::steady_clock::now();
+            handlers[num]();
+            irqNanos[num] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            irqCounts[num]++;
+        }
+    }
+
+    uint function(uint pin)
+    {
+        return (iobank0Registers.io[pin].ctrl >> IO_BANK0_GPIO0_CTRL_FUNCSEL_LSB) & 0x1f;
+    }
+
+    void record(int pin, uint64_t time)
+    {
+        recorded.push_back({time, pin});
+
+        for (Carriage &carriage : carriages)
+        {
+            if (carriage.step != pin)
+                continue;
+            carriage.position += gpios[carriage.dir].level ? 1 : -1;
+            carriage.lowest = std::min(carriage.lowest, carriage.position);
+            gpios[carriage.endstop].input = carriage.position > 0;
+        }
+
+        for (Driver &driver : drivers)
+        {
+            if (driver.step != pin)
+                continue;
+
+            int mode = 0;
+            for (int i = 0; i < 3; i++)
+                mode |= gpios[driver.modes[i]].level << i;
+            int stride = 32 >> std::min(mode, 5);
+
+            driver.lastMove = gpios[driver.dir].level ? stride : -stride;
+            driver.lastOffGrid = driver.position % stride != 0;
+            driver.offGrid += driver.lastOffGrid;
+            driver.position += driver.lastMove;
+        }
+    }
+
+    // A pulse taken back before it came out, the last one on its pin
+    void unrecord(int pin)
+    {
+        for (Driver &driver : drivers)
+        {
+            if (driver.step != pin)
+                continue;
+            driver.position -= driver.lastMove;
+            driver.offGrid -= driver.lastOffGrid;
+        }
+    }
+
+    // The step outputs are on channel A, the even pin of each slice
+    void recordPwm(uint slice, uint64_t time)
+    {
+        if (slices[slice].level == 0)
+            return;
+        for (uint pin = 0; pin < NUM_GPIOS; pin += 2)
+        {
+            if (pwm_gpio_to_slice_num(pin) == slice && function(pin) == GPIO_FUNC_PWM)
+                record((int)pin, time);
+        }
+        slices[slice].pulseStart = time;
+    }
+
+    // Interrupts take no time here, so a pulse that the handler stops at the
+    // wrap that started it never came out at all. It was recorded on this
+    // tick, after everything with an earlier time.
+    void dropPwm(uint slice)
+    {
+        uint64_t start = slices[slice].pulseStart;
+        for (size_t i = recorded.size(); i-- > 0 && recorded[i].time >= start;)
+        {
+            const HostSim::Pulse &pulse = recorded[i];
+            if (pulse.time == start && pulse.pin >= 0 && pwm_gpio_to_slice_num(pulse.pin) == slice &&
+                function(pulse.pin) == GPIO_FUNC_PWM)
+            {
+                unrecord(pulse.pin);
+                recorded.erase(recorded.begin() + (ptrdiff_t)i);
+            }
+        }
+    }
+
+    uint16_t counterAt(const Slice &slice, uint64_t time)
+    {
+        if (!slice.enabled)
+            return slice.counter;
+        return (uint16_t)(slice.counter + (time - slice.since) / slice.div);
+    }
+
+    // A counter above TOP runs on to the 16 bit overflow before it comes
+    // round to TOP and wraps
+    uint64_t nextWrap(const Slice &slice)
+    {
+        uint64_t counts = slice.top + 1 - slice.counter;
+        if (slice.counter > slice.top)
+            counts += 65536;
+        return slice.since + counts * slice.div;
+    }
+
+    void freeze(Slice &slice)
+    {
+        slice.counter = counterAt(slice, ticks);
+        slice.since = ticks;
+    }
+
+    // Slices that wrap on the same tick come to the handler together
+    void wrap()
+    {
+        bool raised = false;
+        for (uint num = 0; num < NUM_PWM_SLICES; num++)
+        {
+            Slice &slice = slices[num];
+            if (!slice.enabled || nextWrap(slice) != ticks)
+                continue;
+
+            slice.counter = 0;
+            slice.since = ticks;
+            slice.top = slice.topBuffered;
+            slice.level = slice.levelBuffered;
+            pwmRegisters.slice[num].top = slice.top;
+            pwmRegisters.slice[num].cc = slice.level;
+            recordPwm(num, ticks);
+            if (slice.irqEnabled)
+            {
+                pwmInterrupts |= 1u << num;
+                raised = true;
+            }
+        }
+        if (raised)
+            interrupt(PWM_IRQ_WRAP);
+    }
+
+    Timer *findTimer(int32_t id)
+    {
+        for (Timer &entry : timers)
+        {
+            if (entry.id == id)
+                return &entry;
+        }
+        return nullptr;
+    }
+
+    // The delay is read from the structure after the call, as the SDK does
+    void fireTimer(int32_t id)
+    {
+        repeating_timer_t *timer = findTimer(id)->timer;
+        bool again = timer->callback(timer);
+        Timer *entry = findTimer(id);
+        if (!entry)
+            return;
+        if (!again)
+        {
+            timer->alarm_id = 0;
+            timers.erase(timers.begin() + (entry - timers.data()));
+            return;
+        }
+        uint64_t delay = (uint64_t)std::abs(timer->delay_us) * HostSim::TICKS_PER_US;
+        entry->due = std::max(entry->due + delay, ticks);
+    }
+
+    void fireAlarm(uint num)
+    {
+        alarms[num].armed = false;
+        timerInterrupts |= 1u << num;
+        timerRegisters.ints = timerInterrupts & timerRegisters.inte;
+        if (timerRegisters.ints & (1u << num))
+            interrupt(TIMER_IRQ_0 + num);
+    }
+
+    uint64_t cycles(uint64_t count)
+    {
+        return count * HostSim::TICKS_PER_CYCLE;
+    }
+
+    // Takes the next two words and plays the whole segment. The edges are
+    // recorded up front and taken back if the machine is restarted.
+    void startSegment(uint num)
+    {
+        StateMachine &sm = sms[num];
+        uint64_t start = std::max(sm.freeAt, ticks);
+        uint32_t count = sm.tx.front();
+        sm.tx.pop_front();
+        uint32_t delay = sm.tx.front();
+        sm.tx.pop_front();
+
+        uint64_t step = cycles(2ull * delay + 5);
+        uint64_t edge = start + cycles(PIO_LEAD_CYCLES);
+        for (uint64_t i = 0; i <= count; i++, edge += step)
+            record(sm.pin, edge);
+
+        sm.running = true;
+        sm.pushAt = edge;
+        sm.freeAt = edge + cycles(1);
+    }
+
+    void finishSegment(uint num)
+    {
+        StateMachine &sm = sms[num];
+        sm.running = false;
+        if (sm.rx < FIFO_DEPTH)
+            sm.rx++;
+        if (pioInterruptSources & (1u << num))
+            interrupt(PIO0_IRQ_0);
+    }
+
+    void abortSegment(uint num)
+    {
+        StateMachine &sm = sms[num];
+        if (sm.running)
+        {
+            recorded.erase(std::remove_if(recorded.begin(), recorded.end(),
+                                          [&](const HostSim::Pulse &pulse)
+                                          {
+                                              return pulse.pin == sm.pin && pulse.time > ticks;
+                                          }), recorded.end());
+        }
+        sm.running = false;
+        sm.freeAt = ticks;
+    }
+
+    enum EventKind
+    {
+        EVENT_NONE,
+        EVENT_PWM,
+        EVENT_ALARM,
+        EVENT_TIMER,
+        EVENT_PIO_START,
+        EVENT_PIO_PUSH
+    };
+
+    struct Event
+    {
+        EventKind kind;
+        uint64_t time;
+        uint index;
+    };
+
+    Event nextEvent()
+    {
+        Event next = {EVENT_NONE, UINT64_MAX, 0};
+        auto consider = [&](EventKind kind, uint64_t time, uint index)
+        {
+            if (time < next.time)
+                next = {kind, time, index};
+        };
+
+        for (uint i = 0; i < NUM_PWM_SLICES; i++)
+        {
+            if (slices[i].enabled)
+                consider(EVENT_PWM, nextWrap(slices[i]), i);
+        }
+        for (uint i = 0; i < NUM_TIMERS; i++)
+        {
+            if (alarms[i].armed)
+                consider(EVENT_ALARM, alarms[i].due, i);
+        }
+        for (const Timer &entry : timers)
+            consider(EVENT_TIMER, entry.due, (uint)entry.id);
+        for (uint i = 0; i < NUM_SMS; i++)
+        {
+            const StateMachine &sm = sms[i];
+            if (sm.running)
+                consider(EVENT_PIO_PUSH, sm.pushAt, i);
+            else if (sm.enabled && sm.tx.size() >= 2)
+                consider(EVENT_PIO_START, std::max(sm.freeAt, ticks), i);
+        }
+        return next;
+    }
+
+    bool runNext(uint64_t limit)
+    {
+        Event event = nextEvent();
+        if (event.kind == EVENT_NONE || event.time > limit)
+            return false;
+
+        ticks = std::max(ticks, event.time);
+        switch (event.kind)
+        {
+            case EVENT_PWM:
+                wrap();
+                break;
+            case EVENT_ALARM:
+                fireAlarm(event.index);
+                break;
+            case EVENT_TIMER:
+                fireTimer((int32_t)event.index);
+                break;
+            case EVENT_PIO_START:
+                startSegment(event.index);
+                break;
+            case EVENT_PIO_PUSH:
+                finishSegment(event.index);
+                break;
+            default:
+                break;
+        }
+        return true;
+    }
+}
+
+namespace HostSim
+{
+    void reset(uint64_t startUs)
+    {
+        ticks = startUs * TICKS_PER_US;
+        for (Slice &slice : slices)
+            slice = {false, false, 16, 0xffff, 0xffff, 0, 0, 0, 0, UINT64_MAX, false, 0, 0};
+        pwmInterrupts = 0;
+        timers.clear();
+        lastTimerId = 0;
+        for (Alarm &alarm : alarms)
+            alarm = {false, false, 0};
+        timerInterrupts = 0;
+        for (StateMachine &sm : sms)
+        {
+            sm.claimed = sm.enabled = sm.running = false;
+            sm.pin = -1;
+            sm.tx.clear();
+            sm.rx = 0;
+            sm.freeAt = sm.pushAt = 0;
+        }
+        pioInterruptSources = 0;
+        for (Gpio &gpio : gpios)
+            gpio = {false, false, true};
+        recorded.clear();
+        carriages.clear();
+        drivers.clear();
+        std::fill(std::begin(irqCounts), std::end(irqCounts), 0);
+        std::fill(std::begin(irqNanos), std::end(irqNanos), 0);
+
+        memset((void *)&pwmRegisters, 0, sizeof(pwmRegisters));
+        memset((void *)&iobank0Registers, 0, sizeof(iobank0Registers));
+        timerRegisters = timer_hw_t();
+    }
+
+    uint64_t now()
+    {
+        return ticks;
+    }
+
+    double seconds()
+    {
+        return (double)ticks / TICKS_PER_SECOND;
+    }
+
+    void runUntil(uint64_t limit)
+    {
+        while (runNext(limit))
+            ;
+        ticks = std::max(ticks, limit);
+    }
+
+    void runFor(double seconds)
+    {
+        runUntil(ticks + (uint64_t)(seconds * TICKS_PER_SECOND));
+    }
+
+    bool runUntilIdle(uint64_t limit)
+    {
+        while (runNext(limit))
+            ;
+        return nextEvent().kind == EVENT_NONE;
+    }
+
+    uint32_t interrupts(uint num)
+    {
+        return irqCounts[num];
+    }
+
+    uint64_t interruptNanos(uint num)
+    {
+        return irqNanos[num];
+    }
+
+    uint32_t pwmStarts(uint slice)
+    {
+        return slices[slice].starts;
+    }
+
+    uint32_t pwmStops(uint slice)
+    {
+        return slices[slice].stops;
+    }
+
+    void setInput(int pin, bool level)
+    {
+        gpios[pin].input = level;
+    }
+
+    const std::vector<Pulse> &pulses()
+    {
+        return recorded;
+    }
+
+    std::vector<uint64_t> pulseTimes(int pin)
+    {
+        std::vector<uint64_t> times;
+        for (const Pulse &pulse : recorded)
+        {
+            if (pulse.pin == pin)
+                times.push_back(pulse.time);
+        }
+        std::sort(times.begin(), times.end());
+        return times;
+    }
+
+    void clearPulses()
+    {
+        recorded.clear();
+    }
+
+    void attachCarriage(int stepPin, int dirPin, int endstopPin, int position)
+    {
+        carriages.push_back({stepPin, dirPin, endstopPin, position, position});
+        gpios[endstopPin].input = position > 0;
+    }
+
+    int carriagePosition(int stepPin)
+    {
+        for (const Carriage &carriage : carriages)
+        {
+            if (carriage.step == stepPin)
+                return carriage.position;
+        }
+        return 0;
+    }
+
+    int carriageLowest(int stepPin)
+    {
+        for (const Carriage &carriage : carriages)
+        {
+            if (carriage.step == stepPin)
+                return carriage.lowest;
+        }
+        return 0;
+    }
+
+    void attachDriver(int stepPin, int dirPin, int m0, int m1, int m2)
+    {
+        drivers.push_back({stepPin, dirPin, {m0, m1, m2}, 0, 0, 0, false});
+    }
+
+    int driverPosition(int stepPin)
+    {
+        for (const Driver &driver : drivers)
+        {
+            if (driver.step == stepPin)
+                return driver.position;
+        }
+        return 0;
+    }
+
+    int driverOffGrid(int stepPin)
+    {
+        for (const Driver &driver : drivers)
+        {
+            if (driver.step == stepPin)
+                return driver.offGrid;
+        }
+        return 0;
+    }
+
+    void eraseFlash()
+    {
+        memset(hostFlash, 0xff, sizeof(hostFlash));
+        flashProgramCount = flashEraseCount = 0;
+    }
+
+    uint32_t flashPrograms()
+    {
+        return flashProgramCount;
+    }
+
+    uint32_t flashErases()
+    {
+        return flashEraseCount;
+    }
+}
+
+// Registers
+
+uint8_t hostFlash[PICO_FLASH_SIZE_BYTES];
+
+pwm_hw_t *pwm_hw = &pwmRegisters;
+iobank0_hw_t *iobank0_hw = &iobank0Registers;
+timer_hw_t *timer_hw = &timerRegisters;
+PIO pio0 = &pioBlock;
+
+TimerTimeRegister::operator uint32_t() const
+{
+    uint64_t us = microseconds();
+    return high ? (uint32_t)(us >> 32) : (uint32_t)us;
+}
+
+// The alarm matches the low 32 bits of the microsecond counter, so it goes
+// off the next time they come round to the target
+TimerAlarmRegister &TimerAlarmRegister::operator=(uint32_t target)
+{
+    uint64_t us = microseconds();
+    alarms[alarm].armed = true;
+    alarms[alarm].due = (us + (uint32_t)(target - (uint32_t)us)) * HostSim::TICKS_PER_US;
+    return *this;
+}
+
+TimerClearRegister &TimerClearRegister::operator=(uint32_t mask)
+{
+    if (interrupt)
+    {
+        timerInterrupts &= ~mask;
+        timerRegisters.ints = timerInterrupts & timerRegisters.inte;
+    }
+    else
+    {
+        for (uint i = 0; i < NUM_TIMERS; i++)
+        {
+            if (mask & (1u << i))
+                alarms[i].armed = false;
+        }
+    }
+    return *this;
+}
+
+// pico/time.h
+
+uint64_t time_us_64()
+{
+    return microseconds();
+}
+
+uint32_t time_us_32()
+{
+    return (uint32_t)microseconds();
+}
+
+alarm_pool_t *alarm_pool_get_default()
+{
+    static int pool;
+    return (alarm_pool_t *)&pool;
+}
+
+bool alarm_pool_add_repeating_timer_us(alarm_pool_t *pool, int64_t delay_us, repeating_timer_callback_t callback,
+                                       void *user_data, repeating_timer_t *out)
+{
+    out->delay_us = delay_us;
+    out->pool = pool;
+    out->alarm_id = ++lastTimerId;
+    out->callback = callback;
+    out->user_data = user_data;
+
+    timers.push_back({out->alarm_id, out, ticks + (uint64_t)std::abs(delay_us) * HostSim::TICKS_PER_US});
+    return true;
+}
+
+bool cancel_repeating_timer(repeating_timer_t *timer)
+{
+    Timer *entry = timer->alarm_id ? findTimer(timer->alarm_id) : nullptr;
+    timer->alarm_id = 0;
+    if (!entry)
+        return false;
+    timers.erase(timers.begin() + (entry - timers.data()));
+    return true;
+}
+
+void sleep_ms(uint32_t ms)
+{
+    HostSim::runUntil(ticks + ms * 1000ull * HostSim::TICKS_PER_US);
+}
+
+// hardware/timer.h
+
+int hardware_alarm_claim_unused(bool required)
+{
+    for (uint i = 0; i < NUM_TIMERS; i++)
+    {
+        if (!alarms[i].claimed)
+        {
+            alarms[i].claimed = true;
+            return (int)i;
+        }
+    }
+    if (required)
+        abort();
+    return -1;
+}
+
+void hardware_alarm_unclaim(uint alarm_num)
+{
+    alarms[alarm_num] = {false, false, 0};
+}
+
+// hardware/irq.h
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    handlers[num] = handler;
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler)
+{
+    if (handlers[num] == handler)
+        handlers[num] = nullptr;
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    irqEnabled[num] = enabled;
+}
+
+// hardware/gpio.h
+
+void gpio_init(uint gpio)
+{
+    gpio_set_dir(gpio, GPIO_IN);
+    gpio_put(gpio, false);
+    gpio_set_function(gpio, GPIO_FUNC_SIO);
+}
+
+void gpio_set_function(uint gpio, gpio_function function)
+{
+    iobank0Registers.io[gpio].ctrl = (uint32_t)function << IO_BANK0_GPIO0_CTRL_FUNCSEL_LSB;
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    gpios[gpio].out = out;
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    Gpio &pin = gpios[gpio];
+    if (value && !pin.level && pin.out && function(gpio) == GPIO_FUNC_SIO)
+        record((int)gpio, ticks);
+    pin.level = value;
+}
+
+void gpio_put_masked(uint32_t mask, uint32_t value)
+{
+    for (uint i = 0; i < NUM_GPIOS; i++)
+    {
+        if (mask & (1u << i))
+            gpio_put(i, (value >> i) & 1);
+    }
+}
+
+bool gpio_get(uint gpio)
+{
+    const Gpio &pin = gpios[gpio];
+    if (pin.out && function(gpio) == GPIO_FUNC_SIO)
+        return pin.level;
+    return pin.input;
+}
+
+bool gpio_get_out_level(uint gpio)
+{
+    return gpios[gpio].level;
+}
+
+void gpio_pull_up(uint gpio)
+{
+}
+
+void gpio_disable_pulls(uint gpio)
+{
+}
+
+// hardware/pwm.h
+
+void pwm_set_irq_enabled(uint slice, bool enabled)
+{
+    slices[slice].irqEnabled = enabled;
+}
+
+void pwm_set_clkdiv_mode(uint slice, pwm_clkdiv_mode mode)
+{
+}
+
+void pwm_set_clkdiv_int_frac(uint slice, uint8_t integer, uint8_t fract)
+{
+    freeze(slices[slice]);
+    slices[slice].div = (integer ? integer : 256) * 16 + fract;
+    pwmRegisters.slice[slice].div = slices[slice].div;
+}
+
+// TOP and the compare level are double buffered and take effect at the
+// next wrap, or straight away while the slice is stopped
+void pwm_set_wrap(uint slice, uint16_t wrap)
+{
+    slices[slice].topBuffered = wrap;
+    if (!slices[slice].enabled)
+    {
+        slices[slice].top = wrap;
+        pwmRegisters.slice[slice].top = wrap;
+    }
+}
+
+void pwm_set_chan_level(uint slice, uint chan, uint16_t level)
+{
+    if (chan != PWM_CHAN_A)
+        return;
+    slices[slice].levelBuffered = level;
+    if (!slices[slice].enabled)
+    {
+        slices[slice].level = level;
+        pwmRegisters.slice[slice].cc = level;
+        if (slices[slice].counter >= level)
+            slices[slice].held = false;
+    }
+}
+
+void pwm_set_enabled(uint slice, bool enabled)
+{
+    Slice &state = slices[slice];
+    if (state.enabled == enabled)
+        return;
+    freeze(state);
+    state.enabled = enabled;
+    if (enabled)
+    {
+        state.starts++;
+        pwmRegisters.en |= 1u << slice;
+        if (state.counter < state.level && !state.held)
+            recordPwm(slice, ticks);
+        state.held = false;
+    }
+    else
+    {
+        state.stops++;
+        pwmRegisters.en &= ~(1u << slice);
+        state.held = state.counter < state.level;
+        if (state.pulseStart == ticks && state.held)
+        {
+            dropPwm(slice);
+            state.held = false;
+        }
+    }
+}
+
+void pwm_set_mask_enabled(uint32_t mask)
+{
+    for (uint i = 0; i < NUM_PWM_SLICES; i++)
+        pwm_set_enabled(i, (mask >> i) & 1);
+}
+
+void pwm_set_counter(uint slice, uint16_t count)
+{
+    slices[slice].counter = count;
+    slices[slice].since = ticks;
+    if (count >= slices[slice].level)
+        slices[slice].held = false;
+}
+
+uint16_t pwm_get_counter(uint slice)
+{
+    return counterAt(slices[slice], ticks);
+}
+
+uint32_t pwm_get_irq_status_mask()
+{
+    return pwmInterrupts;
+}
+
+void pwm_clear_irq(uint slice)
+{
+    pwmInterrupts &= ~(1u << slice);
+}
+
+// hardware/pio.h, only what the stepper program needs
+
+uint pio_add_program(PIO pio, const pio_program *program)
+{
+    return 0;
+}
+
+int pio_claim_unused_sm(PIO pio, bool required)
+{
+    for (uint i = 0; i < NUM_SMS; i++)
+    {
+        if (!sms[i].claimed)
+        {
+            sms[i].claimed = true;
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void pio_sm_unclaim(PIO pio, uint sm)
+{
+    sms[sm].claimed = false;
+}
+
+// A stopped machine drops the segment it was in, the motor code restarts it
+// whenever it stops one anyway
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled)
+{
+    if (!enabled)
+        abortSegment(sm);
+    sms[sm].enabled = enabled;
+}
+
+void pio_set_irq0_source_enabled(PIO pio, pio_interrupt_source source, bool enabled)
+{
+    uint sm = source - pis_sm0_rx_fifo_not_empty;
+    if (enabled)
+        pioInterruptSources |= 1u << sm;
+    else
+        pioInterruptSources &= ~(1u << sm);
+}
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm)
+{
+    return (uint)sms[sm].tx.size();
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm)
+{
+    return sms[sm].rx == 0;
+}
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data)
+{
+    if (sms[sm].tx.size() < FIFO_DEPTH)
+        sms[sm].tx.push_back(data);
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm)
+{
+    if (sms[sm].rx)
+        sms[sm].rx--;
+    return 0;
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm)
+{
+    sms[sm].tx.clear();
+    sms[sm].rx = 0;
+}
+
+void pio_sm_restart(PIO pio, uint sm)
+{
+    abortSegment(sm);
+}
+
+void pio_sm_exec(PIO pio, uint sm, uint instruction)
+{
+}
+
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t values, uint32_t mask)
+{
+}
+
+const pio_program stepper_program = {nullptr, 10, -1};
+
+void stepper_program_init(PIO pio, uint sm, uint offset, uint pin)
+{
+    sms[sm].pin = (int)pin;
+    sms[sm].freeAt = ticks;
+    sms[sm].enabled = true;
+}
+
+// hardware/flash.h
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    memset(hostFlash + flash_offs, 0xff, count);
+    flashEraseCount++;
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        hostFlash[flash_offs + i] &= data[i];
+    flashProgramCount++;
+}
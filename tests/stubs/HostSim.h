@@ -0,0 +1,84 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_HOSTSIM_H
+#define PILOMAR_HOSTSIM_H
+
+#include <cstdint>
+#include <vector>
+
+// The peripherals behind the SDK stubs, simulated well enough to run the
+// motor code on the host: PWM slices with double buffered TOP and compare
+// level, the SDK's repeating timers, GPIO and the stepper PIO program.
+// Nothing runs by itself, the tests advance the clock and the interrupt
+// handlers are called at the times the hardware would raise them.
+//
+// Time is kept in 1/16 cycles of the 125 MHz system clock. That makes every
+// PWM period, fractional divider included, a whole number of ticks.
+namespace HostSim
+{
+    const uint64_t TICKS_PER_SECOND = 2000000000ull;
+    const uint64_t TICKS_PER_US = TICKS_PER_SECOND / 1000000;
+    const uint64_t TICKS_PER_CYCLE = 16;
+
+    // Rising edge on an output pin, from the PWM, the PIO or a GPIO write
+    struct Pulse
+    {
+        uint64_t time;
+        int pin;
+    };
+
+    // Back to power on, at startUs on the clock, with no motors left. The
+    // interrupt handlers stay, the motor code installs its shared ones once.
+    void reset(uint64_t startUs = 1000000);
+
+    uint64_t now();
+    double seconds();
+
+    // Runs everything due up to limit, in order, and leaves the clock there
+    void runUntil(uint64_t limit);
+    void runFor(double seconds);
+
+    // Runs until nothing is pending any more, or limit. True if it settled.
+    bool runUntilIdle(uint64_t limit);
+
+    // Handler calls for an interrupt since the last reset, and the host
+    // time they took
+    uint32_t interrupts(unsigned num);
+    uint64_t interruptNanos(unsigned num);
+
+    // Times a PWM slice was switched on and off since the last reset
+    uint32_t pwmStarts(unsigned slice);
+    uint32_t pwmStops(unsigned slice);
+
+    // Level an input pin reads, pins start high like with a pull-up
+    void setInput(int pin, bool level);
+
+    // Rising edges since the last reset, in time order for each pin
+    const std::vector<Pulse> &pulses();
+    std::vector<uint64_t> pulseTimes(int pin);
+    void clearPulses();
+
+    // A carriage at position on the axis of stepPin, counting its rising
+    // edges up while dirPin is high and down while it is low. It holds
+    // endstopPin low at 0 and below. Gone at the next reset.
+    void attachCarriage(int stepPin, int dirPin, int endstopPin, int position);
+    int carriagePosition(int stepPin);
+    int carriageLowest(int stepPin);         // Furthest it went past the endstop
+
+    // A DRV8825 on the axis of stepPin with its mode pins, gone at the next
+    // reset. Its position counts 1/32 steps from where it was attached.
+    // Pulses off the grid of their mode, a full step from half way between
+    // two, are counted.
+    void attachDriver(int stepPin, int dirPin, int m0, int m1, int m2);
+    int driverPosition(int stepPin);
+    int driverOffGrid(int stepPin);
+
+    // The flash keeps its contents over a reset like the real one. Erased
+    // to all ones, and the counts of page programs and sector erases since.
+    void eraseFlash();
+    uint32_t flashPrograms();
+    uint32_t flashErases();
+}
+
+#endif //PILOMAR_HOSTSIM_H
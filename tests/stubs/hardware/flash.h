@@ -0,0 +1,21 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_STUB_HARDWARE_FLASH_H
+#define PILOMAR_STUB_HARDWARE_FLASH_H
+
+#include "pico/platform.h"
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+
+// A small flash, HostSim keeps it in memory and reads it through XIP_BASE
+#define PICO_FLASH_SIZE_BYTES (16 * FLASH_SECTOR_SIZE)
+extern uint8_t hostFlash[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t)hostFlash)
+
+// Like the real part, programming only clears bits
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#endif //PILOMAR_STUB_HARDWARE_FLASH_H
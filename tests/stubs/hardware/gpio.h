@@ -0,0 +1,30 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_STUB_HARDWARE_GPIO_H
+#define PILOMAR_STUB_HARDWARE_GPIO_H
+
+#include "pico/platform.h"
+
+enum gpio_function
+{
+    GPIO_FUNC_PWM = 4,
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_PIO0 = 6,
+    GPIO_FUNC_PIO1 = 7
+};
+
+#define GPIO_OUT 1
+#define GPIO_IN 0
+
+void gpio_init(uint gpio);
+void gpio_set_function(uint gpio, gpio_function function);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+void gpio_put_masked(uint32_t mask, uint32_t value);
+bool gpio_get(uint gpio);
+bool gpio_get_out_level(uint gpio);
+void gpio_pull_up(uint gpio);
+void gpio_disable_pulls(uint gpio);
+
+#endif //PILOMAR_STUB_HARDWARE_GPIO_H
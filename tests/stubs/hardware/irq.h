@@ -0,0 +1,16 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_STUB_HARDWARE_IRQ_H
+#define PILOMAR_STUB_HARDWARE_IRQ_H
+
+#include "pico/platform.h"
+#include "hardware/regs/intctrl.h"
+
+typedef void (*irq_handler_t)();
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_remove_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+
+#endif //PILOMAR_STUB_HARDWARE_IRQ_H
@@ -0,0 +1,45 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_STUB_HARDWARE_PIO_H
+#define PILOMAR_STUB_HARDWARE_PIO_H
+
+#include "pico/platform.h"
+
+struct pio_hw_t;
+typedef pio_hw_t *PIO;
+extern PIO pio0;
+
+struct pio_program
+{
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+};
+
+struct pio_sm_config
+{
+    uint32_t clkdiv;
+};
+
+enum pio_interrupt_source
+{
+    pis_sm0_rx_fifo_not_empty = 0
+};
+
+uint pio_add_program(PIO pio, const pio_program *program);
+int pio_claim_unused_sm(PIO pio, bool required);
+void pio_sm_unclaim(PIO pio, uint sm);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_set_irq0_source_enabled(PIO pio, pio_interrupt_source source, bool enabled);
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+uint32_t pio_sm_get(PIO pio, uint sm);
+void pio_sm_clear_fifos(PIO pio, uint sm);
+void pio_sm_restart(PIO pio, uint sm);
+void pio_sm_exec(PIO pio, uint sm, uint instruction);
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t values, uint32_t mask);
+inline uint pio_encode_jmp(uint address) { return address; }
+
+#endif //PILOMAR_STUB_HARDWARE_PIO_H
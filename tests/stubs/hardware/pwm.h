@@ -0,0 +1,53 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_STUB_HARDWARE_PWM_H
+#define PILOMAR_STUB_HARDWARE_PWM_H
+
+#include "pico/platform.h"
+
+#define NUM_PWM_SLICES 8
+
+enum pwm_chan
+{
+    PWM_CHAN_A = 0,
+    PWM_CHAN_B = 1
+};
+
+enum pwm_clkdiv_mode
+{
+    PWM_DIV_FREE_RUNNING = 0
+};
+
+struct pwm_slice_hw_t
+{
+    volatile uint32_t csr;
+    volatile uint32_t div;
+    volatile uint32_t ctr;
+    volatile uint32_t cc;
+    volatile uint32_t top;                  // The TOP in effect, written back at every wrap
+};
+
+struct pwm_hw_t
+{
+    pwm_slice_hw_t slice[NUM_PWM_SLICES];
+    volatile uint32_t en;
+};
+
+extern pwm_hw_t *pwm_hw;
+
+inline uint pwm_gpio_to_slice_num(uint gpio) { return (gpio >> 1) & 7; }
+
+void pwm_set_irq_enabled(uint slice, bool enabled);
+void pwm_set_clkdiv_mode(uint slice, pwm_clkdiv_mode mode);
+void pwm_set_clkdiv_int_frac(uint slice, uint8_t integer, uint8_t fract);
+void pwm_set_wrap(uint slice, uint16_t wrap);
+void pwm_set_chan_level(uint slice, uint chan, uint16_t level);
+void pwm_set_enabled(uint slice, bool enabled);
+void pwm_set_mask_enabled(uint32_t mask);
+void pwm_set_counter(uint slice, uint16_t count);
+uint16_t pwm_get_counter(uint slice);
+uint32_t pwm_get_irq_status_mask();
+void pwm_clear_irq(uint slice);
+
+#endif //PILOMAR_STUB_HARDWARE_PWM_H
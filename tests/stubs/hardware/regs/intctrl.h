@@ -0,0 +1,12 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_STUB_HARDWARE_REGS_INTCTRL_H
+#define PILOMAR_STUB_HARDWARE_REGS_INTCTRL_H
+
+// RP2040 interrupt numbers
+#define TIMER_IRQ_0 0
+#define PWM_IRQ_WRAP 4
+#define PIO0_IRQ_0 7
+
+#endif //PILOMAR_STUB_HARDWARE_REGS_INTCTRL_H
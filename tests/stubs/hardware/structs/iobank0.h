@@ -0,0 +1,24 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_STUB_HARDWARE_STRUCTS_IOBANK0_H
+#define PILOMAR_STUB_HARDWARE_STRUCTS_IOBANK0_H
+
+#include "pico/platform.h"
+
+#define IO_BANK0_GPIO0_CTRL_FUNCSEL_LSB 0
+
+struct io_status_ctrl_hw_t
+{
+    volatile uint32_t status;
+    volatile uint32_t ctrl;
+};
+
+struct iobank0_hw_t
+{
+    io_status_ctrl_hw_t io[30];
+};
+
+extern iobank0_hw_t *iobank0_hw;
+
+#endif //PILOMAR_STUB_HARDWARE_STRUCTS_IOBANK0_H
@@ -0,0 +1,44 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_STUB_HARDWARE_STRUCTS_TIMER_H
+#define PILOMAR_STUB_HARDWARE_STRUCTS_TIMER_H
+
+#include "pico/platform.h"
+
+// The registers the motor code touches. Reads and writes go to the
+// simulated timer, so they act like the hardware's: the raw time follows
+// the simulation clock, writing an alarm arms it and writing ARMED or INTR
+// clears the bits written.
+struct TimerTimeRegister
+{
+    bool high;
+    operator uint32_t() const;
+};
+
+struct TimerAlarmRegister
+{
+    uint alarm;
+    TimerAlarmRegister &operator=(uint32_t target);
+};
+
+struct TimerClearRegister
+{
+    bool interrupt;                         // INTR, otherwise ARMED
+    TimerClearRegister &operator=(uint32_t mask);
+};
+
+struct timer_hw_t
+{
+    TimerAlarmRegister alarm[4] = {{0}, {1}, {2}, {3}};
+    TimerClearRegister armed = {false};
+    TimerTimeRegister timerawh = {true};
+    TimerTimeRegister timerawl = {false};
+    TimerClearRegister intr = {true};
+    volatile uint32_t inte = 0;
+    volatile uint32_t ints = 0;
+};
+
+extern timer_hw_t *timer_hw;
+
+#endif //PILOMAR_STUB_HARDWARE_STRUCTS_TIMER_H
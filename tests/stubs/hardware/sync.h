@@ -0,0 +1,18 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_STUB_HARDWARE_SYNC_H
+#define PILOMAR_STUB_HARDWARE_SYNC_H
+
+#include "pico/platform.h"
+
+// One core and no real interrupts on the host, the simulation calls the
+// handlers between the code under test's statements
+inline uint32_t save_and_disable_interrupts() { return 0; }
+inline void restore_interrupts(uint32_t) {}
+inline void __dmb() { __asm volatile ("" ::: "memory"); }
+
+inline void hw_set_bits(volatile uint32_t *address, uint32_t mask) { *address |= mask; }
+inline void hw_clear_bits(volatile uint32_t *address, uint32_t mask) { *address &= ~mask; }
+
+#endif //PILOMAR_STUB_HARDWARE_SYNC_H
@@ -0,0 +1,14 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_STUB_HARDWARE_TIMER_H
+#define PILOMAR_STUB_HARDWARE_TIMER_H
+
+#include "pico/time.h"
+
+#define NUM_TIMERS 4
+
+int hardware_alarm_claim_unused(bool required);
+void hardware_alarm_unclaim(uint alarm_num);
+
+#endif //PILOMAR_STUB_HARDWARE_TIMER_H
@@ -0,0 +1,13 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_STUB_PICO_MULTICORE_H
+#define PILOMAR_STUB_PICO_MULTICORE_H
+
+#include "pico/platform.h"
+
+// There is no second core on the host to park
+inline void multicore_lockout_start_blocking() {}
+inline void multicore_lockout_end_blocking() {}
+
+#endif //PILOMAR_STUB_PICO_MULTICORE_H
@@ -0,0 +1,19 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Host stand-in for the parts of the Pico SDK the motor code uses. Only
+// what Motor.cpp needs is declared, see HostSim.h for how it behaves.
+
+#ifndef PILOMAR_STUB_PICO_PLATFORM_H
+#define PILOMAR_STUB_PICO_PLATFORM_H
+
+#include <cstdint>
+#include <cstddef>
+
+typedef unsigned int uint;
+
+#define __not_in_flash_func(name) name
+#define __time_critical_func(name) name
+#define __force_inline inline
+
+#endif //PILOMAR_STUB_PICO_PLATFORM_H
@@ -0,0 +1,61 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef PILOMAR_STUB_PICO_TIME_H
+#define PILOMAR_STUB_PICO_TIME_H
+
+#include "pico/platform.h"
+
+typedef uint64_t absolute_time_t;
+static const absolute_time_t nil_time = 0;
+
+uint64_t time_us_64();
+uint32_t time_us_32();
+
+inline absolute_time_t get_absolute_time() { return time_us_64(); }
+inline uint64_t to_us_since_boot(absolute_time_t time) { return time; }
+inline absolute_time_t from_us_since_boot(uint64_t us) { return us; }
+inline absolute_time_t delayed_by_us(absolute_time_t time, uint64_t us) { return time + us; }
+inline absolute_time_t make_timeout_time_ms(uint32_t ms) { return time_us_64() + ms * 1000ull; }
+inline bool time_reached(absolute_time_t time) { return time_us_64() >= time; }
+inline bool is_nil_time(absolute_time_t time) { return time == nil_time; }
+inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) { return (int64_t)(to - from); }
+
+typedef struct alarm_pool alarm_pool_t;
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t *timer);
+
+// Negative delays are from the due time of the last call, like the SDK's
+struct repeating_timer
+{
+    int64_t delay_us;
+    alarm_pool_t *pool;
+    int32_t alarm_id;
+    repeating_timer_callback_t callback;
+    void *user_data;
+};
+
+alarm_pool_t *alarm_pool_get_default();
+bool alarm_pool_add_repeating_timer_us(alarm_pool_t *pool, int64_t delay_us, repeating_timer_callback_t callback,
+                                       void *user_data, repeating_timer_t *out);
+inline bool alarm_pool_add_repeating_timer_ms(alarm_pool_t *pool, int32_t delay_ms, repeating_timer_callback_t callback,
+                                              void *user_data, repeating_timer_t *out)
+{
+    return alarm_pool_add_repeating_timer_us(pool, (int64_t)delay_ms * 1000, callback, user_data, out);
+}
+inline bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void *user_data,
+                                   repeating_timer_t *out)
+{
+    return alarm_pool_add_repeating_timer_us(alarm_pool_get_default(), delay_us, callback, user_data, out);
+}
+inline bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void *user_data,
+                                   repeating_timer_t *out)
+{
+    return add_repeating_timer_us((int64_t)delay_ms * 1000, callback, user_data, out);
+}
+bool cancel_repeating_timer(repeating_timer_t *timer);
+
+// Runs the simulation for the time, interrupts included
+void sleep_ms(uint32_t ms);
+
+#endif //PILOMAR_STUB_PICO_TIME_H
@@ -0,0 +1,16 @@
+// SPDX-FileCopyrightText: 2024 Melanie Thielker & Leonie Gaertner
+// SPDX-License-Identifier: BSD-3-Clause
+
+// Stands in for what pioasm makes of stepper.pio. The simulated state
+// machine runs the program's timing, see HostSim.cpp.
+
+#ifndef PILOMAR_STUB_STEPPER_PIO_H
+#define PILOMAR_STUB_STEPPER_PIO_H
+
+#include "hardware/pio.h"
+
+extern const pio_program stepper_program;
+
+void stepper_program_init(PIO pio, uint sm, uint offset, uint pin);
+
+#endif //PILOMAR_STUB_STEPPER_PIO_H
@@ -37,6 +37,14 @@ static struct netif netif_data;
 /* shared between tud_network_recv_cb() and service_traffic() */
 static struct pbuf *received_frame;
 
+/* lwip only runs on core0, the motors run on core1. The protection is a spin lock
+   with interrupts off, a few cycles where a mutex took a trip through the SDK. The lock
+   keeps it correct should the other core ever call into lwip. lwip nests these calls,
+   so the owning core just counts. */
+static spin_lock_t *lwip_lock;
+static volatile int lwip_lock_owner = -1;
+static int lwip_lock_count = 0;
+
 /* this is used by this code, ./class/net/net_driver.c, and usb_descriptors.c */
 /* ideally speaking, this should be generated from the hardware's unique ID (if available) */
 /* it is suggested that the first byte is 0x02 to indicate a link-local address */
@@ -111,6 +119,8 @@ void init_lwip(void)
 {
     struct netif *netif = &netif_data;
     
+    lwip_lock = spin_lock_init(spin_lock_claim_unused(true));
+
     /* Initialize lwip */
     lwip_init();
     
@@ -207,38 +217,33 @@ void wait_for_netif_is_up()
 
 
 /* lwip platform specific routines for Pico */
-static mutex_t lwip_mutex;
-static int lwip_mutex_count = 0;
+
 
 sys_prot_t sys_arch_protect(void)
 {
-    uint32_t owner;
-    if (!mutex_try_enter(&lwip_mutex, &owner))
+    uint32_t interrupts = save_and_disable_interrupts();
+    int core = (int)get_core_num();
+
+    if (lwip_lock_owner != core)
     {
-        if (owner != get_core_num())
-        {
-            // Wait until other core releases mutex
-            mutex_enter_blocking(&lwip_mutex);
-        }
+        spin_lock_unsafe_blocking(lwip_lock);
+        lwip_lock_owner = core;
     }
 
-    lwip_mutex_count++;
-    
-    return 0;
+    lwip_lock_count++;
+
+    return interrupts;
 }
 
 void sys_arch_unprotect(sys_prot_t pval)
 {
-    (void)pval;
-    
-    if (lwip_mutex_count)
+    if (lwip_lock_count && !--lwip_lock_count)
     {
-        lwip_mutex_count--;
-        if (!lwip_mutex_count)
-        {
-            mutex_exit(&lwip_mutex);
-        }
+        lwip_lock_owner = -1;
+        spin_unlock_unsafe(lwip_lock);
     }
+
+    restore_interrupts(pval);
 }
 
 uint32_t sys_now(void)
@@ -113,7 +113,7 @@ std::string HttpRequest::url() const
     return m_url;
 }
 
-std::optional<std::string> HttpRequest::param(std::string name)
+std::optional<std::string> HttpRequest::param(std::string name) const
 {
     return getValue(m_params, std::move(name));
 }
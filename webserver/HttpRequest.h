@@ -15,7 +15,7 @@ public:
     explicit HttpRequest(const char *request);
     std::string method() const;
     std::string url() const;
-    std::optional<std::string> param(std::string name);
+    std::optional<std::string> param(std::string name) const;
 //    std::list<std::string> params(std::string name);
     std::optional<std::string> header(std::string name);
 //    std::list<std::string> headers(std::string name);